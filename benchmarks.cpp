@@ -2,6 +2,7 @@
  * yanta main file. Initializes all objects, views, and visualizers.
  */
 
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <boost/timer/timer.hpp>
@@ -16,6 +17,7 @@
 
 #include <gui/SkiaDocumentPainter.h>
 #include <io/DocumentReader.h>
+#include <tools/ErasorKernel.h>
 
 util::ProgramOption optionFilename(
 		util::_long_name        = "file",
@@ -79,6 +81,165 @@ void testSkia(gui::skia_pixel_t* data, unsigned int width, unsigned int height,
 	MEASURE(10, painter.draw(canvas), timer, "draw document:");
 }
 
+/**
+ * Reference for the erasor kernel, as Erasor tested lines before: the squared 
+ * distance of p to the line from a to b.
+ */
+double distance2(const util::point<double>& p, const util::point<double>& a, const util::point<double>& b) {
+
+	util::point<double> ab = b - a;
+	util::point<double> ap = p - a;
+
+	double length2 = ab.x*ab.x + ab.y*ab.y;
+	double t = (length2 > 0 ? std::max(0.0, std::min(1.0, (ap.x*ab.x + ap.y*ab.y)/length2)) : 0.0);
+
+	util::point<double> diff = ap - ab*t;
+
+	return diff.x*diff.x + diff.y*diff.y;
+}
+
+/**
+ * Reference for the erasor kernel: whether the lines p + t*r and q + u*s, with 
+ * t and u in [0,1], intersect.
+ */
+bool intersectLines(const util::point<double>& p, const util::point<double>& r, const util::point<double>& q, const util::point<double>& s) {
+
+	double rXs = r.x*s.y - r.y*s.x;
+
+	util::point<double> pq = q - p;
+
+	double t = (pq.x*s.y - pq.y*s.x)/rXs;
+	double u = (pq.x*r.y - pq.y*r.x)/rXs;
+
+	return t >= 0 && t <= 1 && u >= 0 && u <= 1;
+}
+
+/**
+ * Reference for the erasor kernel: the squared distance between the lines 
+ * from a0 to a1 and from b0 to b1.
+ */
+double distance2(const util::point<double>& a0, const util::point<double>& a1, const util::point<double>& b0, const util::point<double>& b1) {
+
+	if (intersectLines(a0, a1 - a0, b0, b1 - b0))
+		return 0;
+
+	return std::min(
+			std::min(distance2(a0, b0, b1), distance2(a1, b0, b1)),
+			std::min(distance2(b0, a0, a1), distance2(b1, a0, a1)));
+}
+
+// the stroke points [begin, end) of a stroke
+typedef std::vector<std::pair<unsigned long, unsigned long> > strokes_type;
+
+unsigned long findHitsPerLine(
+		const StrokePoints& points,
+		const strokes_type& strokes,
+		const util::point<double>& start,
+		const util::point<double>& end,
+		double radius,
+		std::vector<std::vector<bool> >& hits) {
+
+	unsigned long numHits = 0;
+
+	hits.resize(strokes.size());
+
+	for (unsigned int s = 0; s < strokes.size(); s++) {
+
+		unsigned long begin = strokes[s].first;
+		unsigned long last  = strokes[s].second - 1;
+
+		hits[s].assign(last - begin, false);
+
+		for (unsigned long i = begin; i < last; i++)
+			if (distance2(points[i].position, points[i+1].position, start, end) < radius*radius) {
+
+				hits[s][i - begin] = true;
+				numHits++;
+			}
+	}
+
+	return numHits;
+}
+
+unsigned long findHitsKernel(
+		const StrokePoints& points,
+		const strokes_type& strokes,
+		const util::point<double>& start,
+		const util::point<double>& end,
+		double radius,
+		std::vector<std::vector<unsigned int> >& hits) {
+
+	unsigned long numHits = 0;
+
+	hits.resize(strokes.size());
+
+	ErasorKernel kernel(start, end, radius);
+	for (unsigned int s = 0; s < strokes.size(); s++)
+		numHits += kernel.findHits(points, strokes[s].first, strokes[s].second, hits[s]);
+
+	return numHits;
+}
+
+/**
+ * Count the lines on which the hits of the reference and the kernel differ.
+ */
+unsigned long compareHits(
+		const std::vector<std::vector<bool> >&         lineHits,
+		const std::vector<std::vector<unsigned int> >& kernelHits) {
+
+	unsigned long numDifferent = 0;
+
+	for (unsigned int s = 0; s < lineHits.size(); s++)
+		for (unsigned long j = 0; j < lineHits[s].size(); j++)
+			if (lineHits[s][j] != ErasorKernel::isHit(kernelHits[s], j))
+				numDifferent++;
+
+	return numDifferent;
+}
+
+void testErasor(boost::timer::cpu_timer& timer) {
+
+	// dense hatching: 400 wavy strokes of 250 points each, 0.25 units apart
+	StrokePoints points;
+	strokes_type strokes;
+	for (int line = 0; line < 400; line++) {
+
+		unsigned long begin = points.size();
+
+		for (int i = 0; i < 250; i++)
+			points.add(StrokePoint(util::point<double>(0.4*i, 0.25*line + 0.1*sin(0.7*i)), 1.0, 0));
+
+		strokes.push_back(std::make_pair(begin, points.size()));
+	}
+
+	util::point<double> start(50, 50);
+	util::point<double> end(53, 52);
+
+	std::vector<std::vector<bool> >         lineHits;
+	std::vector<std::vector<unsigned int> > kernelHits;
+
+	MEASURE(100, findHitsPerLine(points, strokes, start, end, 1.0, lineHits), timer, "erase line by line");
+	MEASURE(100, findHitsKernel(points, strokes, start, end, 1.0, kernelHits), timer, "erase with kernel ");
+
+	// the kernel has to find the same lines for erasor moves all over the 
+	// hatching, including short ones and ones that don't move at all
+	unsigned long numHits      = 0;
+	unsigned long numDifferent = 0;
+	for (int i = 0; i < 200; i++) {
+
+		util::point<double> moveStart(0.5*(i%200), 0.5*(i*37%200));
+		util::point<double> moveEnd = moveStart + util::point<double>(0.05*(i%7) - 0.15, 0.03*(i%11) - 0.15);
+
+		numHits      += findHitsPerLine(points, strokes, moveStart, moveEnd, 0.3 + 0.01*(i%50), lineHits);
+		findHitsKernel(points, strokes, moveStart, moveEnd, 0.3 + 0.01*(i%50), kernelHits);
+		numDifferent += compareHits(lineHits, kernelHits);
+	}
+
+	std::cout
+			<< "    " << numDifferent << " of " << numHits
+			<< " lines hit by 200 erasor moves differ from the line by line test" << std::endl;
+}
+
 void loadTexture(gui::Texture& texture, gui::skia_pixel_t* data) {
 
 	texture.loadData(data);
@@ -156,6 +317,10 @@ int main(int optionc, char** optionv) {
 			MEASURE(1000, loadTexture(texture, util::rect<unsigned int>(100, 100, 356, 356), data), timer, "load texture (roi)");
 
 			delete[] data;
+
+			std::cout << std::endl << "testing the erasor on 400 strokes of hatching" << std::endl << std::endl;
+
+			testErasor(timer);
 		}
 
 	} catch (Exception& e) {
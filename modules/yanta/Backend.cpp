@@ -1,15 +1,46 @@
 #include <gui/Modifiers.h>
 #include <util/Logger.h>
+#include <util/ProgramOptions.h>
 #include <tools/Erasor.h>
 #include "Backend.h"
 
 logger::LogChannel backendlog("backendlog", "[Backend] ");
 
+util::ProgramOption optionMinStrokePointDistance(
+	util::_long_name        = "minStrokePointDistance",
+	util::_description_text = "Pen samples closer than this (in millimeters) to the previous stroke point are dropped, unless the pressure changed considerably.",
+	util::_default_value    = 0.05);
+
+util::ProgramOption optionMinStrokePointInterval(
+	util::_long_name        = "minStrokePointInterval",
+	util::_description_text = "Pen samples less than this number of milliseconds after the previous stroke point are dropped, unless the pressure changed considerably.",
+	util::_default_value    = 0);
+
+util::ProgramOption optionStrokePointSpacing(
+	util::_long_name        = "strokePointSpacing",
+	util::_description_text = "Resample strokes to stroke points with this spacing in millimeters. Set to 0 to keep the pen samples.",
+	util::_default_value    = 0);
+
+util::ProgramOption optionUndoMemory(
+	util::_long_name        = "undoMemory",
+	util::_description_text = "The amount of memory in MB to use for the undo history.",
+	util::_default_value    = 16);
+
 Backend::Backend() :
 	_penDown(false),
 	_mode(Draw),
 	_initialDocumentChanged(false),
-	_penModeChanged(true) {
+	_penModeChanged(true),
+	_strokePointFilter(
+			optionMinStrokePointDistance.as<double>(),
+			optionMinStrokePointInterval.as<unsigned long>(),
+			optionStrokePointSpacing.as<double>()),
+	_history(optionUndoMemory.as<unsigned long>()*1024*1024),
+	_stopped(false),
+	_inputThread(boost::bind(&Backend::processInput, this)),
+	_compactionPending(false),
+	_compactionRequested(false),
+	_compactionThread(boost::bind(&Backend::compact, this)) {
 
 	registerInput(_initialDocument, "initial document", pipeline::Optional);
 	registerInput(_penMode, "pen mode");
@@ -21,9 +52,12 @@ Backend::Backend() :
 	_penMode.registerBackwardCallback(&Backend::onPenModeChanged, this);
 	_osdRequest.registerBackwardCallback(&Backend::onAdd, this);
 	_osdRequest.registerBackwardCallback(&Backend::onRemove, this);
+	_osdRequest.registerBackwardCallback(&Backend::onUndo, this);
+	_osdRequest.registerBackwardCallback(&Backend::onRedo, this);
 
 	_document.registerForwardSlot(_documentChangedArea);
 	_document.registerForwardSlot(_strokePointAdded);
+	_document.registerForwardSlot(_strokeFinished);
 	_document.registerForwardCallback(&Backend::onPenDown, this);
 	_document.registerForwardCallback(&Backend::onPenMove, this);
 	_document.registerForwardCallback(&Backend::onPenUp, this);
@@ -38,15 +72,40 @@ Backend::Backend() :
 	setDependency(_osdRequest, _tools);
 }
 
+Backend::~Backend() {
+
+	{
+		boost::lock_guard<boost::mutex> lock(_inputMutex);
+		_stopped = true;
+	}
+
+	_inputAvailable.notify_one();
+	_inputThread.join();
+
+	_compactionThread.interrupt();
+	_compactionThread.join();
+}
+
 void
 Backend::cleanup() {
 
+	boost::lock_guard<boost::mutex> lock(_document->getMutex());
+
+	// don't lose the last pen events
+	processEvents();
+
+	compactErased();
+
 	anchorSelection();
 }
 
 void
 Backend::updateOutputs() {
 
+	boost::lock_guard<boost::mutex> lock(_document->getMutex());
+
+	compactErased();
+
 	if (_initialDocumentChanged) {
 
 		if (_initialDocument && _initialDocument->numPages() > 0) {
@@ -54,8 +113,12 @@ Backend::updateOutputs() {
 			LOG_DEBUG(backendlog) << "have initial document, loading them" << std::endl;
 			LOG_ALL(backendlog) << "initial document has " << _initialDocument->numStrokes() << " strokes on " << _initialDocument->numPages() << " pages" << std::endl;
 
+			// shares the stroke points with the initial document
 			*_document = *_initialDocument;
 
+			// the changes recorded so far refer to the previous document
+			_history.clear();
+
 			LOG_ALL(backendlog) << "copy has " << _document->numStrokes() << " strokes on " << _document->numPages() << " pages" << std::endl;
 
 		} else {
@@ -75,19 +138,8 @@ Backend::updateOutputs() {
 
 		_mode = Erase;
 
-		if (_penDown) {
-
-			_document->finishCurrentStroke();
-
-			double penWidth = _penMode->getStyle().width();
-			util::rect<DocumentPrecision> area(
-					_previousPosition.x - penWidth,
-					_previousPosition.y - penWidth,
-					_previousPosition.x + penWidth,
-					_previousPosition.y + penWidth);
-			StrokePointAdded signal(area);
-			_strokePointAdded(signal);
-		}
+		if (_penDown)
+			finishStroke();
 
 		_penModeChanged = false;
 	}
@@ -110,8 +162,131 @@ Backend::onPenModeChanged(const pipeline::Modified&) {
 void
 Backend::onPenDown(const gui::PenDown& signal) {
 
+	PenEvent event;
+	event.type = PenEvent::Down;
+	event.down = signal;
+
+	queueEvent(event);
+}
+
+void
+Backend::onPenUp(const gui::PenUp& signal) {
+
+	PenEvent event;
+	event.type = PenEvent::Up;
+	event.up   = signal;
+
+	queueEvent(event);
+}
+
+void
+Backend::onPenMove(const gui::PenMove& signal) {
+
+	PenEvent event;
+	event.type = PenEvent::Move;
+	event.move = signal;
+
+	queueEvent(event);
+}
+
+void
+Backend::queueEvent(const PenEvent& event) {
+
+	if (!_inputQueue.push(event)) {
+
+		// the input thread is far behind, the stroke will just continue with 
+		// the next pen move
+		if (event.type == PenEvent::Move) {
+
+			LOG_DEBUG(backendlog) << "input queue is full, dropping a pen move" << std::endl;
+			return;
+		}
+
+		// pen downs and ups can't be dropped, wait for the input thread to 
+		// make room (the timeout catches notifications we missed)
+		boost::unique_lock<boost::mutex> lock(_inputMutex);
+
+		while (!_inputQueue.push(event) && !_stopped)
+			_inputProcessed.timed_wait(lock, boost::posix_time::milliseconds(10));
+	}
+
+	boost::lock_guard<boost::mutex> lock(_inputMutex);
+	_inputAvailable.notify_one();
+}
+
+void
+Backend::processInput() {
+
+	LOG_DEBUG(backendlog) << "input thread started" << std::endl;
+
+	while (true) {
+
+		{
+			boost::unique_lock<boost::mutex> lock(_inputMutex);
+
+			while (_inputQueue.empty() && !_stopped)
+				_inputAvailable.wait(lock);
+
+			if (_stopped)
+				break;
+		}
+
+		{
+			boost::lock_guard<boost::mutex> lock(_document->getMutex());
+
+			processEvents();
+		}
+
+		_inputProcessed.notify_all();
+	}
+
+	LOG_DEBUG(backendlog) << "input thread stopped" << std::endl;
+}
+
+void
+Backend::processEvents() {
+
+	PenEvent     event;
+	unsigned int numEvents = 0;
+
+	// everything that arrived so far, but not more than fits into the queue to 
+	// not starve the pipeline
+	while (numEvents < InputQueueSize && _inputQueue.pop(event)) {
+
+		switch (event.type) {
+
+			case PenEvent::Down:
+				flushStrokePoints();
+				processPenDown(event.down);
+				break;
+
+			case PenEvent::Move:
+				processPenMove(event.move);
+				break;
+
+			case PenEvent::Up:
+				flushStrokePoints();
+				processPenUp(event.up);
+				break;
+		}
+
+		numEvents++;
+	}
+
+	flushStrokePoints();
+
+	LOG_ALL(backendlog) << "processed " << numEvents << " pen events" << std::endl;
+}
+
+void
+Backend::processPenDown(const gui::PenDown& signal) {
+
 	LOG_DEBUG(backendlog) << "pen down (button " << signal.button << ")" << std::endl;
 
+	// the previous erase operation has to be complete before the next one 
+	// starts
+	compactErased();
+
 	_previousPosition = signal.position;
 
 	if (signal.button == gui::buttons::Left) {
@@ -136,7 +311,11 @@ Backend::onPenDown(const gui::PenDown& signal) {
 			_lasso = boost::make_shared<Lasso>();
 			_lasso->addPoint(signal.position);
 			_lassoStartPosition = signal.position;
-			_tools->add(_lasso);
+
+			{
+				boost::lock_guard<boost::mutex> lock(_tools->getMutex());
+				_tools->add(_lasso);
+			}
 
 			return;
 		}
@@ -147,12 +326,15 @@ Backend::onPenDown(const gui::PenDown& signal) {
 
 			_document->createNewStroke(signal.position, signal.pressure, signal.timestamp);
 			_document->setCurrentStrokeStyle(_penMode->getStyle());
+			_strokeArea = util::rect<DocumentPrecision>(signal.position.x, signal.position.y, signal.position.x, signal.position.y);
+			_strokePointFilter.reset(StrokePoint(signal.position, signal.pressure, signal.timestamp));
+			_lastAdded = signal.position;
 		}
 	}
 }
 
 void
-Backend::onPenUp(const gui::PenUp& signal) {
+Backend::processPenUp(const gui::PenUp& signal) {
 
 	LOG_DEBUG(backendlog) << "pen up (button " << signal.button << ")" << std::endl;
 
@@ -169,7 +351,7 @@ Backend::onPenUp(const gui::PenUp& signal) {
 			anchorSelection();
 			clearSelection();
 
-			Selection selection = Selection::CreateFromPath(_lasso->getPath(), *_document);
+			Selection selection = Selection::CreateFromPath(_lasso->getPath(), *_document, &_history);
 
 			if (selection.size() > 0) {
 
@@ -179,7 +361,10 @@ Backend::onPenUp(const gui::PenUp& signal) {
 				_documentChangedArea(documentSignal);
 			}
 
-			_tools->remove(_lasso);
+			{
+				boost::lock_guard<boost::mutex> lock(_tools->getMutex());
+				_tools->remove(_lasso);
+			}
 
 			ChangedArea toolsSignal(_lasso->getBoundingBox());
 			_toolsChangedArea(toolsSignal);
@@ -190,28 +375,30 @@ Backend::onPenUp(const gui::PenUp& signal) {
 
 			LOG_DEBUG(backendlog) << "accepting" << std::endl;
 
-			_document->addStrokePoint(signal.position, signal.pressure, signal.timestamp);
-			_document->finishCurrentStroke();
-
-			double penWidth = _penMode->getStyle().width();
-			util::rect<DocumentPrecision> area(_previousPosition.x, _previousPosition.y, _previousPosition.x, _previousPosition.y);
-			area.fit(signal.position);
-			area.minX -= penWidth;
-			area.minY -= penWidth;
-			area.maxX += penWidth;
-			area.maxY += penWidth;
-			StrokePointAdded signal(area);
-			_strokePointAdded(signal);
+			_strokePointFilter.add(StrokePoint(signal.position, signal.pressure, signal.timestamp), _addedPoints);
+			_strokeArea.fit(signal.position);
+
+			finishStroke();
+
+		} else if (_mode == Erase) {
+
+			finishErasing();
 		}
 
 	} else {
 
+		if (_mode == Erase)
+			finishErasing();
+
 		_mode = Draw;
 
 		if (_penDown) {
 
 			_document->createNewStroke(signal.position, signal.pressure, signal.timestamp);
 			_document->setCurrentStrokeStyle(_penMode->getStyle());
+			_strokeArea = util::rect<DocumentPrecision>(signal.position.x, signal.position.y, signal.position.x, signal.position.y);
+			_strokePointFilter.reset(StrokePoint(signal.position, signal.pressure, signal.timestamp));
+			_lastAdded = signal.position;
 		}
 	}
 
@@ -219,7 +406,7 @@ Backend::onPenUp(const gui::PenUp& signal) {
 }
 
 void
-Backend::onPenMove(const gui::PenMove& signal) {
+Backend::processPenMove(const gui::PenMove& signal) {
 
 	if (!_penDown)
 		return;
@@ -241,20 +428,27 @@ Backend::onPenMove(const gui::PenMove& signal) {
 
 	} else if (_penMode->getMode() == PenMode::Lasso) {
 
-		if (!_lasso) {
+		{
+			// the overlay painter draws the tools in another thread
+			boost::lock_guard<boost::mutex> lock(_tools->getMutex());
 
-			_lasso = boost::make_shared<Lasso>();
-			_lassoStartPosition = signal.position;
-			_tools->add(_lasso);
+			if (!_lasso) {
+
+				_lasso = boost::make_shared<Lasso>();
+				_lassoStartPosition = signal.position;
+				_tools->add(_lasso);
+			}
+
+			_lasso->addPoint(signal.position);
 		}
 
-		_lasso->addPoint(signal.position);
 		LassoPointAdded pointAdded(_lassoStartPosition, _previousPosition, signal.position);
 		_lassoPointAdded(pointAdded);
 
 	} else if (_mode == Erase) {
 
 		Erasor erasor(*_document);
+		erasor.setHistory(&_history);
 		erasor.setMode(_penMode->getErasorMode());
 		erasor.setRadius(0.5*_penMode->getStyle().width());
 		util::rect<DocumentPrecision> dirtyArea = erasor.erase(_previousPosition, signal.position);
@@ -267,17 +461,9 @@ Backend::onPenMove(const gui::PenMove& signal) {
 
 	} else {
 
-		_document->addStrokePoint(signal.position, signal.pressure, signal.timestamp);
-
-		double penWidth = _penMode->getStyle().width();
-		util::rect<DocumentPrecision> area(_previousPosition.x, _previousPosition.y, _previousPosition.x, _previousPosition.y);
-		area.fit(signal.position);
-		area.minX -= penWidth;
-		area.minY -= penWidth;
-		area.maxX += penWidth;
-		area.maxY += penWidth;
-		StrokePointAdded addedSignal(area);
-		_strokePointAdded(addedSignal);
+		// added to the document after the whole batch of events
+		_strokePointFilter.add(StrokePoint(signal.position, signal.pressure, signal.timestamp), _addedPoints);
+		_strokeArea.fit(signal.position);
 	}
 
 	_previousPosition = signal.position;
@@ -286,6 +472,10 @@ Backend::onPenMove(const gui::PenMove& signal) {
 void
 Backend::onAdd(const Add& /*signal*/) {
 
+	boost::lock_guard<boost::mutex> lock(_document->getMutex());
+
+	compactErased();
+
 	// if there are no selections, add a page
 	if (_document->size<Selection>() == 0) {
 
@@ -318,6 +508,10 @@ Backend::onAdd(const Add& /*signal*/) {
 void
 Backend::onRemove(const Remove& /*signal*/) {
 
+	boost::lock_guard<boost::mutex> lock(_document->getMutex());
+
+	compactErased();
+
 	for (unsigned int i = 0; i < _document->size<Selection>(); i++) {
 
 		Selection& selection = _document->get<Selection>(i);
@@ -330,6 +524,52 @@ Backend::onRemove(const Remove& /*signal*/) {
 	clearSelection();
 }
 
+void
+Backend::onUndo(const Undo& /*signal*/) {
+
+	boost::lock_guard<boost::mutex> lock(_document->getMutex());
+
+	compactErased();
+
+	if (_penDown) {
+
+		LOG_DEBUG(backendlog) << "not undoing while the pen is down" << std::endl;
+		return;
+	}
+
+	// a floating selection belongs to the last operation, put it down first
+	anchorSelection();
+	clearSelection();
+
+	historyChanged(_history.undo(*_document));
+}
+
+void
+Backend::onRedo(const Redo& /*signal*/) {
+
+	boost::lock_guard<boost::mutex> lock(_document->getMutex());
+
+	compactErased();
+
+	if (_penDown) {
+
+		LOG_DEBUG(backendlog) << "not redoing while the pen is down" << std::endl;
+		return;
+	}
+
+	historyChanged(_history.redo(*_document));
+}
+
+void
+Backend::historyChanged(const util::rect<DocumentPrecision>& area) {
+
+	if (area.isZero())
+		return;
+
+	ChangedArea signal(area);
+	_documentChangedArea(signal);
+}
+
 void
 Backend::anchorSelection() {
 
@@ -337,7 +577,7 @@ Backend::anchorSelection() {
 
 		Selection& selection = _document->get<Selection>(i);
 
-		selection.anchor(*_document);
+		selection.anchor(*_document, &_history);
 
 		ChangedArea changedArea(selection.getBoundingBox());
 		_documentChangedArea(changedArea);
@@ -349,4 +589,127 @@ void
 Backend::clearSelection() {
 
 	_document->clear<Selection>();
+
+	_history.end();
+}
+
+void
+Backend::endOperation() {
+
+	if (_document->size<Selection>() == 0)
+		_history.end();
+}
+
+void
+Backend::finishStroke() {
+
+	// the last sample has to be part of the stroke
+	_strokePointFilter.finish(_addedPoints);
+
+	LOG_ALL(backendlog) << "the stroke point filter dropped " << _strokePointFilter.numDropped() << " samples" << std::endl;
+
+	flushStrokePoints();
+
+	_document->finishCurrentStroke();
+
+	unsigned int page = _document->getCurrentPageIndex();
+	_history.strokeAdded(page, _document->getPage(page).numStrokes() - 1, _document->getPage(page).currentStroke());
+	endOperation();
+
+	double penWidth = _penMode->getStyle().width();
+	util::rect<DocumentPrecision> area = _strokeArea;
+	area.minX -= penWidth;
+	area.minY -= penWidth;
+	area.maxX += penWidth;
+	area.maxY += penWidth;
+
+	StrokeFinished signal(area);
+	_strokeFinished(signal);
+}
+
+void
+Backend::finishErasing() {
+
+	// the fragments left by the erasor are cleaned up in the compaction 
+	// thread, the operation stays open until then
+	_compactionPending = true;
+
+	{
+		boost::lock_guard<boost::mutex> lock(_compactionMutex);
+		_compactionRequested = true;
+	}
+
+	_erasingFinished.notify_one();
+}
+
+void
+Backend::compact() {
+
+	LOG_DEBUG(backendlog) << "compaction thread started" << std::endl;
+
+	try {
+
+		while (true) {
+
+			{
+				boost::unique_lock<boost::mutex> lock(_compactionMutex);
+
+				while (!_compactionRequested)
+					_erasingFinished.wait(lock);
+
+				_compactionRequested = false;
+			}
+
+			// the input thread might have done it already
+			boost::lock_guard<boost::mutex> lock(_document->getMutex());
+
+			compactErased();
+		}
+
+	} catch (boost::thread_interrupted& e) {}
+
+	LOG_DEBUG(backendlog) << "compaction thread stopped" << std::endl;
+}
+
+void
+Backend::compactErased() {
+
+	if (!_compactionPending)
+		return;
+
+	// clean up the fragments left by the erasor, as part of the same operation
+	_document->compactStrokes(&_history);
+
+	endOperation();
+
+	_compactionPending = false;
+}
+
+void
+Backend::flushStrokePoints() {
+
+	if (_addedPoints.empty())
+		return;
+
+	// the new lines start at the last point of the stroke
+	util::rect<DocumentPrecision> area(_lastAdded.x, _lastAdded.y, _lastAdded.x, _lastAdded.y);
+	for (unsigned int i = 0; i < _addedPoints.size(); i++)
+		area.fit(_addedPoints[i].position);
+
+	double penWidth = _penMode->getStyle().width();
+	area.minX -= penWidth;
+	area.minY -= penWidth;
+	area.maxX += penWidth;
+	area.maxY += penWidth;
+
+	_document->addStrokePoints(_addedPoints);
+	_lastAdded = _addedPoints.back().position;
+
+	const Page&   page   = _document->getCurrentPage();
+	const Stroke& stroke = page.currentStroke();
+
+	StrokePointAdded signal(area, stroke.begin(), stroke.end(), stroke.getStyle(), page.getShift());
+	_strokePointAdded(signal);
+
+	_addedPoints.clear();
 }
@@ -1,17 +1,22 @@
 #ifndef YANTA_BACKEND_H__
 #define YANTA_BACKEND_H__
 
+#include <boost/thread.hpp>
+
 #include <gui/PenSignals.h>
 #include <pipeline/all.h>
 
 #include <document/DocumentSignals.h>
+#include <document/History.h>
 #include <document/Selection.h>
+#include <document/StrokePointFilter.h>
 #include <gui/BackendPainter.h>
 #include <gui/OsdRequest.h>
 #include <gui/OsdSignals.h>
 #include <tools/ToolSignals.h>
 #include <tools/PenMode.h>
 #include <tools/Lasso.h>
+#include <util/spsc_queue.hpp>
 
 class Backend : public pipeline::SimpleProcessNode<> {
 
@@ -19,6 +24,8 @@ public:
 
 	Backend();
 
+	~Backend();
+
 	/**
 	 * Finish pending operations like anchoring floating selections. This will 
 	 * be called before the application saves and quits.
@@ -34,6 +41,27 @@ private:
 		DragSelection
 	};
 
+	/**
+	 * A pen signal, waiting to be processed by the input thread.
+	 */
+	struct PenEvent {
+
+		enum Type {
+
+			Down,
+			Move,
+			Up
+		};
+
+		Type         type;
+		gui::PenDown down;
+		gui::PenMove move;
+		gui::PenUp   up;
+	};
+
+	// the maximal number of pen events waiting to be processed
+	static const unsigned int InputQueueSize = 4096;
+
 	void updateOutputs();
 
 	void onInitialDocumentChanged(const pipeline::Modified&);
@@ -43,13 +71,76 @@ private:
 	void onPenUp(const gui::PenUp& signal);
 	void onPenMove(const gui::PenMove& signal);
 
+	/**
+	 * Hand a pen event over to the input thread.
+	 */
+	void queueEvent(const PenEvent& event);
+
+	/**
+	 * Main loop of the input thread.
+	 */
+	void processInput();
+
+	/**
+	 * Process all queued pen events. The document mutex has to be held by the 
+	 * caller.
+	 */
+	void processEvents();
+
+	void processPenDown(const gui::PenDown& signal);
+	void processPenUp(const gui::PenUp& signal);
+	void processPenMove(const gui::PenMove& signal);
+
 	void onAdd(const Add& signal);
 	void onRemove(const Remove& signal);
+	void onUndo(const Undo& signal);
+	void onRedo(const Redo& signal);
 
 	void anchorSelection();
 
 	void clearSelection();
 
+	/**
+	 * Finish the current operation in the history, unless there is a floating 
+	 * selection, which collects all changes until it is anchored or removed.
+	 */
+	void endOperation();
+
+	/**
+	 * Send a signal for an area changed by undo or redo.
+	 */
+	void historyChanged(const util::rect<DocumentPrecision>& area);
+
+	/**
+	 * Finish the current stroke and tell the painters to merge it.
+	 */
+	void finishStroke();
+
+	/**
+	 * Finish the current erase operation. The erased strokes are compacted by 
+	 * the compaction thread, which ends the operation afterwards.
+	 */
+	void finishErasing();
+
+	/**
+	 * Main loop of the compaction thread.
+	 */
+	void compact();
+
+	/**
+	 * Compact the strokes of a finished erase operation and end the 
+	 * operation, if the compaction thread did not do so already. Has to be 
+	 * called with the document mutex held, before anything else is recorded 
+	 * in the history.
+	 */
+	void compactErased();
+
+	/**
+	 * Add the stroke points collected from pen moves to the document at once 
+	 * and send one signal for all of them.
+	 */
+	void flushStrokePoints();
+
 	pipeline::Input<Document>   _initialDocument;
 	pipeline::Input<PenMode>    _penMode;
 	pipeline::Input<OsdRequest> _osdRequest;
@@ -60,6 +151,19 @@ private:
 
 	Mode                           _mode;
 	util::point<DocumentPrecision> _previousPosition;
+	util::rect<DocumentPrecision>  _strokeArea;
+
+	// stroke points of the current batch of pen moves, and the last point that 
+	// was added to the document before them
+	std::vector<StrokePoint>       _addedPoints;
+	util::point<DocumentPrecision> _lastAdded;
+
+	// drops redundant pen samples
+	StrokePointFilter _strokePointFilter;
+
+	// the changes to undo and redo
+	History _history;
+
 	unsigned int                   _currentElement;
 
 	bool _initialDocumentChanged;
@@ -70,9 +174,35 @@ private:
 
 	signals::Slot<ChangedArea>      _documentChangedArea;
 	signals::Slot<StrokePointAdded> _strokePointAdded;
+	signals::Slot<StrokeFinished>   _strokeFinished;
 	signals::Slot<SelectionMoved>   _selectionMoved;
 	signals::Slot<ChangedArea>      _toolsChangedArea;
 	signals::Slot<LassoPointAdded>  _lassoPointAdded;
+
+	// pen events from the window thread, processed in batches by the input 
+	// thread
+	spsc_queue<PenEvent, InputQueueSize> _inputQueue;
+
+	// only used to let the input thread sleep while the queue is empty, and 
+	// the window thread while it is full
+	boost::mutex              _inputMutex;
+	boost::condition_variable _inputAvailable;
+	boost::condition_variable _inputProcessed;
+	bool                      _stopped;
+
+	boost::thread _inputThread;
+
+	// whether the last erase operation still has to be compacted, guarded by 
+	// the document mutex
+	bool _compactionPending;
+
+	// only used to let the compaction thread sleep until an erase operation 
+	// was finished
+	boost::mutex              _compactionMutex;
+	boost::condition_variable _erasingFinished;
+	bool                      _compactionRequested;
+
+	boost::thread _compactionThread;
 };
 
 #endif // YANTA_BACKEND_H__
@@ -1,12 +1,24 @@
+#include <algorithm>
+
 #include <util/Logger.h>
+#include <util/ProgramOptions.h>
 #include "Document.h"
 
 logger::LogChannel documentlog("documentlog", "[Document] ");
 
-Document::Document() {}
+util::ProgramOption optionStrokeIndexTileSize(
+	util::_long_name        = "strokeIndexTileSize",
+	util::_description_text = "The size in millimeters of the tiles by which the strokes of a page are indexed for drawing and erasing. Set to 0 to disable the index.",
+	util::_default_value    = 25);
+
+Document::Document() :
+	_tileSize(optionStrokeIndexTileSize.as<double>(), optionStrokeIndexTileSize.as<double>()),
+	_contentMargin(0) {}
 
 Document::Document(Document& other) :
-		pipeline::Data() {
+		pipeline::Data(),
+		_tileSize(optionStrokeIndexTileSize.as<double>(), optionStrokeIndexTileSize.as<double>()),
+		_contentMargin(0) {
 
 	copyFrom(other);
 }
@@ -19,6 +31,23 @@ Document::operator=(Document& other) {
 	return *this;
 }
 
+boost::shared_ptr<Document>
+Document::snapshot() {
+
+	boost::lock_guard<boost::mutex> lock(_mutex);
+
+	boost::shared_ptr<Document> snapshot(new Document(*this));
+
+	// the pages and selections of the snapshot share their content with ours, 
+	// which we copy when we change it -- the snapshot never does
+	for (unsigned int i = 0; i < snapshot->numPages(); i++)
+		snapshot->getPage(i).freeze();
+	for (unsigned int i = 0; i < snapshot->size<Selection>(); i++)
+		snapshot->get<Selection>(i).freeze();
+
+	return snapshot;
+}
+
 void
 Document::createPage(
 		const util::point<DocumentPrecision>& position,
@@ -26,7 +55,65 @@ Document::createPage(
 
 	LOG_DEBUG(documentlog) << "created a new page" << std::endl;
 
-	add<Page>(Page(this, position, size));
+	add<Page>(Page(this, numPages(), position, size));
+	get<Page>(numPages() - 1).setTileSize(_tileSize);
+
+	_pageLayout.addPage(get<Page>(numPages() - 1).getPageBoundingBox());
+	pageContentChanged(get<Page>(numPages() - 1));
+}
+
+unsigned int
+Document::getPageIndex(const util::point<DocumentPrecision>& position) const {
+
+	// quickly check if there is a page that contains the point (this should 
+	// be true in the vast majority of all cases)
+	unsigned int page;
+	if (_pageLayout.findContaining(position, page))
+		return page;
+
+	// if we haven't been successfull, let's get the closest page instead
+	return _pageLayout.findClosest(position);
+}
+
+void
+Document::getPages(const util::rect<DocumentPrecision>& area, std::vector<unsigned int>& pages) const {
+
+	_pageLayout.findIntersecting(area, _contentMargin, pages);
+
+	// the margin is a bound for all pages, keep only those that really 
+	// intersect
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < pages.size(); i++)
+		if (get<Page>(pages[i]).getBoundingBox().intersects(area))
+			pages[kept++] = pages[i];
+
+	pages.resize(kept);
+}
+
+void
+Document::pageContentChanged(const Page& page) {
+
+	const util::rect<DocumentPrecision>& content = page.getBoundingBox();
+	const util::rect<DocumentPrecision>& bounds  = page.getPageBoundingBox();
+
+	_contentMargin = std::max(_contentMargin, bounds.minX - content.minX);
+	_contentMargin = std::max(_contentMargin, bounds.minY - content.minY);
+	_contentMargin = std::max(_contentMargin, content.maxX - bounds.maxX);
+	_contentMargin = std::max(_contentMargin, content.maxY - bounds.maxY);
+}
+
+unsigned int
+Document::compactStrokes(History* history) {
+
+	unsigned int removed = 0;
+
+	for (unsigned int i = 0; i < numPages(); i++)
+		removed += get<Page>(i).compact(history, i);
+
+	if (removed > 0)
+		LOG_DEBUG(documentlog) << "removed " << removed << " stroke fragments" << std::endl;
+
+	return removed;
 }
 
 util::rect<DocumentPrecision>
@@ -53,12 +140,25 @@ Document::copyFrom(Document& other) {
 
 	// We can't just copy pages, since they have a reference to the document they 
 	// belong to. Therefore, we properly initialize our pages and copy the 
-	// relevant parts, only.
+	// relevant parts, only. The strokes and tile indices are shared with the 
+	// other pages, until one of them changes.
 	clear<Page>();
+	_pageLayout.clear();
+	_contentMargin = 0;
 
 	for (unsigned int i = 0; i < other.numPages(); i++) {
 
 		createPage(other.getPage(i).getShift(), other.getPage(i).getSize());
 		get<Page>(i) = other.getPage(i);
+		pageContentChanged(get<Page>(i));
+	}
+
+	// the same for the selections
+	clear<Selection>();
+
+	for (unsigned int i = 0; i < other.size<Selection>(); i++) {
+
+		add(Selection(_strokePoints));
+		get<Selection>(i) = other.get<Selection>(i);
 	}
 }
@@ -1,6 +1,9 @@
 #ifndef YANTA_DOCUMENT_H__
 #define YANTA_DOCUMENT_H__
 
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include <pipeline/Data.h>
 
 #include <util/tree.h>
@@ -9,6 +12,7 @@
 #include <tools/Tool.h>
 #include "DocumentElementContainer.h"
 #include "Page.h"
+#include "PageLayout.h"
 #include "Precision.h"
 #include "Selection.h"
 #include "Stroke.h"
@@ -29,6 +33,22 @@ public:
 
 	Document& operator=(Document& other);
 
+	/**
+	 * Get a copy of this document that does not change anymore, for readers 
+	 * in other threads. The copy shares the stroke points, strokes, and tile 
+	 * indices with this document, which copies them page by page when it 
+	 * changes them. Taking a snapshot costs only a few pointer copies per 
+	 * page. Changes to this document have to be made while holding 
+	 * getMutex().
+	 */
+	boost::shared_ptr<Document> snapshot();
+
+	/**
+	 * Get the mutex that serializes changes to this document and snapshots of 
+	 * it.
+	 */
+	inline boost::mutex& getMutex() { return _mutex; }
+
 	void createPage(
 			const util::point<DocumentPrecision>& position,
 			const util::point<PagePrecision>&     size);
@@ -52,6 +72,7 @@ public:
 	inline void setCurrentStrokeStyle(const Style& style) {
 
 		get<Page>(_currentPage).currentStroke().setStyle(style);
+		get<Page>(_currentPage).contentChanged();
 	}
 
 	/**
@@ -66,12 +87,21 @@ public:
 		get<Page>(_currentPage).addStrokePoint(position, pressure, timestamp);
 	}
 
+	/**
+	 * Add several stroke points to the global list and append them to the 
+	 * current stroke.
+	 */
+	inline void addStrokePoints(const std::vector<StrokePoint>& points) {
+
+		get<Page>(_currentPage).addStrokePoints(points);
+	}
+
 	/**
 	 * Finish appending the current stroke and prepare for the next stroke.
 	 */
 	inline void finishCurrentStroke() {
 
-		getPage(_currentPage).currentStroke().finish();
+		getPage(_currentPage).currentStroke().finish(_strokePoints);
 	}
 
 	/**
@@ -86,6 +116,16 @@ public:
 		return false;
 	}
 
+	/**
+	 * Get the page that received the most recent stroke.
+	 */
+	inline const Page& getCurrentPage() const { return get<Page>(_currentPage); }
+
+	/**
+	 * Get the index of the page that received the most recent stroke.
+	 */
+	inline unsigned int getCurrentPageIndex() const { return _currentPage; }
+
 	/**
 	 * Virtually erase points within the given postion and radius by splitting 
 	 * the involved strokes.
@@ -102,6 +142,23 @@ public:
 			const util::point<DocumentPrecision>& begin,
 			const util::point<DocumentPrecision>& end);
 
+	/**
+	 * Remove empty strokes and merge strokes that continue each other on all 
+	 * pages that changed since the last call. If a history is given, the 
+	 * changes are recorded in it.
+	 *
+	 * @return The number of strokes removed.
+	 */
+	unsigned int compactStrokes(History* history = 0);
+
+	/**
+	 * Get the size of the tiles (in document units) by which the strokes of 
+	 * each page are indexed. The size is fixed, such that the index does not 
+	 * have to be rebuilt when the view changes. A size of zero means that 
+	 * there is no index.
+	 */
+	inline const util::point<DocumentPrecision>& getTileSize() const { return _tileSize; }
+
 	/**
 	 * Get the list of all stroke points.
 	 */
@@ -109,45 +166,22 @@ public:
 	inline const StrokePoints& getStrokePoints() const { return _strokePoints; }
 
 	/**
-	 * Get the index of the page that is closest to the given document point.
+	 * Get the index of the page that contains the given document point, or the 
+	 * closest page if there is none.
 	 */
-	inline unsigned int getPageIndex(const util::point<DocumentPrecision>& position) {
-
-		// quickly check if there is a page that contains the point (this should 
-		// be true in the vast majority of all cases)
-		for (unsigned int i = 0; i < size<Page>(); i++)
-			if (get<Page>(i).getPageBoundingBox().contains(position))
-				return i;
-
-		// if we haven't been successfull, let's get the closest page instead
-		double minDistance = -1;
-		unsigned int closestPage = 0;
-
-		for (unsigned int i = 0; i < size<Page>(); i++) {
-
-			const util::rect<DocumentPrecision>& bb = get<Page>(i).getPageBoundingBox();
-
-			double l = bb.minX - position.x;
-			double r = position.x - bb.maxX;
-			double t = bb.minY - position.y;
-			double b = position.y - bb.maxY;
-
-			double distance = -1;
-
-			if (l > 0) distance = l;
-			if (distance < 0 || (r > 0 && r < distance)) distance = r;
-			if (distance < 0 || (t > 0 && t < distance)) distance = t;
-			if (distance < 0 || (b > 0 && b < distance)) distance = b;
+	unsigned int getPageIndex(const util::point<DocumentPrecision>& position) const;
 
-			if (minDistance < 0 || distance < minDistance) {
-
-				minDistance = distance;
-				closestPage = i;
-			}
-		}
+	/**
+	 * Get the indices of the pages whose content intersects the given area, 
+	 * in increasing order.
+	 */
+	void getPages(const util::rect<DocumentPrecision>& area, std::vector<unsigned int>& pages) const;
 
-		return closestPage;
-	}
+	/**
+	 * Inform the document that the content of the given page changed. Called 
+	 * by the pages themselves.
+	 */
+	void pageContentChanged(const Page& page);
 
 	/**
 	 * Get a page of the document.
@@ -182,6 +216,18 @@ private:
 
 	// the number of the current page
 	unsigned int _currentPage;
+
+	// the size of the tiles of the pages' tile indices
+	util::point<DocumentPrecision> _tileSize;
+
+	// the bounding boxes of the pages, to find pages by position
+	PageLayout _pageLayout;
+
+	// an upper bound on how far the content of any page reaches beyond its 
+	// page bounding box
+	DocumentPrecision _contentMargin;
+
+	boost::mutex _mutex;
 };
 
 #endif // YANTA_DOCUMENT_H__
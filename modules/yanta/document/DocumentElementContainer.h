@@ -1,6 +1,9 @@
 #ifndef YANTA_DOCUMENT_ELEMENT_CONTAINER_H__
 #define YANTA_DOCUMENT_ELEMENT_CONTAINER_H__
 
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
 #include <util/multi_container.hpp>
 
 #include "DocumentElement.h"
@@ -8,9 +11,73 @@
 /**
  * A document element holding an arbitrary number of different, compile-time 
  * fixed document element types. The types are passed as a typelist.
+ *
+ * The elements are copy-on-write: copies of a container share its elements, 
+ * until one of them asks for non-const access. A frozen container never makes 
+ * its own copy of the elements, use it for read-only copies, whose visitors 
+ * need non-const access.
  */
 template <typename Types>
-class DocumentElementContainer : public DocumentElement, public multi_container<Types> {};
+class DocumentElementContainer : public DocumentElement {
 
-#endif // YANTA_DOCUMENT_ELEMENT_CONTAINER_H__
+public:
+
+	DocumentElementContainer() :
+		_elements(boost::make_shared<multi_container<Types> >()),
+		_frozen(false) {}
+
+	DocumentElementContainer(const DocumentElementContainer<Types>& other) :
+		DocumentElement(other),
+		_elements(other._elements),
+		_frozen(false) {}
+
+	DocumentElementContainer<Types>& operator=(const DocumentElementContainer<Types>& other) {
+
+		DocumentElement::operator=(other);
+		_elements = other._elements;
+
+		return *this;
+	}
+
+	/**
+	 * Promise that the elements of this container will not be changed anymore. 
+	 * Non-const accesses will not copy shared elements from now on.
+	 */
+	void freeze() { _frozen = true; }
+
+	/**
+	 * Check whether this container was frozen.
+	 */
+	bool frozen() const { return _frozen; }
 
+	template <typename X> std::vector<X>& get() { detach(); return _elements->template get<X>(); }
+	template <typename X> const std::vector<X>& get() const { return _elements->template get<X>(); }
+	template <typename X> X& get(unsigned int i) { detach(); return _elements->template get<X>(i); }
+	template <typename X> const X& get(unsigned int i) const { return _elements->template get<X>(i); }
+	template <typename X> unsigned int size() const { return _elements->template size<X>(); }
+	unsigned int size() const { return _elements->size(); }
+	template <typename X> void add(const X& x) { detach(); _elements->add(x); }
+	template <typename X> void clear() { detach(); _elements->template clear<X>(); }
+	template <typename F> void for_each(F& f) { detach(); _elements->for_each(f); }
+	template <typename F> void for_each(const F& f) { detach(); _elements->for_each(f); }
+
+protected:
+
+	/**
+	 * Get our own copy of the elements, if they are shared with another 
+	 * container.
+	 */
+	void detach() {
+
+		if (!_frozen && !_elements.unique())
+			_elements = boost::make_shared<multi_container<Types> >(*_elements);
+	}
+
+private:
+
+	boost::shared_ptr<multi_container<Types> > _elements;
+
+	bool _frozen;
+};
+
+#endif // YANTA_DOCUMENT_ELEMENT_CONTAINER_H__
@@ -2,6 +2,7 @@
 #define YANTA_DOCUMENT_SIGNALS_H__
 
 #include <Signals.h>
+#include "Style.h"
 
 /**
  * Signal to indicate that the document changed incrementally.
@@ -17,15 +18,51 @@ public:
 };
 
 /**
- * Signal to send when just a stroke point was added to the current stroke.
+ * Signal to send when just a stroke point was added to the current stroke. 
+ * Describes the current stroke, such that receivers on other threads don't 
+ * have to look it up in the document.
  */
 class StrokePointAdded : public ContentAdded {
 
 public:
 
-	StrokePointAdded() : ContentAdded() {}
+	StrokePointAdded() :
+		ContentAdded(),
+		begin(0), end(0), shift(0, 0) {}
 
-	StrokePointAdded(const util::rect<DocumentPrecision>& area_) :
+	StrokePointAdded(
+			const util::rect<DocumentPrecision>& area_,
+			unsigned long begin_,
+			unsigned long end_,
+			const Style& style_,
+			const util::point<DocumentPrecision>& shift_) :
+		ContentAdded(area_),
+		begin(begin_),
+		end(end_),
+		style(style_),
+		shift(shift_) {}
+
+	// the stroke points of the current stroke
+	unsigned long begin;
+	unsigned long end;
+
+	Style style;
+
+	// the shift of the page the stroke is on
+	util::point<DocumentPrecision> shift;
+};
+
+/**
+ * Signal to send when the current stroke was finished. The area covers the 
+ * whole stroke.
+ */
+class StrokeFinished : public ContentAdded {
+
+public:
+
+	StrokeFinished() : ContentAdded() {}
+
+	StrokeFinished(const util::rect<DocumentPrecision>& area_) :
 		ContentAdded(area_) {}
 };
 
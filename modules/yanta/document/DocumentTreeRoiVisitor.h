@@ -1,7 +1,11 @@
 #ifndef YANTA_DOCUMENT_TREE_ROI_VISITOR_H__
 #define YANTA_DOCUMENT_TREE_ROI_VISITOR_H__
 
+#include <algorithm>
+#include <vector>
+
 #include "DocumentTreeTransformationVisitor.h"
+#include "Document.h"
 #include "DocumentElement.h"
 #include "DocumentElementContainer.h"
 
@@ -56,6 +60,62 @@ public:
 		}
 	}
 
+	/**
+	 * Traverse method for pages. Scans the array of stroke bounding boxes of 
+	 * the page for strokes that intersect the roi, instead of testing each 
+	 * stroke.
+	 */
+	template <typename VisitorType>
+	void traverse(Page& page, VisitorType& visitor) {
+
+		if (_roi.isZero()) {
+
+			Traverser<VisitorType> traverser(visitor);
+			page.for_each(traverser);
+
+			return;
+		}
+
+		util::rect<DocumentPrecision> roi = getRoi();
+
+		// strokes are accessed by their index, since visitors can add strokes 
+		// to the page (the erasor does so when it splits strokes)
+		unsigned int numStrokes = page.numStrokes();
+
+		for (unsigned int i = 0; i < numStrokes; i++)
+			if (page.getStrokeBoundingBoxes()[i].intersects(roi))
+				page.getStroke(i).accept(visitor);
+	}
+
+	/**
+	 * Traverse method for the document. Asks the document for the pages that 
+	 * intersect the roi, instead of testing each of them.
+	 */
+	template <typename VisitorType>
+	void traverse(Document& document, VisitorType& visitor) {
+
+		if (_roi.isZero()) {
+
+			Traverser<VisitorType> traverser(visitor);
+			document.for_each(traverser);
+
+		} else {
+
+			util::rect<DocumentPrecision> roi = getRoi();
+
+			std::vector<unsigned int> pages;
+			document.getPages(roi, pages);
+
+			LOG_ALL(documenttreeroivisitorlog) << pages.size() << " of " << document.numPages() << " pages intersect roi " << roi << std::endl;
+
+			for (unsigned int i = 0; i < pages.size(); i++)
+				document.getPage(pages[i]).accept(visitor);
+
+			RoiTraverser<VisitorType> traverser(visitor, roi);
+			std::for_each(document.get<Selection>().begin(), document.get<Selection>().end(), traverser);
+		}
+	}
+
 	// fallback implementation
 	using DocumentTreeVisitor::traverse;
 
@@ -0,0 +1,202 @@
+#include <algorithm>
+
+#include <util/Logger.h>
+#include "Document.h"
+#include "History.h"
+
+logger::LogChannel historylog("historylog", "[History] ");
+
+History::History(unsigned long maxMemory) :
+	_open(false),
+	_numChanges(0),
+	_maxChanges(std::max(1UL, maxMemory/(unsigned long)sizeof(Change))) {}
+
+void
+History::strokeAdded(unsigned int page, unsigned int index, const Stroke& stroke) {
+
+	Change change;
+	change.type  = Change::Added;
+	change.page  = page;
+	change.index = index;
+	change.after = stroke;
+
+	record(change);
+}
+
+void
+History::strokeChanged(unsigned int page, unsigned int index, const Stroke& before, const Stroke& after) {
+
+	Change change;
+	change.type   = Change::Changed;
+	change.page   = page;
+	change.index  = index;
+	change.before = before;
+	change.after  = after;
+
+	record(change);
+}
+
+void
+History::strokeRemoved(unsigned int page, unsigned int index, const Stroke& stroke) {
+
+	Change change;
+	change.type   = Change::Removed;
+	change.page   = page;
+	change.index  = index;
+	change.before = stroke;
+
+	record(change);
+}
+
+void
+History::end() {
+
+	if (_open)
+		LOG_ALL(historylog) << "recorded operation with " << _undo.back().size() << " changes" << std::endl;
+
+	_open = false;
+}
+
+void
+History::clear() {
+
+	LOG_DEBUG(historylog) << "forgetting all operations" << std::endl;
+
+	_undo.clear();
+	_redo.clear();
+	_open       = false;
+	_numChanges = 0;
+}
+
+util::rect<DocumentPrecision>
+History::undo(Document& document) {
+
+	util::rect<DocumentPrecision> area(0, 0, 0, 0);
+
+	end();
+
+	if (_undo.empty())
+		return area;
+
+	_redo.push_back(operation_type());
+	_redo.back().swap(_undo.back());
+	_undo.pop_back();
+
+	const operation_type& operation = _redo.back();
+
+	LOG_DEBUG(historylog) << "undoing " << operation.size() << " changes" << std::endl;
+
+	for (operation_type::const_reverse_iterator i = operation.rbegin(); i != operation.rend(); i++)
+		apply(*i, true, document, area);
+
+	return area;
+}
+
+util::rect<DocumentPrecision>
+History::redo(Document& document) {
+
+	util::rect<DocumentPrecision> area(0, 0, 0, 0);
+
+	end();
+
+	if (_redo.empty())
+		return area;
+
+	_undo.push_back(operation_type());
+	_undo.back().swap(_redo.back());
+	_redo.pop_back();
+
+	const operation_type& operation = _undo.back();
+
+	LOG_DEBUG(historylog) << "redoing " << operation.size() << " changes" << std::endl;
+
+	for (operation_type::const_iterator i = operation.begin(); i != operation.end(); i++)
+		apply(*i, false, document, area);
+
+	return area;
+}
+
+void
+History::record(const Change& change) {
+
+	if (!_open) {
+
+		// a new operation makes the undone ones obsolete
+		for (unsigned int i = 0; i < _redo.size(); i++)
+			_numChanges -= _redo[i].size();
+		_redo.clear();
+
+		_undo.push_back(operation_type());
+		_open = true;
+	}
+
+	_undo.back().push_back(change);
+	_numChanges++;
+
+	limitMemory();
+}
+
+void
+History::apply(const Change& change, bool revert, Document& document, util::rect<DocumentPrecision>& area) {
+
+	Page& page = document.getPage(change.page);
+
+	switch (change.type) {
+
+		case Change::Added:
+
+			if (revert)
+				page.removeStroke(change.index);
+			else
+				page.insertStroke(change.index, change.after);
+
+			fitArea(page, change.after, area);
+			break;
+
+		case Change::Changed:
+
+			page.replaceStroke(change.index, revert ? change.before : change.after);
+
+			fitArea(page, change.before, area);
+			fitArea(page, change.after, area);
+			break;
+
+		case Change::Removed:
+
+			if (revert)
+				page.insertStroke(change.index, change.before);
+			else
+				page.removeStroke(change.index);
+
+			fitArea(page, change.before, area);
+			break;
+	}
+}
+
+void
+History::fitArea(const Page& page, const Stroke& stroke, util::rect<DocumentPrecision>& area) {
+
+	if (stroke.size() == 0)
+		return;
+
+	util::rect<DocumentPrecision> strokeArea = stroke.getBoundingBox();
+	strokeArea += page.getShift();
+
+	if (area.isZero())
+		area = strokeArea;
+	else
+		area.fit(strokeArea);
+}
+
+void
+History::limitMemory() {
+
+	// never forget the operation that is being recorded
+	while (_numChanges > _maxChanges && _undo.size() > 1) {
+
+		LOG_DEBUG(historylog) << "forgetting operation with " << _undo.front().size() << " changes" << std::endl;
+
+		_numChanges -= _undo.front().size();
+		_undo.pop_front();
+	}
+}
@@ -0,0 +1,141 @@
+#ifndef YANTA_HISTORY_H__
+#define YANTA_HISTORY_H__
+
+#include <deque>
+#include <vector>
+
+#include <util/rect.hpp>
+
+#include "Precision.h"
+#include "Stroke.h"
+
+// forward declarations
+class Document;
+class Page;
+
+/**
+ * Undo and redo of the changes to the strokes of a document. A change stores 
+ * the affected stroke before and after the change. Strokes only refer to the 
+ * stroke points of the document, which are never removed. Therefore, undoing 
+ * or redoing a change does not have to touch the stroke points.
+ *
+ * Changes are grouped into operations, which are undone and redone as a 
+ * whole. An operation starts with the first change recorded after end().
+ */
+class History {
+
+public:
+
+	/**
+	 * Create a new history.
+	 *
+	 * @param maxMemory
+	 *             The maximal number of bytes to spend on recorded changes. The 
+	 *             oldest operations are forgotten if this is exceeded.
+	 */
+	History(unsigned long maxMemory);
+
+	/**
+	 * A stroke was added at the given index of a page.
+	 */
+	void strokeAdded(unsigned int page, unsigned int index, const Stroke& stroke);
+
+	/**
+	 * The stroke at the given index of a page was changed.
+	 */
+	void strokeChanged(unsigned int page, unsigned int index, const Stroke& before, const Stroke& after);
+
+	/**
+	 * The stroke at the given index of a page was removed.
+	 */
+	void strokeRemoved(unsigned int page, unsigned int index, const Stroke& stroke);
+
+	/**
+	 * Finish the current operation.
+	 */
+	void end();
+
+	/**
+	 * Forget all operations, e.g., when the document was replaced and the 
+	 * recorded pages and strokes don't exist anymore.
+	 */
+	void clear();
+
+	/**
+	 * Check whether there is an operation to undo.
+	 */
+	bool canUndo() const { return !_undo.empty(); }
+
+	/**
+	 * Check whether there is an operation to redo.
+	 */
+	bool canRedo() const { return !_redo.empty(); }
+
+	/**
+	 * Revert the most recent operation. The current operation is finished 
+	 * first.
+	 *
+	 * @return The area of the document that changed.
+	 */
+	util::rect<DocumentPrecision> undo(Document& document);
+
+	/**
+	 * Repeat the most recently undone operation.
+	 *
+	 * @return The area of the document that changed.
+	 */
+	util::rect<DocumentPrecision> redo(Document& document);
+
+private:
+
+	struct Change {
+
+		enum Type {
+
+			Added,
+			Changed,
+			Removed
+		};
+
+		Type         type;
+		unsigned int page;
+		unsigned int index;
+		Stroke       before;
+		Stroke       after;
+	};
+
+	typedef std::vector<Change> operation_type;
+
+	/**
+	 * Add a change to the current operation, start one if needed.
+	 */
+	void record(const Change& change);
+
+	/**
+	 * Apply a change to a document, or revert it. Extends area by the affected 
+	 * parts of the document.
+	 */
+	void apply(const Change& change, bool revert, Document& document, util::rect<DocumentPrecision>& area);
+
+	void fitArea(const Page& page, const Stroke& stroke, util::rect<DocumentPrecision>& area);
+
+	/**
+	 * Forget the oldest operations until we are within the memory limit.
+	 */
+	void limitMemory();
+
+	// the operations to undo, the most recent one last
+	std::deque<operation_type> _undo;
+
+	// the operations to redo, the next one last
+	std::vector<operation_type> _redo;
+
+	// whether the last operation in _undo is still being recorded
+	bool _open;
+
+	unsigned long _numChanges;
+	unsigned long _maxChanges;
+};
+
+#endif // YANTA_HISTORY_H__
+
@@ -1,4 +1,9 @@
+#include <algorithm>
+
+#include <boost/atomic.hpp>
+
 #include "Document.h"
+#include "History.h"
 #include "Page.h"
 #include <util/Logger.h>
 
@@ -6,12 +11,19 @@ logger::LogChannel pagelog("pagelog", "[Page] ");
 
 Page::Page(
 		Document* document,
+		unsigned int index,
 		const util::point<DocumentPrecision>& position,
 		const util::point<PagePrecision>&     size) :
 	_size(size),
 	_borderSize(15),
 	_pageBoundingBox(position.x, position.y, position.x + size.x, position.y + size.y),
-	_strokePoints(document->getStrokePoints()) {
+	_document(document),
+	_index(index),
+	_strokePoints(document->getStrokePoints()),
+	_tileIndex(boost::make_shared<TileIndex>()),
+	_strokeBoundingBoxes(boost::make_shared<bounding_boxes_type>()),
+	_contentVersion(nextContentVersion()),
+	_compactedVersion(0) {
 
 	fitBoundingBox(util::rect<PagePrecision>(-getBorderSize(), -getBorderSize(), size.x + getBorderSize(), size.y + getBorderSize()));
 	shift(position);
@@ -20,11 +32,16 @@ Page::Page(
 Page&
 Page::operator=(const Page& other) {
 
-	// copy the elements of the container
+	// share the elements of the container and the tile index, until one of 
+	// the pages changes
 	DocumentElementContainer<PageElementTypes>::operator=(other);
 
-	_size            = other._size;
-	_pageBoundingBox = other._pageBoundingBox;
+	_size             = other._size;
+	_pageBoundingBox  = other._pageBoundingBox;
+	_tileIndex           = other._tileIndex;
+	_strokeBoundingBoxes = other._strokeBoundingBoxes;
+	_contentVersion      = other._contentVersion;
+	_compactedVersion    = other._compactedVersion;
 
 	// we don't copy the stroke points, since they might belong to another 
 	// document
@@ -48,9 +65,38 @@ Page::createNewStroke(unsigned long begin) {
 
 	// if this happens in the middle of a draw, finish the unfinished
 	if (numStrokes() > 0 && !currentStroke().finished())
-		currentStroke().finish();
+		currentStroke().finish(_strokePoints);
 
 	add(Stroke(begin));
+	updateStrokeBoundingBox(numStrokes() - 1);
+	contentChanged();
+}
+
+void
+Page::addStrokePoints(const std::vector<StrokePoint>& points) {
+
+	if (points.empty())
+		return;
+
+	// transform the points into page units
+	std::vector<StrokePoint> pagePoints(points);
+	for (unsigned int i = 0; i < pagePoints.size(); i++) {
+
+		pagePoints[i].position -= getShift();
+		fitBoundingBox(points[i].position);
+	}
+
+	unsigned long first = _strokePoints.size();
+
+	_strokePoints.add(pagePoints);
+	currentStroke().setEnd(_strokePoints.size(), _strokePoints);
+	updateStrokeBoundingBox(numStrokes() - 1);
+
+	// add the new lines to the tile index
+	for (unsigned long j = std::max(first, currentStroke().begin() + 1); j < _strokePoints.size(); j++)
+		indexSegment(numStrokes() - 1, j - 1);
+
+	contentChanged();
 }
 
 void
@@ -59,6 +105,346 @@ Page::recomputeBoundingBox() {
 	resetBoundingBox();
 	fitBoundingBox(util::rect<PagePrecision>(-getBorderSize(), -getBorderSize(), _size.x + getBorderSize(), _size.y + getBorderSize()));
 	for_each(UpdateBoundingBox(*this));
+
+	updateStrokeBoundingBoxes();
+}
+
+void
+Page::strokeChanged(unsigned int i, const util::rect<PagePrecision>& previousBoundingBox) {
+
+	changeTileIndex().removeStroke(i, toDocumentCoordinates(previousBoundingBox));
+	indexStroke(i);
+	contentChanged();
+}
+
+void
+Page::insertStroke(unsigned int i, const Stroke& stroke) {
+
+	if (i == numStrokes()) {
+
+		addStroke(stroke);
+
+	} else {
+
+		get<Stroke>().insert(get<Stroke>().begin() + i, stroke);
+
+		// the strokes behind the new one changed their indices
+		reindex();
+	}
+
+	fitBoundingBox(stroke.getBoundingBox());
+	contentChanged();
+}
+
+void
+Page::removeStroke(unsigned int i) {
+
+	if (i + 1 == numStrokes()) {
+
+		changeTileIndex().removeStroke(i, toDocumentCoordinates(getStroke(i).getBoundingBox()));
+		changeStrokeBoundingBoxes().pop_back();
+		get<Stroke>().pop_back();
+
+	} else {
+
+		get<Stroke>().erase(get<Stroke>().begin() + i);
+
+		// the strokes behind the removed one changed their indices
+		reindex();
+	}
+
+	contentChanged();
+}
+
+void
+Page::replaceStroke(unsigned int i, const Stroke& stroke) {
+
+	util::rect<PagePrecision> previousBoundingBox = getStroke(i).getBoundingBox();
+
+	getStroke(i) = stroke;
+	fitBoundingBox(stroke.getBoundingBox());
+
+	strokeChanged(i, previousBoundingBox);
+}
+
+unsigned int
+Page::compact(History* history, unsigned int pageIndex) {
+
+	if (_compactedVersion == _contentVersion)
+		return 0;
+
+	std::vector<Stroke>& strokes = get<Stroke>();
+	unsigned int         n       = strokes.size();
+
+	// strokes to remove, and the stroke each of them was merged into (the 
+	// stroke itself, if it was empty)
+	std::vector<bool>         removed(n, false);
+	std::vector<unsigned int> mergedInto(n);
+
+	// finished, non-empty strokes by their first point
+	std::multimap<unsigned long, unsigned int> starts;
+
+	for (unsigned int i = 0; i < n; i++) {
+
+		mergedInto[i] = i;
+
+		if (!strokes[i].finished())
+			continue;
+
+		if (strokes[i].size() == 0)
+			removed[i] = true;
+		else
+			starts.insert(std::make_pair(strokes[i].begin(), i));
+	}
+
+	// the strokes that got others appended, and how they were before
+	std::vector<unsigned int> merged;
+	std::vector<Stroke>       previous;
+
+	for (unsigned int i = 0; i < n; i++) {
+
+		if (removed[i] || !strokes[i].finished() || strokes[i].size() == 0)
+			continue;
+
+		unsigned long end = strokes[i].end();
+
+		unsigned int j;
+		while ((j = findContinuation(i, end, starts, removed)) < n) {
+
+			LOG_ALL(pagelog) << "appending stroke " << j << " to stroke " << i << std::endl;
+
+			if (merged.empty() || merged.back() != i) {
+
+				merged.push_back(i);
+				previous.push_back(strokes[i]);
+			}
+
+			end           = strokes[j].end();
+			removed[j]    = true;
+			mergedInto[j] = i;
+		}
+
+		if (end != strokes[i].end()) {
+
+			strokes[i].setEnd(end, _strokePoints);
+			strokes[i].finish(_strokePoints);
+			strokes[i].updateBoundingBox(_strokePoints);
+		}
+	}
+
+	_compactedVersion = _contentVersion;
+
+	if (std::find(removed.begin(), removed.end(), true) == removed.end())
+		return 0;
+
+	// as if the strokes were changed first, and then removed one by one, 
+	// starting with the last
+	if (history) {
+
+		for (unsigned int k = 0; k < merged.size(); k++)
+			history->strokeChanged(pageIndex, merged[k], previous[k], strokes[merged[k]]);
+
+		for (int i = n - 1; i >= 0; i--)
+			if (removed[i])
+				history->strokeRemoved(pageIndex, i, strokes[i]);
+	}
+
+	// the new indices of the strokes, -1 for empty strokes
+	std::vector<int> indices(n, -1);
+	unsigned int     kept = 0;
+
+	for (unsigned int i = 0; i < n; i++) {
+
+		if (removed[i])
+			continue;
+
+		indices[i] = kept;
+		if (kept != i)
+			strokes[kept] = strokes[i];
+		kept++;
+	}
+
+	for (unsigned int i = 0; i < n; i++) {
+
+		if (!removed[i])
+			continue;
+
+		// strokes can be appended to strokes that were appended themselves
+		unsigned int target = mergedInto[i];
+		while (removed[target] && mergedInto[target] != target)
+			target = mergedInto[target];
+
+		if (target != i)
+			indices[i] = indices[target];
+	}
+
+	strokes.resize(kept);
+
+	LOG_DEBUG(pagelog) << "compacted " << n << " strokes to " << kept << std::endl;
+
+	// the lines of appended strokes stay where they are, only the indices 
+	// change
+	changeTileIndex().renumberStrokes(indices);
+	updateStrokeBoundingBoxes();
+
+	// the strokes got new indices, anything that refers to them by index has 
+	// to be updated
+	contentChanged();
+	_compactedVersion = _contentVersion;
+
+	return n - kept;
+}
+
+unsigned int
+Page::findContinuation(
+		unsigned int                                      i,
+		unsigned long                                     end,
+		const std::multimap<unsigned long, unsigned int>& starts,
+		const std::vector<bool>&                          removed) {
+
+	const Stroke& stroke = getStroke(i);
+
+	typedef std::multimap<unsigned long, unsigned int>::const_iterator iterator;
+	std::pair<iterator, iterator> candidates = starts.equal_range(end - 1);
+
+	for (iterator c = candidates.first; c != candidates.second; c++) {
+
+		unsigned int j = c->second;
+
+		if (j == i || removed[j])
+			continue;
+
+		const Stroke& other = getStroke(j);
+
+		if (
+				other.getStyle() == stroke.getStyle() &&
+				other.getShift() == stroke.getShift() &&
+				other.getScale() == stroke.getScale())
+			return j;
+	}
+
+	return numStrokes();
+}
+
+void
+Page::contentChanged() {
+
+	_contentVersion = nextContentVersion();
+
+	// the content might reach further beyond the page now
+	_document->pageContentChanged(*this);
+}
+
+TileIndex&
+Page::changeTileIndex() {
+
+	if (!frozen() && !_tileIndex.unique())
+		_tileIndex = boost::make_shared<TileIndex>(*_tileIndex);
+
+	return *_tileIndex;
+}
+
+Page::bounding_boxes_type&
+Page::changeStrokeBoundingBoxes() {
+
+	if (!frozen() && !_strokeBoundingBoxes.unique())
+		_strokeBoundingBoxes = boost::make_shared<bounding_boxes_type>(*_strokeBoundingBoxes);
+
+	return *_strokeBoundingBoxes;
+}
+
+void
+Page::updateStrokeBoundingBox(unsigned int i) {
+
+	bounding_boxes_type& boundingBoxes = changeStrokeBoundingBoxes();
+
+	if (boundingBoxes.size() != numStrokes())
+		boundingBoxes.resize(numStrokes());
+
+	boundingBoxes[i] = getStroke(i).getBoundingBox();
+}
+
+void
+Page::updateStrokeBoundingBoxes() {
+
+	bounding_boxes_type& boundingBoxes = changeStrokeBoundingBoxes();
+
+	boundingBoxes.resize(numStrokes());
+
+	for (unsigned int i = 0; i < numStrokes(); i++)
+		boundingBoxes[i] = getStroke(i).getBoundingBox();
+}
+
+unsigned long
+Page::nextContentVersion() {
+
+	// pages of different documents change in different threads
+	static boost::atomic<unsigned long> version(0);
+
+	return ++version;
+}
+
+void
+Page::setTileSize(const util::point<DocumentPrecision>& tileSize) {
+
+	if (_tileIndex->getTileSize() == tileSize)
+		return;
+
+	changeTileIndex().setTileSize(tileSize);
+	reindex();
+}
+
+void
+Page::indexSegment(unsigned int i, unsigned long j) {
+
+	if (!_tileIndex->enabled())
+		return;
+
+	const Stroke& stroke = getStroke(i);
+
+	// the line in page coordinates
+	util::point<PagePrecision> begin = _strokePoints[j].position*stroke.getScale() + stroke.getShift();
+	util::point<PagePrecision> end   = _strokePoints[j+1].position*stroke.getScale() + stroke.getShift();
+
+	util::rect<PagePrecision> area(begin.x, begin.y, begin.x, begin.y);
+	area.fit(end);
+
+	PagePrecision width = stroke.getStyle().width()*std::max(stroke.getScale().x, stroke.getScale().y);
+	area.minX -= width;
+	area.minY -= width;
+	area.maxX += width;
+	area.maxY += width;
+
+	changeTileIndex().addSegment(i, j, toDocumentCoordinates(area));
+}
+
+void
+Page::indexStroke(unsigned int i) {
+
+	// the bounding boxes are kept up-to-date with or without tile index
+	updateStrokeBoundingBox(i);
+
+	if (!_tileIndex->enabled())
+		return;
+
+	const Stroke& stroke = getStroke(i);
+
+	for (unsigned long j = stroke.begin(); j + 1 < stroke.end(); j++)
+		indexSegment(i, j);
+}
+
+void
+Page::reindex() {
+
+	updateStrokeBoundingBoxes();
+
+	if (!_tileIndex->enabled())
+		return;
+
+	changeTileIndex().clear();
+
+	for (unsigned int i = 0; i < numStrokes(); i++)
+		indexStroke(i);
 }
 
 util::rect<DocumentPrecision>
@@ -82,12 +468,17 @@ Page::erase(const util::point<DocumentPrecision>& begin, const util::point<Docum
 	unsigned int n = numStrokes();
 
 	for (unsigned int i = 0; i < n; i++)
-		if (getStroke(i).getBoundingBox().intersects(eraseBoundingBox)) {
+		if (getStrokeBoundingBoxes()[i].intersects(eraseBoundingBox)) {
 
 			//LOG_ALL(pagelog) << "stroke " << i << " is close to the erase position" << std::endl;
 
+			util::rect<PagePrecision> previousBoundingBox = getStroke(i).getBoundingBox();
+
 			util::rect<PagePrecision> changedStrokeArea = erase(getStroke(i), pageBegin, pageEnd);
 
+			if (!changedStrokeArea.isZero())
+				strokeChanged(i, previousBoundingBox);
+
 			if (changedArea.isZero()) {
 
 				changedArea = changedStrokeArea;
@@ -129,12 +520,23 @@ Page::erase(const util::point<PagePrecision>& position, PagePrecision radius) {
 	unsigned int n = numStrokes();
 
 	for (unsigned int i = 0; i < n; i++)
-		if (getStroke(i).getBoundingBox().intersects(eraseBoundingBox)) {
+		if (getStrokeBoundingBoxes()[i].intersects(eraseBoundingBox)) {
 
 			//LOG_ALL(pagelog) << "stroke " << i << " is close to the erase pagePosition" << std::endl;
 
+			util::rect<PagePrecision> previousBoundingBox = getStroke(i).getBoundingBox();
+			unsigned int previousNumStrokes = numStrokes();
+
 			util::rect<PagePrecision> changedStrokeArea = erase(&getStroke(i), pagePosition, radius*radius);
 
+			// update the tile index for the split stroke and its new parts
+			if (!changedStrokeArea.isZero()) {
+
+				strokeChanged(i, previousBoundingBox);
+				for (unsigned int j = previousNumStrokes; j < numStrokes(); j++)
+					indexStroke(j);
+			}
+
 			if (changedArea.isZero()) {
 
 				changedArea = changedStrokeArea;
@@ -202,7 +604,7 @@ Page::erase(Stroke* stroke, const util::point<PagePrecision>& center, PagePrecis
 				LOG_ALL(pagelog) << "this is the first line to erase on this stroke" << std::endl;
 
 				stroke->setEnd(i+1, _strokePoints);
-				stroke->finish();
+				stroke->finish(_strokePoints);
 				wasErasing = true;
 			}
 
@@ -211,9 +613,12 @@ Page::erase(Stroke* stroke, const util::point<PagePrecision>& center, PagePrecis
 
 			LOG_ALL(pagelog) << "line " << i << " is the next line not to erase on this stroke" << std::endl;
 
+			boost::shared_ptr<const StrokeCurve> curve = stroke->shareCurve();
+
 			createNewStroke(i);
 			stroke = &(currentStroke());
 			stroke->setStyle(style);
+			stroke->setCurve(curve);
 			wasErasing = false;
 		}
 	}
@@ -223,7 +628,7 @@ Page::erase(Stroke* stroke, const util::point<PagePrecision>& center, PagePrecis
 	if (!wasErasing) {
 
 		stroke->setEnd(end+1, _strokePoints);
-		stroke->finish();
+		stroke->finish(_strokePoints);
 	}
 
 	// increase the size of the changedArea (if there is one) by the style width
@@ -273,7 +678,7 @@ Page::erase(Stroke& stroke, const util::point<PagePrecision>& lineBegin, const u
 
 			// make this an empty stroke
 			stroke.setEnd(begin, _strokePoints);
-			stroke.finish();
+			stroke.finish(_strokePoints);
 
 			break;
 		}
@@ -1,8 +1,12 @@
 #ifndef YANTA_PAGE_H__
 #define YANTA_PAGE_H__
 
+#include <map>
+#include <vector>
+
 #include <boost/bind.hpp>
-#include <boost/lambda/lambda.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 
 #include <util/tree.h>
 #include <util/typelist.h>
@@ -11,9 +15,11 @@
 #include "Precision.h"
 #include "Stroke.h"
 #include "StrokePoints.h"
+#include "TileIndex.h"
 
-// forward declaration
+// forward declarations
 class Document;
+class History;
 
 typedef TYPELIST_1(Stroke) PageElementTypes;
 
@@ -21,15 +27,23 @@ class Page : public DocumentElementContainer<PageElementTypes> {
 
 public:
 
+	typedef std::vector<util::rect<PagePrecision> > bounding_boxes_type;
+
 	YANTA_TREE_VISITABLE();
 
 	Page(
 			Document* document,
+			unsigned int index,
 			const util::point<DocumentPrecision>& position,
 			const util::point<PagePrecision>&   size);
 
 	Page& operator=(const Page& other);
 
+	/**
+	 * Get the number of this page in its document.
+	 */
+	inline unsigned int getIndex() const { return _index; }
+
 	/**
 	 * Get the bounding box of the page, irrespective of its content.
 	 */
@@ -62,7 +76,12 @@ public:
 	/**
 	 * Add a complete stroke to this page.
 	 */
-	void addStroke(const Stroke& stroke) { add(stroke); }
+	void addStroke(const Stroke& stroke) {
+
+		add(stroke);
+		indexStroke(numStrokes() - 1);
+		contentChanged();
+	}
 
 	/**
 	 * Add a stroke point to the current stroke. This appends the stroke point 
@@ -81,8 +100,21 @@ public:
 		currentStroke().setEnd(_strokePoints.size(), _strokePoints);
 
 		fitBoundingBox(position);
+		updateStrokeBoundingBox(numStrokes() - 1);
+
+		// add the new line to the tile index
+		if (currentStroke().size() > 1)
+			indexSegment(numStrokes() - 1, _strokePoints.size() - 2);
+
+		contentChanged();
 	}
 
+	/**
+	 * Add several stroke points (in document units) to the current stroke at 
+	 * once.
+	 */
+	void addStrokePoints(const std::vector<StrokePoint>& points);
+
 	/**
 	 * Get a stroke by its index.
 	 */
@@ -121,28 +153,129 @@ public:
 
 	/**
 	 * Remove all the strokes from this page for which the given unary predicate 
-	 * evaluates to true.
+	 * evaluates to true. The remaining strokes keep their order.
+	 *
+	 * @param indices
+	 *             If given, the former indices of the removed strokes are 
+	 *             stored here.
 	 *
 	 * @return The removed strokes.
 	 */
 	template <typename Predicate>
-	std::vector<Stroke> removeStrokes(Predicate pred) {
+	std::vector<Stroke> removeStrokes(Predicate pred, std::vector<unsigned int>* indices = 0) {
+
+		std::vector<Stroke>& strokes = get<Stroke>();
+
+		std::vector<Stroke> removed;
+		unsigned int        kept = 0;
+
+		for (unsigned int i = 0; i < strokes.size(); i++) {
+
+			if (pred(strokes[i])) {
 
-		std::vector<Stroke>::iterator newEnd = std::partition(get<Stroke>().begin(), get<Stroke>().end(), !boost::bind(pred, boost::lambda::_1));
+				removed.push_back(strokes[i]);
+				if (indices)
+					indices->push_back(i);
 
-		std::vector<Stroke> removed(newEnd, get<Stroke>().end());
-		get<Stroke>().resize(newEnd - get<Stroke>().begin());
+			} else {
+
+				if (kept != i)
+					strokes[kept] = strokes[i];
+				kept++;
+			}
+		}
+
+		strokes.resize(kept);
 
 		recomputeBoundingBox();
 
+		// the strokes changed their indices
+		reindex();
+		contentChanged();
+
 		return removed;
 	}
 
 	/**
-	 * Recompute the bounding box of this page to fit its content.
+	 * Insert a stroke at the given index, moving the strokes behind it.
+	 */
+	void insertStroke(unsigned int i, const Stroke& stroke);
+
+	/**
+	 * Remove the stroke with the given index, moving the strokes behind it.
+	 */
+	void removeStroke(unsigned int i);
+
+	/**
+	 * Replace the stroke with the given index.
+	 */
+	void replaceStroke(unsigned int i, const Stroke& stroke);
+
+	/**
+	 * Clean up after strokes were split by the erasor. Removes empty strokes, 
+	 * and merges finished strokes of the same style and transformation, if 
+	 * one starts with the last point of the other. Does nothing, if the 
+	 * content did not change since the last call.
+	 *
+	 * @param history
+	 *             If given, the changes are recorded here.
+	 * @param pageIndex
+	 *             The index of this page in the document, for the history.
+	 *
+	 * @return The number of strokes removed.
+	 */
+	unsigned int compact(History* history = 0, unsigned int pageIndex = 0);
+
+	/**
+	 * Recompute the bounding box of this page to fit its content, and the 
+	 * bounding boxes of its strokes.
 	 */
 	void recomputeBoundingBox();
 
+	/**
+	 * Inform this page that the stroke with the given index was changed 
+	 * externally (e.g., by an erasor). previousBoundingBox is the bounding box 
+	 * of the stroke before the change.
+	 */
+	void strokeChanged(unsigned int i, const util::rect<PagePrecision>& previousBoundingBox);
+
+	/**
+	 * Inform this page that the stroke with the given index was added 
+	 * externally (e.g., by splitting another stroke).
+	 */
+	void strokeAdded(unsigned int i) { indexStroke(i); contentChanged(); }
+
+	/**
+	 * Inform this page that its content was changed externally in a way that 
+	 * does not affect the tile index (e.g., a change of a stroke's style).
+	 */
+	void contentChanged();
+
+	/**
+	 * Get the version of the content of this page. The version changes with 
+	 * every change of the content. Versions are unique among all pages, only a 
+	 * copy of a page shares its version with the original.
+	 */
+	inline unsigned long getContentVersion() const { return _contentVersion; }
+
+	/**
+	 * Set the size of the tiles of the tile index in document units. Rebuilds 
+	 * the index, if the size changed.
+	 */
+	void setTileSize(const util::point<DocumentPrecision>& tileSize);
+
+	/**
+	 * Get the index of the strokes of this page by tiles.
+	 */
+	inline const TileIndex& getTileIndex() const { return *_tileIndex; }
+
+	/**
+	 * Get the bounding boxes of the strokes of this page, in the order of the 
+	 * strokes. They are stored in one array, such that strokes in a region of 
+	 * interest can be found without touching the others.
+	 */
+	inline const bounding_boxes_type& getStrokeBoundingBoxes() const { return *_strokeBoundingBoxes; }
+
 private:
 
 	struct UpdateBoundingBox {
@@ -174,6 +307,61 @@ private:
 			const util::point<PagePrecision>& lineBegin,
 			const util::point<PagePrecision>& lineEnd);
 
+	/**
+	 * Get the tile index for a change, copying it first if it is shared with 
+	 * another page.
+	 */
+	TileIndex& changeTileIndex();
+
+	/**
+	 * Get the stroke bounding boxes for a change, copying them first if they 
+	 * are shared with another page.
+	 */
+	bounding_boxes_type& changeStrokeBoundingBoxes();
+
+	/**
+	 * Copy the bounding box of the given stroke into the array of stroke 
+	 * bounding boxes.
+	 */
+	void updateStrokeBoundingBox(unsigned int stroke);
+
+	/**
+	 * Rebuild the array of stroke bounding boxes from scratch.
+	 */
+	void updateStrokeBoundingBoxes();
+
+	/**
+	 * Get a new, unique content version.
+	 */
+	static unsigned long nextContentVersion();
+
+	/**
+	 * Find a stroke that can be appended to stroke i, which ends with point 
+	 * end. Starts contains the candidates by their first point. Returns the 
+	 * number of strokes if there is none.
+	 */
+	unsigned int findContinuation(
+			unsigned int                                      i,
+			unsigned long                                     end,
+			const std::multimap<unsigned long, unsigned int>& starts,
+			const std::vector<bool>&                          removed);
+
+	/**
+	 * Add the line between stroke points i and i+1 of the given stroke to the 
+	 * tile index.
+	 */
+	void indexSegment(unsigned int stroke, unsigned long i);
+
+	/**
+	 * Add all lines of the given stroke to the tile index.
+	 */
+	void indexStroke(unsigned int stroke);
+
+	/**
+	 * Rebuild the tile index from scratch.
+	 */
+	void reindex();
+
 	bool intersectsErasorCircle(
 			const util::point<PagePrecision> lineStart,
 			const util::point<PagePrecision> lineEnd,
@@ -220,8 +408,26 @@ private:
 	// the bounding box of the page (not its content) in document units
 	util::rect<DocumentPrecision> _pageBoundingBox;
 
+	// the document this page belongs to, and the number of this page in it
+	Document*    _document;
+	unsigned int _index;
+
 	// the global list of stroke points
 	StrokePoints& _strokePoints;
+
+	// the strokes of this page by the tiles they overlap, shared with copies 
+	// of this page until one of them changes
+	boost::shared_ptr<TileIndex> _tileIndex;
+
+	// the bounding boxes of the strokes of this page, shared like the tile 
+	// index
+	boost::shared_ptr<bounding_boxes_type> _strokeBoundingBoxes;
+
+	// the version of the content of this page
+	unsigned long _contentVersion;
+
+	// the version of the content at the last call to compact()
+	unsigned long _compactedVersion;
 };
 
 #endif // YANTA_PAGE_H__
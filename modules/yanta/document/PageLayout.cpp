@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <limits>
+
+#include "PageLayout.h"
+
+namespace {
+
+// compares entries by the top edge of their bounding box
+struct TopBelow {
+
+	template <typename EntryType>
+	bool operator()(DocumentPrecision y, const EntryType& entry) const {
+
+		return y < entry.boundingBox.minY;
+	}
+};
+
+// squared distance of a position to a rectangle, zero if inside
+DocumentPrecision distance2(const util::rect<DocumentPrecision>& rect, const util::point<DocumentPrecision>& position) {
+
+	DocumentPrecision dx = std::max(std::max(rect.minX - position.x, position.x - rect.maxX), (DocumentPrecision)0);
+	DocumentPrecision dy = std::max(std::max(rect.minY - position.y, position.y - rect.maxY), (DocumentPrecision)0);
+
+	return dx*dx + dy*dy;
+}
+
+} // anonymous namespace
+
+void
+PageLayout::addPage(const util::rect<DocumentPrecision>& pageBoundingBox) {
+
+	unsigned int page = _entries.size();
+
+	// insert behind all entries with the same top edge, such that pages in a
+	// row keep their order
+	unsigned int i = numStartingAbove(pageBoundingBox.minY);
+
+	_entries.insert(_entries.begin() + i, Entry(pageBoundingBox, page));
+	_maxY.resize(_entries.size());
+
+	for (; i < _entries.size(); i++)
+		_maxY[i] = std::max(_entries[i].boundingBox.maxY, (i > 0 ? _maxY[i - 1] : _entries[i].boundingBox.maxY));
+}
+
+void
+PageLayout::clear() {
+
+	_entries.clear();
+	_maxY.clear();
+}
+
+bool
+PageLayout::findContaining(const util::point<DocumentPrecision>& position, unsigned int& page) const {
+
+	bool found = false;
+
+	// only entries starting above the position can contain it, and we can
+	// stop as soon as none of the remaining ones reaches down to it
+	for (int i = (int)numStartingAbove(position.y) - 1; i >= 0 && _maxY[i] >= position.y; i--) {
+
+		if (!_entries[i].boundingBox.contains(position))
+			continue;
+
+		if (!found || _entries[i].page < page)
+			page = _entries[i].page;
+
+		found = true;
+	}
+
+	return found;
+}
+
+unsigned int
+PageLayout::findClosest(const util::point<DocumentPrecision>& position) const {
+
+	unsigned int      closest     = 0;
+	DocumentPrecision minDistance = std::numeric_limits<DocumentPrecision>::max();
+
+	int above = numStartingAbove(position.y);
+
+	// entries starting above the position, their vertical distance is at
+	// least the distance to the lowest bottom edge among them
+	for (int i = above - 1; i >= 0; i--) {
+
+		DocumentPrecision dy = std::max(position.y - _maxY[i], (DocumentPrecision)0);
+
+		if (dy*dy > minDistance)
+			break;
+
+		DocumentPrecision distance = distance2(_entries[i].boundingBox, position);
+
+		if (distance < minDistance || (distance == minDistance && _entries[i].page < closest)) {
+
+			minDistance = distance;
+			closest     = _entries[i].page;
+		}
+	}
+
+	// entries starting below the position, in increasing vertical distance
+	for (unsigned int i = above; i < _entries.size(); i++) {
+
+		DocumentPrecision dy = _entries[i].boundingBox.minY - position.y;
+
+		if (dy*dy > minDistance)
+			break;
+
+		DocumentPrecision distance = distance2(_entries[i].boundingBox, position);
+
+		if (distance < minDistance || (distance == minDistance && _entries[i].page < closest)) {
+
+			minDistance = distance;
+			closest     = _entries[i].page;
+		}
+	}
+
+	return closest;
+}
+
+void
+PageLayout::findIntersecting(
+		const util::rect<DocumentPrecision>& area,
+		DocumentPrecision                    margin,
+		std::vector<unsigned int>&           pages) const {
+
+	pages.clear();
+
+	util::rect<DocumentPrecision> enlarged(area.minX - margin, area.minY - margin, area.maxX + margin, area.maxY + margin);
+
+	for (int i = (int)numStartingAbove(enlarged.maxY) - 1; i >= 0 && _maxY[i] >= enlarged.minY; i--)
+		if (_entries[i].boundingBox.intersects(enlarged))
+			pages.push_back(_entries[i].page);
+
+	std::sort(pages.begin(), pages.end());
+}
+
+unsigned int
+PageLayout::numStartingAbove(DocumentPrecision y) const {
+
+	return std::upper_bound(_entries.begin(), _entries.end(), y, TopBelow()) - _entries.begin();
+}
@@ -0,0 +1,87 @@
+#ifndef YANTA_PAGE_LAYOUT_H__
+#define YANTA_PAGE_LAYOUT_H__
+
+#include <vector>
+
+#include <util/point.hpp>
+#include <util/rect.hpp>
+
+#include "Precision.h"
+
+/**
+ * Spatial index of the bounding boxes of the pages of a document. The boxes
+ * are kept sorted by their top edge, together with the lowest bottom edge of
+ * all boxes up to each position. For pages that are stacked vertically (the
+ * usual layout), queries for a position or an area only look at the few pages
+ * around it, found by binary search.
+ *
+ * Pages are identified by the order in which they were added.
+ */
+class PageLayout {
+
+public:
+
+	/**
+	 * Add the bounding box of the next page.
+	 */
+	void addPage(const util::rect<DocumentPrecision>& pageBoundingBox);
+
+	/**
+	 * Remove all pages.
+	 */
+	void clear();
+
+	/**
+	 * Get the number of pages in this layout.
+	 */
+	inline unsigned int numPages() const { return _entries.size(); }
+
+	/**
+	 * Find the page that contains the given position. If several pages
+	 * contain it, the one added first is reported.
+	 *
+	 * @return false, if no page contains the position.
+	 */
+	bool findContaining(const util::point<DocumentPrecision>& position, unsigned int& page) const;
+
+	/**
+	 * Find the page with the smallest distance to the given position. Returns
+	 * 0 if there are no pages.
+	 */
+	unsigned int findClosest(const util::point<DocumentPrecision>& position) const;
+
+	/**
+	 * Get the pages, in the order they were added, whose bounding box
+	 * enlarged by margin on each side intersects the given area.
+	 */
+	void findIntersecting(
+			const util::rect<DocumentPrecision>& area,
+			DocumentPrecision                    margin,
+			std::vector<unsigned int>&           pages) const;
+
+private:
+
+	struct Entry {
+
+		Entry(const util::rect<DocumentPrecision>& boundingBox_, unsigned int page_) :
+			boundingBox(boundingBox_),
+			page(page_) {}
+
+		util::rect<DocumentPrecision> boundingBox;
+		unsigned int                  page;
+	};
+
+	/**
+	 * Get the number of entries with a top edge not below y.
+	 */
+	unsigned int numStartingAbove(DocumentPrecision y) const;
+
+	// the pages sorted by the top edge of their bounding box
+	std::vector<Entry> _entries;
+
+	// the lowest bottom edge of the entries up to (and including) each entry
+	std::vector<DocumentPrecision> _maxY;
+};
+
+#endif // YANTA_PAGE_LAYOUT_H__
+
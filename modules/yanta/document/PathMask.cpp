@@ -0,0 +1,185 @@
+#include <cmath>
+#include <algorithm>
+
+#include <SkBitmap.h>
+#include <SkCanvas.h>
+#include <SkPaint.h>
+
+#include <util/Logger.h>
+#include "PathMask.h"
+
+logger::LogChannel pathmasklog("pathmasklog", "[PathMask] ");
+
+PathMask::PathMask(const Path& path) :
+	_path(path),
+	_origin(0, 0),
+	_cellSize(1),
+	_width(0),
+	_height(0) {
+
+	// Skia computes the bounds lazily -- do that now, before contains() gets 
+	// called from several threads
+	const SkRect& bounds = path.getBounds();
+
+	DocumentPrecision width  = bounds.fRight  - bounds.fLeft;
+	DocumentPrecision height = bounds.fBottom - bounds.fTop;
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	// leave a margin of one cell, such that the border cells are outside
+	_cellSize = std::max(width, height)/(MaxSize - 2);
+	_origin   = util::point<DocumentPrecision>(bounds.fLeft - _cellSize, bounds.fTop - _cellSize);
+	_width    = (int)ceil(width/_cellSize)  + 2;
+	_height   = (int)ceil(height/_cellSize) + 2;
+
+	LOG_ALL(pathmasklog) << "rasterizing path into " << _width << "x" << _height << " cells of size " << _cellSize << std::endl;
+
+	std::vector<unsigned char> alpha(_width*_height, 0);
+
+	{
+		SkBitmap bitmap;
+		bitmap.setInfo(SkImageInfo::MakeA8(_width, _height));
+		bitmap.setPixels(&alpha[0]);
+
+		SkCanvas canvas(bitmap);
+		canvas.scale(1.0/_cellSize, 1.0/_cellSize);
+		canvas.translate(-_origin.x, -_origin.y);
+
+		SkPaint paint;
+		paint.setAntiAlias(true);
+
+		canvas.drawPath(path, paint);
+	}
+
+	// a cell is only inside or outside if its neighbors agree, which makes us 
+	// robust against the approximations of the rasterizer
+	_cells.resize(_width*_height);
+
+	for (int y = 0; y < _height; y++)
+		for (int x = 0; x < _width; x++) {
+
+			bool full  = true;
+			bool empty = true;
+
+			for (int ny = std::max(0, y - 1); ny <= std::min(_height - 1, y + 1); ny++)
+				for (int nx = std::max(0, x - 1); nx <= std::min(_width - 1, x + 1); nx++) {
+
+					unsigned char a = alpha[ny*_width + nx];
+
+					full  = full  && (a == 255);
+					empty = empty && (a == 0);
+				}
+
+			_cells[y*_width + x] = (full ? Inside : (empty ? Outside : Boundary));
+		}
+
+	// summed area tables with an additional zero row and column
+	_notInside.resize((_width + 1)*(_height + 1), 0);
+	_notOutside.resize((_width + 1)*(_height + 1), 0);
+
+	for (int y = 0; y < _height; y++)
+		for (int x = 0; x < _width; x++) {
+
+			unsigned char cell = _cells[y*_width + x];
+
+			int i     = (y + 1)*(_width + 1) + (x + 1);
+			int left  = i - 1;
+			int up    = i - (_width + 1);
+			int diag  = up - 1;
+
+			_notInside[i]  = _notInside[left]  + _notInside[up]  - _notInside[diag]  + (cell != Inside);
+			_notOutside[i] = _notOutside[left] + _notOutside[up] - _notOutside[diag] + (cell != Outside);
+		}
+}
+
+bool
+PathMask::contains(const util::point<DocumentPrecision>& point) const {
+
+	int x = (int)floor((point.x - _origin.x)/_cellSize);
+	int y = (int)floor((point.y - _origin.y)/_cellSize);
+
+	if (x < 0 || y < 0 || x >= _width || y >= _height)
+		return false;
+
+	switch (_cells[y*_width + x]) {
+
+		case Inside:
+			return true;
+
+		case Outside:
+			return false;
+
+		default:
+			return _path.contains(point);
+	}
+}
+
+bool
+PathMask::contains(const Page& page, const Stroke& stroke, const StrokePoints& points) const {
+
+	if (stroke.size() == 0)
+		return false;
+
+	// the bounding box of the stroke decides in most cases
+	util::rect<DocumentPrecision> area = stroke.getBoundingBox();
+	area += page.getShift();
+
+	Coverage areaCoverage = coverage(area);
+
+	if (areaCoverage == Inside)
+		return true;
+
+	if (areaCoverage == Outside)
+		return false;
+
+	for (unsigned long i = stroke.begin(); i < stroke.end(); i++) {
+
+		util::point<DocumentPrecision> point = points[i].position*stroke.getScale() + stroke.getShift() + page.getShift();
+
+		if (!contains(point))
+			return false;
+	}
+
+	return true;
+}
+
+PathMask::Coverage
+PathMask::coverage(const util::rect<DocumentPrecision>& area) const {
+
+	int minX = (int)floor((area.minX - _origin.x)/_cellSize);
+	int minY = (int)floor((area.minY - _origin.y)/_cellSize);
+	int maxX = (int)floor((area.maxX - _origin.x)/_cellSize);
+	int maxY = (int)floor((area.maxY - _origin.y)/_cellSize);
+
+	// no overlap with the grid at all
+	if (maxX < 0 || maxY < 0 || minX >= _width || minY >= _height)
+		return Outside;
+
+	bool withinGrid = (minX >= 0 && minY >= 0 && maxX < _width && maxY < _height);
+
+	minX = std::max(minX, 0);
+	minY = std::max(minY, 0);
+	maxX = std::min(maxX, _width  - 1);
+	maxY = std::min(maxY, _height - 1);
+
+	if (withinGrid && sum(_notInside, minX, minY, maxX, maxY) == 0)
+		return Inside;
+
+	if (sum(_notOutside, minX, minY, maxX, maxY) == 0)
+		return Outside;
+
+	return Boundary;
+}
+
+unsigned int
+PathMask::sum(const std::vector<unsigned int>& table, int minX, int minY, int maxX, int maxY) const {
+
+	int stride = _width + 1;
+
+	return
+			table[(maxY + 1)*stride + (maxX + 1)] -
+			table[ minY     *stride + (maxX + 1)] -
+			table[(maxY + 1)*stride +  minX     ] +
+			table[ minY     *stride +  minX     ];
+}
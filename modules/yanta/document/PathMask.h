@@ -0,0 +1,86 @@
+#ifndef YANTA_PATH_MASK_H__
+#define YANTA_PATH_MASK_H__
+
+#include <vector>
+
+#include <util/point.hpp>
+#include <util/rect.hpp>
+
+#include "Page.h"
+#include "Path.h"
+#include "Precision.h"
+#include "Stroke.h"
+#include "StrokePoints.h"
+
+/**
+ * Fast containment tests for a path. The path is rasterized once into a grid 
+ * of cells that are either completely inside, completely outside, or on the 
+ * boundary of the path. Only points in boundary cells are tested against the 
+ * path itself.
+ *
+ * The mask does not change the path, contains() can be called from several 
+ * threads at the same time.
+ */
+class PathMask {
+
+public:
+
+	// the maximal number of cells along each side of the mask
+	static const int MaxSize = 512;
+
+	/**
+	 * Create a mask for the given path, which has to outlive the mask.
+	 */
+	PathMask(const Path& path);
+
+	/**
+	 * Test, whether a point is contained in the path.
+	 */
+	bool contains(const util::point<DocumentPrecision>& point) const;
+
+	/**
+	 * Test, whether a stroke is fully contained in the path.
+	 */
+	bool contains(const Page& page, const Stroke& stroke, const StrokePoints& points) const;
+
+private:
+
+	enum Coverage {
+
+		Outside,
+		Inside,
+		Boundary
+	};
+
+	/**
+	 * Get the coverage of the cells in the given area (in document units). 
+	 * Returns Boundary, if the cells do not agree.
+	 */
+	Coverage coverage(const util::rect<DocumentPrecision>& area) const;
+
+	/**
+	 * Get the sum of a summed area table over the cells [minX, maxX]x[minY, 
+	 * maxY].
+	 */
+	unsigned int sum(const std::vector<unsigned int>& table, int minX, int minY, int maxX, int maxY) const;
+
+	const Path& _path;
+
+	// the document position of the upper left corner of the grid
+	util::point<DocumentPrecision> _origin;
+
+	// the size of a cell in document units
+	DocumentPrecision _cellSize;
+
+	int _width;
+	int _height;
+
+	std::vector<unsigned char> _cells;
+
+	// summed area tables of the cells that are not inside and not outside
+	std::vector<unsigned int> _notInside;
+	std::vector<unsigned int> _notOutside;
+};
+
+#endif // YANTA_PATH_MASK_H__
+
@@ -1,28 +1,103 @@
+#include <algorithm>
+
+#include <boost/atomic.hpp>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #include <util/Logger.h>
 
 #include "Document.h"
+#include "History.h"
 #include "Selection.h"
 #include "Path.h"
+#include "PathMask.h"
 
 logger::LogChannel selectionlog("selectionlog", "[Selection] ");
 
+namespace {
+
+/**
+ * Find the strokes contained in the mask for every step-th page, starting 
+ * with page first.
+ */
+void findContainedStrokes(
+		const PathMask&                   mask,
+		const Document&                   document,
+		unsigned int                      first,
+		unsigned int                      step,
+		std::vector<std::vector<bool> >&  contained) {
+
+	for (unsigned int p = first; p < document.numPages(); p += step) {
+
+		const Page& page = document.getPage(p);
+
+		contained[p].resize(page.numStrokes());
+
+		for (unsigned int i = 0; i < page.numStrokes(); i++)
+			contained[p][i] = mask.contains(page, page.getStroke(i), document.getStrokePoints());
+	}
+}
+
+/**
+ * Predicate for Page::removeStrokes(), selecting strokes by their index.
+ */
+class IsContained {
+
+public:
+
+	IsContained(const std::vector<bool>& contained, const Stroke& first) :
+		_contained(contained),
+		_first(&first) {}
+
+	bool operator()(const Stroke& stroke) const { return _contained[&stroke - _first]; }
+
+private:
+
+	const std::vector<bool>& _contained;
+	const Stroke*            _first;
+};
+
+} // anonymous namespace
+
 Selection
-Selection::CreateFromPath(const Path& path, Document& document) {
+Selection::CreateFromPath(const Path& path, Document& document, History* history) {
 
 	Selection selection(document.getStrokePoints());
 
 	LOG_ALL(selectionlog) << "created new selection in " << selection.getBoundingBox() << std::endl;
 
+	PathMask mask(path);
+
+	// find the contained strokes, each thread on its own pages
+	std::vector<std::vector<bool> > contained(document.numPages());
+
+	unsigned int numThreads = std::max(1U, std::min(document.numPages(), boost::thread::hardware_concurrency()));
+
+	boost::thread_group threads;
+	for (unsigned int t = 1; t < numThreads; t++)
+		threads.create_thread(boost::bind(&findContainedStrokes, boost::cref(mask), boost::cref(document), t, numThreads, boost::ref(contained)));
+
+	findContainedStrokes(mask, document, 0, numThreads, contained);
+	threads.join_all();
+
 	for (unsigned int p = 0; p < document.numPages(); p++) {
 
-		LOG_ALL(selectionlog) << "parsing page " << p << " for selection content" <<  std::endl;
+		// don't touch pages without selected strokes
+		if (std::find(contained[p].begin(), contained[p].end(), true) == contained[p].end())
+			continue;
+
+		LOG_ALL(selectionlog) << "removing selected strokes from page " << p << std::endl;
 
 		Page& page = document.getPage(p);
 
 		// get all the strokes that are fully contained in the path
-		std::vector<Stroke> selectedStrokes = page.removeStrokes(boost::bind(&Path::contains, &path, boost::ref(page), _1, boost::ref(document.getStrokePoints())));
+		std::vector<unsigned int> indices;
+		std::vector<Stroke> selectedStrokes = page.removeStrokes(IsContained(contained[p], page.getStroke(0)), &indices);
+
+		// as if the strokes were removed one by one, starting with the last
+		if (history)
+			for (int i = selectedStrokes.size() - 1; i >= 0; i--)
+				history->strokeRemoved(p, indices[i], selectedStrokes[i]);
 
 		for (std::vector<Stroke>::iterator i = selectedStrokes.begin(); i != selectedStrokes.end(); i++) {
 
@@ -36,7 +111,8 @@ Selection::CreateFromPath(const Path& path, Document& document) {
 }
 
 Selection::Selection(const StrokePoints& strokePoints) :
-	_strokePoints(strokePoints) {}
+	_strokePoints(strokePoints),
+	_contentVersion(nextContentVersion()) {}
 
 Selection&
 Selection::operator=(const Selection& other) {
@@ -44,6 +120,8 @@ Selection::operator=(const Selection& other) {
 	// copy the elements of the container
 	DocumentElementContainer<SelectionElementTypes>::operator=(other);
 
+	_contentVersion = other._contentVersion;
+
 	// we don't copy the stroke points, since they might belong to another 
 	// document
 	return *this;
@@ -60,10 +138,12 @@ Selection::addStroke(const Page& page, const Stroke& stroke) {
 	fitBoundingBox(selectionCopy.getBoundingBox());
 
 	add(selectionCopy);
+
+	_contentVersion = nextContentVersion();
 }
 
 void
-Selection::anchor(Document& document) {
+Selection::anchor(Document& document, History* history) {
 
 	for (unsigned int i = 0; i < numStrokes(); i++) {
 
@@ -87,6 +167,18 @@ Selection::anchor(Document& document) {
 		LOG_DEBUG(selectionlog) << "relative to page, stroke is now at " << stroke.getShift() << std::endl;
 
 		// add it
-		document.getPage(p).addStroke(stroke);
+		page.addStroke(stroke);
+
+		if (history)
+			history->strokeAdded(p, page.numStrokes() - 1, stroke);
 	}
 }
+
+unsigned long
+Selection::nextContentVersion() {
+
+	// selections of different documents change in different threads
+	static boost::atomic<unsigned long> version(0);
+
+	return ++version;
+}
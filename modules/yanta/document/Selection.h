@@ -11,6 +11,7 @@
 // forward declarations
 class Path;
 class Document;
+class History;
 
 // the types of elements in a selection
 typedef TYPELIST_1(Stroke) SelectionElementTypes;
@@ -27,9 +28,10 @@ public:
 	/**
 	 * Create a selection from a path and a document. Every document object that is 
 	 * fully contained in the path will be added to the selection and removed 
-	 * from the document.
+	 * from the document. If a history is given, the removals are recorded in 
+	 * it.
 	 */
-	static Selection CreateFromPath(const Path& path, Document& document);
+	static Selection CreateFromPath(const Path& path, Document& document, History* history = 0);
 
 	/**
 	 * Create a new selection.
@@ -55,13 +57,29 @@ public:
 	const StrokePoints& getStrokePoints() const { return _strokePoints; }
 
 	/**
-	 * Place the content of the selection on the document.
+	 * Get the version of the content of this selection. The version changes 
+	 * whenever a stroke is added, but not with the transformation of the 
+	 * selection. Only a copy of a selection shares its version with the 
+	 * original.
 	 */
-	void anchor(Document& document);
+	unsigned long getContentVersion() const { return _contentVersion; }
+
+	/**
+	 * Place the content of the selection on the document. If a history is 
+	 * given, the added strokes are recorded in it.
+	 */
+	void anchor(Document& document, History* history = 0);
 
 private:
 
+	/**
+	 * Get a new, unique content version.
+	 */
+	static unsigned long nextContentVersion();
+
 	const StrokePoints& _strokePoints;
+
+	unsigned long _contentVersion;
 };
 
 #endif // YANTA_SELECTION_H__
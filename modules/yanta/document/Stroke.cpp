@@ -0,0 +1,123 @@
+#include <algorithm>
+
+#include <boost/make_shared.hpp>
+
+#include "Stroke.h"
+
+// the maximal distance of a stroke point to the curve fitted to the stroke
+const double CurveTolerance = 0.02;
+
+void
+Stroke::finish(const StrokePoints& points) {
+
+	_finished = true;
+
+	_lod.reset();
+
+	// parts of erased strokes keep the curve of the original stroke
+	if (size() < 2)
+		_curve.reset();
+	else if (!_curve || !_curve->covers(_begin, _end))
+		_curve = boost::make_shared<StrokeCurve>(points, _begin, _end, CurveTolerance);
+
+	// nothing to simplify
+	if (size() <= 2)
+		return;
+
+	boost::shared_ptr<Lod> lod = boost::make_shared<Lod>();
+
+	for (unsigned int level = 0; level < NumLodLevels; level++)
+		simplify(points, getLodTolerance(level), lod->indices[level]);
+
+	_lod = lod;
+}
+
+DocumentPrecision
+Stroke::getLodTolerance(unsigned int level) {
+
+	// 0.1, 0.4, and 1.6 units
+	return 0.1*(1 << (2*level));
+}
+
+void
+Stroke::simplify(
+		const StrokePoints&        points,
+		DocumentPrecision          tolerance,
+		std::vector<unsigned int>& indices) const {
+
+	unsigned int n = size();
+
+	std::vector<bool> keep(n, false);
+	keep[0]     = true;
+	keep[n - 1] = true;
+
+	DocumentPrecision tolerance2 = tolerance*tolerance;
+
+	// ranges of points (relative to _begin) that still need to be simplified,
+	// processed without recursion to handle strokes of any length
+	std::vector<std::pair<unsigned int, unsigned int> > ranges;
+	ranges.push_back(std::make_pair(0u, n - 1));
+
+	while (!ranges.empty()) {
+
+		unsigned int first = ranges.back().first;
+		unsigned int last  = ranges.back().second;
+		ranges.pop_back();
+
+		if (last <= first + 1)
+			continue;
+
+		const util::point<DocumentPrecision>& a = points[_begin + first].position;
+		const util::point<DocumentPrecision>& b = points[_begin + last].position;
+
+		// find the point farthest away from the line between first and last
+		DocumentPrecision maxDistance2 = 0;
+		unsigned int      farthest     = first;
+
+		for (unsigned int i = first + 1; i < last; i++) {
+
+			DocumentPrecision d2 = distance2(points[_begin + i].position, a, b);
+
+			if (d2 > maxDistance2) {
+
+				maxDistance2 = d2;
+				farthest     = i;
+			}
+		}
+
+		// all points are close enough to the line
+		if (maxDistance2 <= tolerance2)
+			continue;
+
+		keep[farthest] = true;
+		ranges.push_back(std::make_pair(first, farthest));
+		ranges.push_back(std::make_pair(farthest, last));
+	}
+
+	indices.clear();
+	for (unsigned int i = 0; i < n; i++)
+		if (keep[i])
+			indices.push_back(i);
+}
+
+DocumentPrecision
+Stroke::distance2(
+		const util::point<DocumentPrecision>& p,
+		const util::point<DocumentPrecision>& a,
+		const util::point<DocumentPrecision>& b) {
+
+	util::point<DocumentPrecision> ab = b - a;
+	util::point<DocumentPrecision> ap = p - a;
+
+	DocumentPrecision length2 = ab.x*ab.x + ab.y*ab.y;
+
+	// the position of the projection of p on the line, clamped to the segment
+	DocumentPrecision t = 0;
+	if (length2 > 0)
+		t = std::max(0.0, std::min(1.0, (ap.x*ab.x + ap.y*ab.y)/length2));
+
+	util::point<DocumentPrecision> d = ap - ab*t;
+
+	return d.x*d.x + d.y*d.y;
+}
+
@@ -2,12 +2,15 @@
 #define STROKE_H__
 
 #include <vector>
+#include <boost/shared_ptr.hpp>
 #include <util/point.hpp>
 #include <util/rect.hpp>
 
 #include "DocumentElement.h"
+#include "StrokeCurve.h"
 #include "StrokePoints.h"
 #include "Style.h"
+#include "StyleTable.h"
 
 class Stroke : public DocumentElement {
 
@@ -15,10 +18,14 @@ public:
 
 	YANTA_TREE_VISITABLE();
 
+	// the number of simplified versions of a finished stroke
+	static const unsigned int NumLodLevels = 3;
+
 	Stroke(unsigned long begin = 0) :
-		_finished(false),
 		_begin(begin),
-		_end(0) {}
+		_end(0),
+		_style(0),
+		_finished(false) {}
 
 	/**
 	 * Get the number of stroke points in this stroke.
@@ -34,22 +41,14 @@ public:
 	/**
 	 * Set the style this stroke should be drawn with.
 	 */
-	inline void setStyle(const Style& style) { _style = style; }
+	inline void setStyle(const Style& style) { _style = StyleTable::intern(style); }
 
 	/**
 	 * Get the style this stroke is supposed to be drawn with.
 	 */
 	inline const Style& getStyle() const {
 
-		return _style;
-	}
-
-	/**
-	 * Get the style this stroke is supposed to be drawn with.
-	 */
-	inline Style& getStyle() {
-
-		return _style;
+		return StyleTable::get(_style);
 	}
 
 	/**
@@ -58,6 +57,7 @@ public:
 	inline void setBegin(unsigned long index) {
 
 		_begin = index;
+		_lod.reset();
 	}
 
 	/**
@@ -65,20 +65,23 @@ public:
 	 */
 	inline void setEnd(unsigned long index, const StrokePoints& points) {
 
+		double width = getStyle().width();
+
 		// update bounding box
 		for (unsigned int i = std::max(_begin, _end); i < index; i++) {
 
 			const StrokePoint& point = points[i];
 
 			fitBoundingBox(util::rect<DocumentPrecision>(
-					point.position.x - _style.width(),
-					point.position.y - _style.width(),
-					point.position.x + _style.width(),
-					point.position.y + _style.width()));
+					point.position.x - width,
+					point.position.y - width,
+					point.position.x + width,
+					point.position.y + width));
 		}
 
 		// update end pointer
 		_end = index;
+		_lod.reset();
 	}
 
 	/**
@@ -92,12 +95,10 @@ public:
 	inline unsigned long end() const { return _end; }
 
 	/**
-	 * Finish this stroke. Computes the bounding box.
+	 * Finish this stroke. Computes the simplified versions of the stroke and 
+	 * fits a curve to it, unless it has a curve covering its points already.
 	 */
-	inline void finish() {
-
-		_finished = true;
-	}
+	void finish(const StrokePoints& points);
 
 	/**
 	 * Test, whether this stroke was finished already.
@@ -114,27 +115,99 @@ public:
 
 		resetBoundingBox();
 
+		double width = getStyle().width();
+
 		for (unsigned int i = _begin; i < _end; i++) {
 
 			const StrokePoint& point = points[i];
 
 			fitBoundingBox(util::rect<DocumentPrecision>(
-					point.position.x - _style.width(),
-					point.position.y - _style.width(),
-					point.position.x + _style.width(),
-					point.position.y + _style.width()));
+					point.position.x - width,
+					point.position.y - width,
+					point.position.x + width,
+					point.position.y + width));
 		}
 	}
 
+	/**
+	 * Get the maximal distance (in stroke units) of the points of this stroke 
+	 * to its simplified version of the given level.
+	 */
+	static DocumentPrecision getLodTolerance(unsigned int level);
+
+	/**
+	 * Check whether simplified versions of this stroke are available.
+	 */
+	inline bool hasLod() const { return _lod; }
+
+	/**
+	 * Get the points of a simplified version of this stroke as indices 
+	 * relative to begin(). The first and last point are always included.
+	 */
+	inline const std::vector<unsigned int>& getLod(unsigned int level) const { return _lod->indices[level]; }
+
+	/**
+	 * Check whether a curve approximating this stroke is available.
+	 */
+	inline bool hasCurve() const { return _curve; }
+
+	/**
+	 * Get the curve approximating this stroke.
+	 */
+	inline const StrokeCurve& getCurve() const { return *_curve; }
+
+	/**
+	 * Get the curve approximating this stroke to share it with another stroke 
+	 * (e.g., the parts of this stroke after erasing).
+	 */
+	inline boost::shared_ptr<const StrokeCurve> shareCurve() const { return _curve; }
+
+	/**
+	 * Set the curve approximating this stroke (e.g., when reading a stroke 
+	 * from a file, or splitting a stroke). The curve can cover more points 
+	 * than the stroke has.
+	 */
+	inline void setCurve(boost::shared_ptr<const StrokeCurve> curve) { _curve = curve; }
+
 private:
 
-	Style _style;
+	struct Lod {
 
-	bool _finished;
+		std::vector<unsigned int> indices[NumLodLevels];
+	};
+
+	/**
+	 * Simplify the stroke with the Ramer-Douglas-Peucker algorithm, such that 
+	 * no point is farther away than tolerance from the simplified line.
+	 */
+	void simplify(
+			const StrokePoints&        points,
+			DocumentPrecision          tolerance,
+			std::vector<unsigned int>& indices) const;
+
+	/**
+	 * The squared distance of p to the line segment between a and b.
+	 */
+	static DocumentPrecision distance2(
+			const util::point<DocumentPrecision>& p,
+			const util::point<DocumentPrecision>& a,
+			const util::point<DocumentPrecision>& b);
 
 	// indices of the stroke points in the global point list
-	unsigned long _begin;
-	unsigned long _end;
+	unsigned int _begin;
+	unsigned int _end;
+
+	// the index of the style in the StyleTable
+	unsigned short _style;
+
+	bool _finished;
+
+	// simplified versions of this stroke, shared between copies
+	boost::shared_ptr<const Lod> _lod;
+
+	// the Bezier curve approximating this stroke, shared between copies and 
+	// the parts of an erased stroke
+	boost::shared_ptr<const StrokeCurve> _curve;
 };
 
 #endif // STROKE_H__
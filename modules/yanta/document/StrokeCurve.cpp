@@ -0,0 +1,317 @@
+#include <cmath>
+#include <algorithm>
+
+#include "StrokeCurve.h"
+
+namespace {
+
+inline double dot(const util::point<PagePrecision>& a, const util::point<PagePrecision>& b) {
+
+	return a.x*b.x + a.y*b.y;
+}
+
+inline double length(const util::point<PagePrecision>& a) {
+
+	return sqrt(dot(a, a));
+}
+
+inline util::point<PagePrecision> normalize(const util::point<PagePrecision>& a) {
+
+	double l = length(a);
+
+	if (l == 0)
+		return a;
+
+	return a/l;
+}
+
+} // anonymous namespace
+
+StrokeCurve::StrokeCurve(
+		const StrokePoints& points,
+		unsigned long       begin,
+		unsigned long       end,
+		double              maxError) {
+
+	Samples samples;
+	samples.maxError2 = maxError*maxError;
+
+	// collect the samples, skip duplicates which would lead to zero-length
+	// parameter intervals
+	for (unsigned long i = begin; i < end; i++) {
+
+		if (!samples.positions.empty() && length(points[i].position - samples.positions.back()) < 1e-9)
+			continue;
+
+		samples.positions.push_back(points[i].position);
+		samples.pressures.push_back(points[i].pressure);
+		samples.indices.push_back(i);
+	}
+
+	if (samples.positions.size() < 2)
+		return;
+
+	unsigned int last = samples.positions.size() - 1;
+
+	point_type tangent0 = normalize(samples.positions[1] - samples.positions[0]);
+	point_type tangent1 = normalize(samples.positions[last - 1] - samples.positions[last]);
+
+	fit(samples, 0, last, tangent0, tangent1);
+}
+
+util::point<PagePrecision>
+StrokeCurve::evaluate(const Segment& segment, double t) {
+
+	double s = 1 - t;
+
+	return
+			segment.p0*(s*s*s) +
+			segment.c0*(3*s*s*t) +
+			segment.c1*(3*s*t*t) +
+			segment.p1*(t*t*t);
+}
+
+StrokeCurve::Segment
+StrokeCurve::cut(const Segment& segment, double t0, double t1) {
+
+	Segment piece = segment;
+
+	// de Casteljau subdivision, first keep the part before t1...
+	if (t1 < 1) {
+
+		point_type a = piece.p0*(1 - t1) + piece.c0*t1;
+		point_type b = piece.c0*(1 - t1) + piece.c1*t1;
+		point_type c = piece.c1*(1 - t1) + piece.p1*t1;
+		point_type d = a*(1 - t1) + b*t1;
+		point_type e = b*(1 - t1) + c*t1;
+
+		piece.c0 = a;
+		piece.c1 = d;
+		piece.p1 = d*(1 - t1) + e*t1;
+	}
+
+	// ...then the part of it after t0
+	if (t0 > 0 && t1 > 0) {
+
+		double t = std::min(1.0, t0/t1);
+
+		point_type a = piece.p0*(1 - t) + piece.c0*t;
+		point_type b = piece.c0*(1 - t) + piece.c1*t;
+		point_type c = piece.c1*(1 - t) + piece.p1*t;
+		point_type d = a*(1 - t) + b*t;
+		point_type e = b*(1 - t) + c*t;
+
+		piece.p0 = d*(1 - t) + e*t;
+		piece.c0 = e;
+		piece.c1 = c;
+	}
+
+	piece.pressure0 = (1 - t0)*segment.pressure0 + t0*segment.pressure1;
+	piece.pressure1 = (1 - t1)*segment.pressure0 + t1*segment.pressure1;
+
+	return piece;
+}
+
+void
+StrokeCurve::fit(
+		const Samples&    samples,
+		unsigned int      first,
+		unsigned int      last,
+		const point_type& tangent0,
+		const point_type& tangent1) {
+
+	Segment segment;
+
+	// only two samples, use a heuristic
+	if (last - first == 1) {
+
+		double distance = length(samples.positions[last] - samples.positions[first])/3.0;
+
+		segment.p0 = samples.positions[first];
+		segment.p1 = samples.positions[last];
+		segment.c0 = segment.p0 + tangent0*distance;
+		segment.c1 = segment.p1 + tangent1*distance;
+
+		addSegment(samples, segment, first, last);
+		return;
+	}
+
+	// chord length parameterization
+	std::vector<double> u(last - first + 1);
+	u[0] = 0;
+	for (unsigned int i = first + 1; i <= last; i++)
+		u[i - first] = u[i - first - 1] + length(samples.positions[i] - samples.positions[i - 1]);
+	for (unsigned int i = first + 1; i <= last; i++)
+		u[i - first] /= u[last - first];
+
+	generate(samples, first, last, u, tangent0, tangent1, segment);
+
+	unsigned int split;
+	double error = maxError(samples, first, last, u, segment, split);
+
+	if (error < samples.maxError2) {
+
+		addSegment(samples, segment, first, last);
+		return;
+	}
+
+	// close enough to try to improve the parameterization
+	if (error < 16*samples.maxError2) {
+
+		for (int iteration = 0; iteration < 4; iteration++) {
+
+			for (unsigned int i = first; i <= last; i++)
+				u[i - first] = reparameterize(segment, samples.positions[i], u[i - first]);
+
+			generate(samples, first, last, u, tangent0, tangent1, segment);
+			error = maxError(samples, first, last, u, segment, split);
+
+			if (error < samples.maxError2) {
+
+				addSegment(samples, segment, first, last);
+				return;
+			}
+		}
+	}
+
+	// split at the point of maximal error and fit both halves
+	point_type tangentCenter = normalize(samples.positions[split - 1] - samples.positions[split + 1]);
+
+	fit(samples, first, split, tangent0, tangentCenter);
+	fit(samples, split, last, -tangentCenter, tangent1);
+}
+
+void
+StrokeCurve::generate(
+		const Samples&             samples,
+		unsigned int               first,
+		unsigned int               last,
+		const std::vector<double>& u,
+		const point_type&          tangent0,
+		const point_type&          tangent1,
+		Segment&                   segment) {
+
+	// least-squares fit of the lengths of the tangents
+	double c00 = 0, c01 = 0, c11 = 0;
+	double x0 = 0, x1 = 0;
+
+	const point_type& p0 = samples.positions[first];
+	const point_type& p1 = samples.positions[last];
+
+	for (unsigned int i = first; i <= last; i++) {
+
+		double t = u[i - first];
+		double s = 1 - t;
+
+		double b0 = s*s*s;
+		double b1 = 3*s*s*t;
+		double b2 = 3*s*t*t;
+		double b3 = t*t*t;
+
+		point_type a0 = tangent0*b1;
+		point_type a1 = tangent1*b2;
+
+		c00 += dot(a0, a0);
+		c01 += dot(a0, a1);
+		c11 += dot(a1, a1);
+
+		point_type rest = samples.positions[i] - (p0*(b0 + b1) + p1*(b2 + b3));
+
+		x0 += dot(a0, rest);
+		x1 += dot(a1, rest);
+	}
+
+	double det = c00*c11 - c01*c01;
+
+	double alpha0 = 0;
+	double alpha1 = 0;
+
+	if (det != 0) {
+
+		alpha0 = (x0*c11 - x1*c01)/det;
+		alpha1 = (c00*x1 - c01*x0)/det;
+	}
+
+	// fall back to the heuristic, if the fit is degenerated
+	double distance = length(p1 - p0);
+	double epsilon  = 1e-6*distance;
+
+	if (alpha0 < epsilon || alpha1 < epsilon) {
+
+		alpha0 = distance/3.0;
+		alpha1 = distance/3.0;
+	}
+
+	segment.p0 = p0;
+	segment.p1 = p1;
+	segment.c0 = p0 + tangent0*alpha0;
+	segment.c1 = p1 + tangent1*alpha1;
+}
+
+double
+StrokeCurve::maxError(
+		const Samples&             samples,
+		unsigned int               first,
+		unsigned int               last,
+		const std::vector<double>& u,
+		const Segment&             segment,
+		unsigned int&              split) {
+
+	double max = 0;
+	split = (first + last)/2;
+
+	for (unsigned int i = first + 1; i < last; i++) {
+
+		point_type diff = evaluate(segment, u[i - first]) - samples.positions[i];
+		double     d2   = dot(diff, diff);
+
+		if (d2 >= max) {
+
+			max   = d2;
+			split = i;
+		}
+	}
+
+	return max;
+}
+
+double
+StrokeCurve::reparameterize(const Segment& segment, const point_type& p, double u) {
+
+	double s = 1 - u;
+
+	// the curve and its first and second derivative at u
+	point_type q  = evaluate(segment, u);
+	point_type q1 =
+			(segment.c0 - segment.p0)*(3*s*s) +
+			(segment.c1 - segment.c0)*(6*s*u) +
+			(segment.p1 - segment.c1)*(3*u*u);
+	point_type q2 =
+			(segment.c1 - segment.c0*2 + segment.p0)*(6*s) +
+			(segment.p1 - segment.c1*2 + segment.c0)*(6*u);
+
+	point_type diff = q - p;
+
+	double numerator   = dot(diff, q1);
+	double denominator = dot(q1, q1) + dot(diff, q2);
+
+	if (denominator == 0)
+		return u;
+
+	return std::max(0.0, std::min(1.0, u - numerator/denominator));
+}
+
+void
+StrokeCurve::addSegment(
+		const Samples& samples,
+		Segment&       segment,
+		unsigned int   first,
+		unsigned int   last) {
+
+	segment.pressure0 = samples.pressures[first];
+	segment.pressure1 = samples.pressures[last];
+	segment.begin     = samples.indices[first];
+	segment.end       = samples.indices[last];
+
+	_segments.push_back(segment);
+}
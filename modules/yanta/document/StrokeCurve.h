@@ -0,0 +1,144 @@
+#ifndef YANTA_STROKE_CURVE_H__
+#define YANTA_STROKE_CURVE_H__
+
+#include <vector>
+
+#include <util/point.hpp>
+
+#include "Precision.h"
+#include "StrokePoints.h"
+
+/**
+ * A piecewise cubic Bezier approximation of the stroke points of a stroke.
+ */
+class StrokeCurve {
+
+public:
+
+	/**
+	 * A single cubic Bezier segment, with the pressure interpolated linearly
+	 * between its ends.
+	 */
+	struct Segment {
+
+		// start, control points, and end
+		util::point<PagePrecision> p0, c0, c1, p1;
+
+		// the pressure at the start and the end
+		double pressure0, pressure1;
+
+		// the first and last stroke point approximated by this segment
+		unsigned long begin, end;
+	};
+
+	typedef std::vector<Segment> segments_type;
+
+	/**
+	 * Fit a curve to the stroke points in [begin, end), such that no stroke
+	 * point is farther away from the curve than maxError.
+	 */
+	StrokeCurve(
+			const StrokePoints& points,
+			unsigned long       begin,
+			unsigned long       end,
+			double              maxError);
+
+	/**
+	 * Create a curve from the given segments.
+	 */
+	StrokeCurve(const segments_type& segments) : _segments(segments) {}
+
+	/**
+	 * Get the segments of this curve.
+	 */
+	inline const segments_type& getSegments() const { return _segments; }
+
+	/**
+	 * Check whether this curve approximates all the stroke points in [begin, 
+	 * end). Strokes split by erasing keep the curve of the original stroke.
+	 */
+	inline bool covers(unsigned long begin, unsigned long end) const {
+
+		return
+				!_segments.empty() &&
+				_segments.front().begin <= begin &&
+				_segments.back().end + 1 >= end;
+	}
+
+	/**
+	 * Evaluate a segment at t in [0,1].
+	 */
+	static util::point<PagePrecision> evaluate(const Segment& segment, double t);
+
+	/**
+	 * Get the part of a segment between t0 and t1 in [0,1].
+	 */
+	static Segment cut(const Segment& segment, double t0, double t1);
+
+private:
+
+	typedef util::point<PagePrecision> point_type;
+
+	// the samples a curve is fitted to, without duplicates
+	struct Samples {
+
+		std::vector<point_type>    positions;
+		std::vector<double>        pressures;
+		std::vector<unsigned long> indices;
+
+		// the squared maximal distance of a sample to the curve
+		double maxError2;
+	};
+
+	/**
+	 * Fit Bezier segments to the samples [first, last] (Schneider's
+	 * algorithm), given the tangents at the ends.
+	 */
+	void fit(
+			const Samples&    samples,
+			unsigned int      first,
+			unsigned int      last,
+			const point_type& tangent0,
+			const point_type& tangent1);
+
+	/**
+	 * Find the control points for the samples [first, last] with the given
+	 * parameters by least squares.
+	 */
+	void generate(
+			const Samples&             samples,
+			unsigned int               first,
+			unsigned int               last,
+			const std::vector<double>& u,
+			const point_type&          tangent0,
+			const point_type&          tangent1,
+			Segment&                   segment);
+
+	/**
+	 * Get the maximal squared distance of the samples to the segment, and the
+	 * sample where it is reached.
+	 */
+	double maxError(
+			const Samples&             samples,
+			unsigned int               first,
+			unsigned int               last,
+			const std::vector<double>& u,
+			const Segment&             segment,
+			unsigned int&              split);
+
+	/**
+	 * Improve the parameter u of sample i with a Newton-Raphson step.
+	 */
+	double reparameterize(const Segment& segment, const point_type& p, double u);
+
+	void addSegment(
+			const Samples& samples,
+			Segment&       segment,
+			unsigned int   first,
+			unsigned int   last);
+
+	segments_type _segments;
+};
+
+#endif // YANTA_STROKE_CURVE_H__
+
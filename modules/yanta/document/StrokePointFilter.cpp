@@ -0,0 +1,137 @@
+#include <cmath>
+
+#include "StrokePointFilter.h"
+
+namespace {
+
+inline double distance2(const StrokePoint& a, const StrokePoint& b) {
+
+	util::point<double> diff = a.position - b.position;
+
+	return diff.x*diff.x + diff.y*diff.y;
+}
+
+} // anonymous namespace
+
+StrokePointFilter::StrokePointFilter(double minDistance, unsigned long minInterval, double spacing) :
+	_minDistance2(minDistance*minDistance),
+	_minInterval(minInterval),
+	_spacing(spacing),
+	_lastKept(util::point<double>(0, 0), 0, 0),
+	_lastEmitted(util::point<double>(0, 0), 0, 0),
+	_sinceEmitted(0),
+	_held(util::point<double>(0, 0), 0, 0),
+	_haveHeld(false),
+	_extreme(util::point<double>(0, 0), 0, 0),
+	_haveExtreme(false),
+	_extremeIsHeld(false),
+	_numDropped(0) {}
+
+void
+StrokePointFilter::reset(const StrokePoint& first) {
+
+	_lastKept      = first;
+	_lastEmitted   = first;
+	_sinceEmitted  = 0;
+	_haveHeld      = false;
+	_haveExtreme   = false;
+	_extremeIsHeld = false;
+	_numDropped    = 0;
+}
+
+void
+StrokePointFilter::add(const StrokePoint& point, std::vector<StrokePoint>& accepted) {
+
+	bool close =
+			distance2(point, _lastKept) < _minDistance2 ||
+			point.timestamp - _lastKept.timestamp < _minInterval;
+
+	if (close) {
+
+		_held          = point;
+		_haveHeld      = true;
+		_extremeIsHeld = false;
+
+		double pressureChange = std::abs(point.pressure - _lastKept.pressure);
+
+		if (pressureChange > PressureTolerance &&
+		    (!_haveExtreme || pressureChange > std::abs(_extreme.pressure - _lastKept.pressure))) {
+
+			_extreme       = point;
+			_haveExtreme   = true;
+			_extremeIsHeld = true;
+		}
+
+		_numDropped++;
+
+		return;
+	}
+
+	// keep the strongest change in pressure of the dropped samples
+	if (_haveExtreme)
+		accept(_extreme, accepted);
+
+	accept(point, accepted);
+
+	_haveHeld    = false;
+	_haveExtreme = false;
+}
+
+void
+StrokePointFilter::finish(std::vector<StrokePoint>& accepted) {
+
+	if (_haveExtreme && !_extremeIsHeld)
+		accept(_extreme, accepted);
+
+	if (_haveHeld) {
+
+		accept(_held, accepted);
+		_numDropped--;
+	}
+
+	_haveHeld    = false;
+	_haveExtreme = false;
+
+	// the resampling might have stopped short of the last sample
+	if (_spacing > 0 && distance2(_lastEmitted, _lastKept) > 0) {
+
+		accepted.push_back(_lastKept);
+		_lastEmitted  = _lastKept;
+		_sinceEmitted = 0;
+	}
+}
+
+void
+StrokePointFilter::accept(const StrokePoint& point, std::vector<StrokePoint>& accepted) {
+
+	if (_spacing <= 0) {
+
+		accepted.push_back(point);
+		_lastKept    = point;
+		_lastEmitted = point;
+
+		return;
+	}
+
+	// place points every _spacing along the line from the last kept sample to 
+	// this one, continuing the spacing of the previous lines
+	double length = sqrt(distance2(point, _lastKept));
+
+	double pos = _spacing - _sinceEmitted;
+
+	for (; pos <= length; pos += _spacing) {
+
+		double a = pos/length;
+
+		StrokePoint resampled(
+				_lastKept.position + (point.position - _lastKept.position)*a,
+				(1 - a)*_lastKept.pressure + a*point.pressure,
+				_lastKept.timestamp + (unsigned long)(a*(point.timestamp - _lastKept.timestamp)));
+
+		accepted.push_back(resampled);
+		_lastEmitted = resampled;
+	}
+
+	_sinceEmitted = length - (pos - _spacing);
+	_lastKept     = point;
+}
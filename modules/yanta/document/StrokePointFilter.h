@@ -0,0 +1,91 @@
+#ifndef YANTA_STROKE_POINT_FILTER_H__
+#define YANTA_STROKE_POINT_FILTER_H__
+
+#include <vector>
+
+#include <util/point.hpp>
+#include "StrokePoint.h"
+
+/**
+ * Streaming filter for the samples of a stroke, before they get added to the
+ * document. Drops samples that are too close in space or time to the last
+ * kept one, unless they carry a considerable change in pressure. Optionally,
+ * the kept samples are resampled to a constant spacing. The first and the last
+ * sample of a stroke are always kept.
+ */
+class StrokePointFilter {
+
+public:
+
+	// the minimal change in pressure (of 2048) for which a close sample is kept
+	static const unsigned int PressureTolerance = 64;
+
+	/**
+	 * Create a new filter.
+	 *
+	 * @param minDistance
+	 *             Samples closer than this to the last kept one are dropped.
+	 * @param minInterval
+	 *             Samples less than this number of milliseconds after the last
+	 *             kept one are dropped.
+	 * @param spacing
+	 *             If non-zero, resample the kept samples to this spacing.
+	 */
+	StrokePointFilter(double minDistance = 0, unsigned long minInterval = 0, double spacing = 0);
+
+	/**
+	 * Start a new stroke with the given first point, which is not passed
+	 * through the filter.
+	 */
+	void reset(const StrokePoint& first);
+
+	/**
+	 * Filter the next sample. Appends the points to keep to accepted.
+	 */
+	void add(const StrokePoint& point, std::vector<StrokePoint>& accepted);
+
+	/**
+	 * End the current stroke. Appends the last sample to accepted, if it was
+	 * dropped so far.
+	 */
+	void finish(std::vector<StrokePoint>& accepted);
+
+	/**
+	 * Get the number of samples dropped since the last reset().
+	 */
+	unsigned long numDropped() const { return _numDropped; }
+
+private:
+
+	void accept(const StrokePoint& point, std::vector<StrokePoint>& accepted);
+
+	double        _minDistance2;
+	unsigned long _minInterval;
+	double        _spacing;
+
+	// the last sample that was kept
+	StrokePoint _lastKept;
+
+	// the last point that was passed on
+	StrokePoint _lastEmitted;
+
+	// for resampling, the length of the kept samples' polyline since the last
+	// emitted point
+	double _sinceEmitted;
+
+	// the most recent dropped sample
+	StrokePoint _held;
+	bool        _haveHeld;
+
+	// the dropped sample with the largest change in pressure since the last
+	// kept one, and whether it is the held sample as well (timestamps can
+	// repeat, so they can't tell)
+	StrokePoint _extreme;
+	bool        _haveExtreme;
+	bool        _extremeIsHeld;
+
+	unsigned long _numDropped;
+};
+
+#endif // YANTA_STROKE_POINT_FILTER_H__
+
@@ -2,6 +2,9 @@
 #define YANTA_STROKE_POINTS_H__
 
 #include <vector>
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/thread/shared_mutex.hpp>
 
 #include "StrokePoint.h"
@@ -10,45 +13,72 @@
  * Central collection of all stroke points in a document. Strokes are defined as 
  * begin and end indices into this collection plus an optional transformation.  
  * This way, two strokes can use the same stroke points.
+ *
+ * Stroke points can only be appended. They are stored in chunks of fixed size, 
+ * and a chunk that is full never changes again. Copies share the full chunks, 
+ * such that copying the stroke points of a document is cheap.
  */
 class StrokePoints {
 
-	typedef std::vector<StrokePoint> points_t;
+	// the number of stroke points per chunk is 2^ChunkBits
+	static const unsigned int  ChunkBits = 12;
+	static const unsigned long ChunkSize = 1 << ChunkBits;
+
+	typedef std::vector<StrokePoint>                 chunk_t;
+	typedef std::vector<boost::shared_ptr<chunk_t> > chunks_t;
 
 public:
 
-	StrokePoints() { init(); }
+	StrokePoints() : _size(0) { init(); }
 
-	StrokePoints(StrokePoints& other) { init(); copyFrom(other); }
+	StrokePoints(StrokePoints& other) : _size(0) { init(); copyFrom(other); }
 
 	StrokePoints& operator=(StrokePoints& other) { copyFrom(other); return *this; }
 
 	/**
 	 * Get the ith stroke point.
 	 */
-	inline StrokePoint& operator[](unsigned long i) { return _points[i]; }
-	inline const StrokePoint& operator[](unsigned long i) const { return _points[i]; }
+	inline const StrokePoint& operator[](unsigned long i) const { return (*_chunks[i >> ChunkBits])[i & (ChunkSize - 1)]; }
 
 	/**
 	 * Get the number of stroke points.
 	 */
-	inline unsigned long size() const { return _points.size(); }
+	inline unsigned long size() const { return _size; }
 
 	/**
-	 * Add a new stroke point. Will uniquely lock the mutex, if a reallocation 
-	 * is necessary. This method itself is not thread safe.
+	 * Add a new stroke point. Will uniquely lock the mutex, if the list of 
+	 * chunks needs to be reallocated. This method itself is not thread safe.
 	 */
 	inline void add(const StrokePoint& point) {
 
-		if (_points.size() + 1 <= _points.capacity())
+		if (_size == _chunks.size()*ChunkSize)
+			addChunk();
 
-			_points.push_back(point);
+		_chunks.back()->push_back(point);
+		_size++;
+	}
 
-		else {
+	/**
+	 * Add several stroke points at once.
+	 */
+	inline void add(const std::vector<StrokePoint>& points) {
 
-			boost::unique_lock<boost::shared_mutex> lock(_mutex);
+		std::vector<StrokePoint>::const_iterator i = points.begin();
+
+		while (i != points.end()) {
 
-			_points.push_back(point);
+			if (_size == _chunks.size()*ChunkSize)
+				addChunk();
+
+			chunk_t& chunk = *_chunks.back();
+
+			unsigned long n = std::min(
+					(unsigned long)(points.end() - i),
+					ChunkSize - chunk.size());
+
+			chunk.insert(chunk.end(), i, i + n);
+			_size += n;
+			i     += n;
 		}
 	}
 
@@ -63,7 +93,25 @@ private:
 	void init() {
 
 		// we will certainly need a lot of them
-		_points.reserve(10000);
+		_chunks.reserve(256);
+	}
+
+	void addChunk() {
+
+		// chunks never reallocate, the points stay where they are
+		boost::shared_ptr<chunk_t> chunk = boost::make_shared<chunk_t>();
+		chunk->reserve(ChunkSize);
+
+		if (_chunks.size() < _chunks.capacity())
+
+			_chunks.push_back(chunk);
+
+		else {
+
+			boost::unique_lock<boost::shared_mutex> lock(_mutex);
+
+			_chunks.push_back(chunk);
+		}
 	}
 
 	void copyFrom(StrokePoints& other) {
@@ -71,12 +119,24 @@ private:
 		boost::shared_lock<boost::shared_mutex> lockThem(other._mutex);
 		boost::unique_lock<boost::shared_mutex> lockMe(_mutex);
 
-		_points = other._points;
+		_chunks = other._chunks;
+		_size   = other._size;
+
+		// both of us will append to the last chunk, if it is not full yet -- 
+		// get our own copy of it
+		if (!_chunks.empty() && _chunks.back()->size() < ChunkSize) {
+
+			boost::shared_ptr<chunk_t> last = boost::make_shared<chunk_t>();
+			last->reserve(ChunkSize);
+			last->insert(last->end(), _chunks.back()->begin(), _chunks.back()->begin() + (_size & (ChunkSize - 1)));
+
+			_chunks.back() = last;
+		}
 	}
 
 	boost::shared_mutex _mutex;
-	points_t            _points;
-
+	chunks_t            _chunks;
+	unsigned long       _size;
 };
 
 #endif // YANTA_STROKE_POINTS_H__
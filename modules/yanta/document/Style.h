@@ -34,6 +34,18 @@ public:
 	inline unsigned char getBlue()  const { return _blue; }
 	inline unsigned char getAlpha() const { return _alpha; }
 
+	inline bool operator==(const Style& other) const {
+
+		return
+				_width == other._width &&
+				_red   == other._red   &&
+				_green == other._green &&
+				_blue  == other._blue  &&
+				_alpha == other._alpha;
+	}
+
+	inline bool operator!=(const Style& other) const { return !(*this == other); }
+
 private:
 
 	double _width;
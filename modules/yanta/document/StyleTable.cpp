@@ -0,0 +1,74 @@
+#include <map>
+
+#include <boost/thread/mutex.hpp>
+
+#include <util/Logger.h>
+#include "StyleTable.h"
+
+logger::LogChannel styletablelog("styletablelog", "[StyleTable] ");
+
+namespace {
+
+// strict weak ordering to find styles in the table
+struct StyleOrder {
+
+	bool operator()(const Style& a, const Style& b) const {
+
+		if (a.width() != b.width())
+			return a.width() < b.width();
+		if (a.getRed() != b.getRed())
+			return a.getRed() < b.getRed();
+		if (a.getGreen() != b.getGreen())
+			return a.getGreen() < b.getGreen();
+		if (a.getBlue() != b.getBlue())
+			return a.getBlue() < b.getBlue();
+
+		return a.getAlpha() < b.getAlpha();
+	}
+};
+
+// the first chunk, holding the default style at index 0
+Style firstChunk[StyleTable::ChunkSize];
+
+} // anonymous namespace
+
+Style* StyleTable::_chunks[NumChunks] = { firstChunk };
+
+unsigned short
+StyleTable::intern(const Style& style) {
+
+	static boost::mutex                              mutex;
+	static std::map<Style, unsigned int, StyleOrder> indices;
+	static unsigned int                              size = 1;
+
+	boost::mutex::scoped_lock lock(mutex);
+
+	if (style == Style())
+		return 0;
+
+	std::map<Style, unsigned int, StyleOrder>::const_iterator i = indices.find(style);
+
+	if (i != indices.end())
+		return i->second;
+
+	// strokes can't refer to more styles, and drawing them in another style 
+	// would silently change the document
+	if (size == ChunkSize*NumChunks)
+		UTIL_THROW_EXCEPTION(
+				TooManyStylesError,
+				"all " << size << " style indices are in use, can't add a style with width " << style.width());
+
+	unsigned int index = size;
+
+	if (!_chunks[index >> ChunkBits])
+		_chunks[index >> ChunkBits] = new Style[ChunkSize];
+
+	_chunks[index >> ChunkBits][index & (ChunkSize - 1)] = style;
+	indices[style] = index;
+	size++;
+
+	LOG_DEBUG(styletablelog) << "added style " << index << " with width " << style.width() << std::endl;
+
+	return index;
+}
+
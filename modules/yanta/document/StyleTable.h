@@ -0,0 +1,49 @@
+#ifndef YANTA_STYLE_TABLE_H__
+#define YANTA_STYLE_TABLE_H__
+
+#include <util/exceptions.h>
+
+#include "Style.h"
+
+/**
+ * Thrown by StyleTable::intern(), if the table is full.
+ */
+struct TooManyStylesError : virtual Exception {};
+
+/**
+ * Process-wide table of all styles in use. Strokes refer to their style by a
+ * small index into this table, since most strokes share one of a handful of
+ * styles. Styles are only ever added, such that an index stays valid, and
+ * reading a style does not need a lock.
+ */
+class StyleTable {
+
+public:
+
+	// the styles are stored in chunks of 2^ChunkBits, which never move
+	static const unsigned int ChunkBits = 8;
+	static const unsigned int ChunkSize = 1 << ChunkBits;
+	static const unsigned int NumChunks = 256;
+
+	/**
+	 * Get the index of the given style. The style is added to the table, if it
+	 * is not in there already. Index 0 is always the default style. Throws a 
+	 * TooManyStylesError, if the style is new and all indices are in use.
+	 */
+	static unsigned short intern(const Style& style);
+
+	/**
+	 * Get the style with the given index.
+	 */
+	static inline const Style& get(unsigned short index) {
+
+		return _chunks[index >> ChunkBits][index & (ChunkSize - 1)];
+	}
+
+private:
+
+	static Style* _chunks[NumChunks];
+};
+
+#endif // YANTA_STYLE_TABLE_H__
+
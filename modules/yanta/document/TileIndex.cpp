@@ -0,0 +1,229 @@
+#include <cmath>
+#include <algorithm>
+#include "TileIndex.h"
+
+namespace {
+
+struct EntryOrder {
+
+	bool operator()(const TileIndex::Entry& a, const TileIndex::Entry& b) const {
+
+		return a.stroke < b.stroke || (a.stroke == b.stroke && a.begin < b.begin);
+	}
+};
+
+} // anonymous namespace
+
+TileIndex::TileIndex() :
+	_tileSize(0, 0) {}
+
+TileIndex::TileIndex(const TileIndex& other) {
+
+	copyFrom(other);
+}
+
+TileIndex&
+TileIndex::operator=(const TileIndex& other) {
+
+	if (&other != this)
+		copyFrom(other);
+
+	return *this;
+}
+
+void
+TileIndex::setTileSize(const util::point<DocumentPrecision>& tileSize) {
+
+	boost::unique_lock<boost::shared_mutex> lock(_mutex);
+
+	_tileSize = tileSize;
+	_tiles.clear();
+}
+
+void
+TileIndex::clear() {
+
+	boost::unique_lock<boost::shared_mutex> lock(_mutex);
+
+	_tiles.clear();
+}
+
+void
+TileIndex::addSegment(unsigned int stroke, unsigned long i, const util::rect<DocumentPrecision>& area) {
+
+	if (!enabled())
+		return;
+
+	util::rect<int> tiles = getTiles(area);
+
+	boost::unique_lock<boost::shared_mutex> lock(_mutex);
+
+	for (int x = tiles.minX; x < tiles.maxX; x++)
+		for (int y = tiles.minY; y < tiles.maxY; y++) {
+
+			entries_type& entries = _tiles[std::make_pair(x, y)];
+
+			// extend the last range, if this segment continues it
+			if (!entries.empty() && entries.back().stroke == stroke && entries.back().end == i + 1)
+				entries.back().end = i + 2;
+			else
+				entries.push_back(Entry(stroke, i, i + 2));
+		}
+}
+
+void
+TileIndex::removeStroke(unsigned int stroke, const util::rect<DocumentPrecision>& area) {
+
+	if (!enabled())
+		return;
+
+	util::rect<int> tiles = getTiles(area);
+
+	boost::unique_lock<boost::shared_mutex> lock(_mutex);
+
+	for (int x = tiles.minX; x < tiles.maxX; x++)
+		for (int y = tiles.minY; y < tiles.maxY; y++) {
+
+			tiles_type::iterator i = _tiles.find(std::make_pair(x, y));
+
+			if (i == _tiles.end())
+				continue;
+
+			entries_type& entries = i->second;
+
+			unsigned int kept = 0;
+			for (unsigned int j = 0; j < entries.size(); j++)
+				if (entries[j].stroke != stroke)
+					entries[kept++] = entries[j];
+
+			entries.resize(kept, Entry(0, 0, 0));
+
+			if (entries.empty())
+				_tiles.erase(i);
+		}
+}
+
+void
+TileIndex::renumberStrokes(const std::vector<int>& indices) {
+
+	boost::unique_lock<boost::shared_mutex> lock(_mutex);
+
+	tiles_type::iterator i = _tiles.begin();
+
+	while (i != _tiles.end()) {
+
+		entries_type& entries = i->second;
+
+		unsigned int kept = 0;
+		for (unsigned int j = 0; j < entries.size(); j++) {
+
+			int stroke = indices[entries[j].stroke];
+
+			if (stroke < 0)
+				continue;
+
+			entries[kept] = entries[j];
+			entries[kept].stroke = stroke;
+			kept++;
+		}
+
+		entries.resize(kept, Entry(0, 0, 0));
+
+		if (entries.empty())
+			_tiles.erase(i++);
+		else
+			++i;
+	}
+}
+
+void
+TileIndex::getEntries(const util::rect<DocumentPrecision>& area, entries_type& entries) const {
+
+	entries.clear();
+
+	if (!enabled())
+		return;
+
+	util::rect<int> tiles = getTiles(area);
+
+	{
+		boost::shared_lock<boost::shared_mutex> lock(_mutex);
+
+		for (int x = tiles.minX; x < tiles.maxX; x++)
+			for (int y = tiles.minY; y < tiles.maxY; y++) {
+
+				tiles_type::const_iterator i = _tiles.find(std::make_pair(x, y));
+
+				if (i != _tiles.end())
+					entries.insert(entries.end(), i->second.begin(), i->second.end());
+			}
+	}
+
+	std::sort(entries.begin(), entries.end(), EntryOrder());
+
+	// a segment crossing a tile border is listed in both tiles
+	unsigned int merged = 0;
+	for (unsigned int i = 0; i < entries.size(); i++) {
+
+		if (merged > 0 && entries[merged - 1].stroke == entries[i].stroke && entries[i].begin < entries[merged - 1].end) {
+
+			entries[merged - 1].end = std::max(entries[merged - 1].end, entries[i].end);
+			continue;
+		}
+
+		entries[merged++] = entries[i];
+	}
+
+	entries.resize(merged, Entry(0, 0, 0));
+}
+
+void
+TileIndex::getStrokes(const util::rect<DocumentPrecision>& area, std::vector<unsigned int>& strokes) const {
+
+	strokes.clear();
+
+	if (!enabled())
+		return;
+
+	util::rect<int> tiles = getTiles(area);
+
+	boost::shared_lock<boost::shared_mutex> lock(_mutex);
+
+	for (int x = tiles.minX; x < tiles.maxX; x++)
+		for (int y = tiles.minY; y < tiles.maxY; y++) {
+
+			tiles_type::const_iterator i = _tiles.find(std::make_pair(x, y));
+
+			if (i == _tiles.end())
+				continue;
+
+			for (unsigned int j = 0; j < i->second.size(); j++)
+				strokes.push_back(i->second[j].stroke);
+		}
+
+	std::sort(strokes.begin(), strokes.end());
+	strokes.erase(std::unique(strokes.begin(), strokes.end()), strokes.end());
+}
+
+util::rect<int>
+TileIndex::getTiles(const util::rect<DocumentPrecision>& area) const {
+
+	// add a small margin to account for anti-aliasing at the tile borders
+	util::point<DocumentPrecision> margin = _tileSize/64.0;
+
+	return util::rect<int>(
+			(int)std::floor((area.minX - margin.x)/_tileSize.x),
+			(int)std::floor((area.minY - margin.y)/_tileSize.y),
+			(int)std::floor((area.maxX + margin.x)/_tileSize.x) + 1,
+			(int)std::floor((area.maxY + margin.y)/_tileSize.y) + 1);
+}
+
+void
+TileIndex::copyFrom(const TileIndex& other) {
+
+	boost::shared_lock<boost::shared_mutex> lockThem(other._mutex);
+	boost::unique_lock<boost::shared_mutex> lockMe(_mutex);
+
+	_tiles    = other._tiles;
+	_tileSize = other._tileSize;
+}
@@ -0,0 +1,128 @@
+#ifndef YANTA_TILE_INDEX_H__
+#define YANTA_TILE_INDEX_H__
+
+#include <map>
+#include <vector>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <util/point.hpp>
+#include <util/rect.hpp>
+
+#include "Precision.h"
+
+/**
+ * Auxiliary map from tiles (squares of a fixed size in document units) to the
+ * stroke segments overlapping them. The content of an area can be found
+ * without testing every stroke of a page. The tile size does not depend on
+ * the scale the document is shown at, such that zooming never requires to
+ * rebuild the index.
+ *
+ * Each page keeps one of these for its strokes. The index is filled
+ * incrementally as strokes are created, extended, erased, or added.
+ */
+class TileIndex {
+
+public:
+
+	/**
+	 * A range of consecutive stroke points of a single stroke, whose segments
+	 * overlap a tile.
+	 */
+	struct Entry {
+
+		Entry(unsigned int stroke_, unsigned long begin_, unsigned long end_) :
+			stroke(stroke_),
+			begin(begin_),
+			end(end_) {}
+
+		// the index of the stroke in its page
+		unsigned int stroke;
+
+		// the first stroke point of the range
+		unsigned long begin;
+
+		// one beyond the last stroke point of the range
+		unsigned long end;
+	};
+
+	typedef std::vector<Entry> entries_type;
+
+	TileIndex();
+
+	TileIndex(const TileIndex& other);
+
+	TileIndex& operator=(const TileIndex& other);
+
+	/**
+	 * Set the size of the tiles in document units. This clears the index. A
+	 * size of zero disables the index.
+	 */
+	void setTileSize(const util::point<DocumentPrecision>& tileSize);
+
+	/**
+	 * Get the size of the tiles in document units.
+	 */
+	inline const util::point<DocumentPrecision>& getTileSize() const { return _tileSize; }
+
+	/**
+	 * Check whether this index is in use, i.e., whether a tile size was set.
+	 */
+	inline bool enabled() const { return _tileSize.x > 0 && _tileSize.y > 0; }
+
+	/**
+	 * Remove all entries.
+	 */
+	void clear();
+
+	/**
+	 * Add the segment between the stroke points i and i+1 of the given stroke
+	 * to all tiles that intersect area (in document units).
+	 */
+	void addSegment(unsigned int stroke, unsigned long i, const util::rect<DocumentPrecision>& area);
+
+	/**
+	 * Remove all entries of the given stroke from the tiles that intersect
+	 * area (in document units). Area should cover the stroke completely.
+	 */
+	void removeStroke(unsigned int stroke, const util::rect<DocumentPrecision>& area);
+
+	/**
+	 * Change the stroke indices of all entries. Entries of stroke i are 
+	 * changed to stroke indices[i], or removed if indices[i] is negative.
+	 */
+	void renumberStrokes(const std::vector<int>& indices);
+
+	/**
+	 * Get the entries of all tiles that intersect area (in document units), 
+	 * ordered by stroke and first point. Overlapping ranges of the same stroke 
+	 * are merged, such that no segment is listed twice.
+	 */
+	void getEntries(const util::rect<DocumentPrecision>& area, entries_type& entries) const;
+
+	/**
+	 * Get the indices of all strokes with segments in the tiles that intersect 
+	 * area (in document units), in ascending order.
+	 */
+	void getStrokes(const util::rect<DocumentPrecision>& area, std::vector<unsigned int>& strokes) const;
+
+private:
+
+	typedef std::map<std::pair<int, int>, entries_type> tiles_type;
+
+	/**
+	 * Get all tiles intersecting the given area in document units.
+	 */
+	util::rect<int> getTiles(const util::rect<DocumentPrecision>& area) const;
+
+	void copyFrom(const TileIndex& other);
+
+	tiles_type _tiles;
+
+	util::point<DocumentPrecision> _tileSize;
+
+	// protects _tiles for readers in other threads
+	mutable boost::shared_mutex _mutex;
+};
+
+#endif // YANTA_TILE_INDEX_H__
+
@@ -9,6 +9,8 @@
 #include <util/Logger.h>
 #include <util/ProgramOptions.h>
 #include "BackendPainter.h"
+#include "PreviewPyramid.h"
+#include "TilesCache.h"
 #include "TorusTexture.h"
 
 logger::LogChannel backendpainterlog("backendpainterlog", "[BackendPainter] ");
@@ -28,13 +30,32 @@ util::ProgramOption optionScaleGridSize(
 	util::_description_text = "The amount of zooming between two scale points.",
 	util::_default_value    = 1.0/1.5);
 
+util::ProgramOption optionWetInk(
+	util::_long_name        = "wetInk",
+	util::_description_text = "Draw the current stroke directly on the screen and add it to the tiles only when it is finished.",
+	util::_default_value    = true);
+
+util::ProgramOption optionPenPrediction(
+	util::_long_name        = "penPrediction",
+	util::_description_text = "The number of milliseconds to extrapolate the current stroke ahead of the last pen sample. Set this value to about the time between two frames to hide the latency of the display.",
+	util::_default_value    = 16);
+
+util::ProgramOption optionMaxTileCacheMemory(
+	util::_long_name        = "maxTileCacheMemory",
+	util::_description_text = "The amount of memory in MB to use for caching the tiles of recently used scale points. Each scale point needs 256MB and its own drawing thread. At least the current scale point is always cached.",
+	util::_default_value    = 512);
+
 BackendPainter::BackendPainter() :
 	_mode(IncrementalDrawing),
+	_showCursor(false),
 	_snapToScaleGrid(optionSnapToScaleGrid.as<bool>()),
 	_logScaleGridSize(log(optionScaleGridSize)),
+	_wetInk(optionWetInk.as<bool>()),
+	_penPrediction(optionPenPrediction.as<double>()),
 	_documentChanged(true),
 	_documentPainter(gui::skia_pixel_t(255, 255, 255)),
-	_documentCleanUpPainter(boost::make_shared<SkiaDocumentPainter>(gui::skia_pixel_t(255, 255, 255))),
+	_pageRasterCache(boost::make_shared<PageRasterCache>()),
+	_previewPainter(boost::make_shared<SkiaDocumentPainter>(gui::skia_pixel_t(255, 255, 255))),
 	_overlayAlpha(1.0),
 	_shift(0, 0),
 	_defaultScale(optionDpi.as<double>()*0.0393701, optionDpi.as<double>()*0.0393701), // pixel per millimeter
@@ -44,10 +65,26 @@ BackendPainter::BackendPainter() :
 	_previousShift(0, 0),
 	_previousScale(0, 0),
 	_previousPixelRoi(0, 0, 0, 0),
+	_viewState(_defaultScale),
 	_cursorPosition(0, 0) {
 
+	// the memory needed by a tiles cache in MB
+	int cacheSize =
+			TilesCache::Width*TilesCache::Height*
+			TilesCache::TileSize*TilesCache::TileSize*
+			sizeof(gui::skia_pixel_t)/(1024*1024);
+
+	_maxScaleLevels = std::max(1, optionMaxTileCacheMemory.as<int>()/cacheSize);
+
+	LOG_DEBUG(backendpainterlog) << "keeping tiles for up to " << _maxScaleLevels << " scale levels" << std::endl;
+
+	_documentPainter.setPageRasterCache(_pageRasterCache);
+	_previewPainter->setPageRasterCache(_pageRasterCache);
+
+	_documentPainter.setOmitOpenStroke(_wetInk);
+	_previewPainter->setOmitOpenStroke(_wetInk);
+
 	setDeviceTransformation();
-	_documentPainter.setIncremental(true);
 }
 
 bool
@@ -55,14 +92,37 @@ BackendPainter::draw(
 		const util::rect<double>&  roi,
 		const util::point<double>& resolution) {
 
-	if (!_documentPainter.hasDocument()) {
+	if (!_document) {
 
 		LOG_DEBUG(backendpainterlog) << "no document to paint (yet)" << std::endl;
 		return false;
 	}
 
+	std::vector<PendingChange> changes;
+
+	{
+		boost::lock_guard<boost::mutex> lock(_pendingChangesMutex);
+		std::swap(changes, _pendingChanges);
+	}
+
+	// The input thread sends the notifications while it changes the document, 
+	// a snapshot taken after them contains all the changes they report. The 
+	// painters draw from the snapshot, such that the input thread never has 
+	// to wait for them.
+	if (!_snapshot || _documentChanged || !changes.empty())
+		takeSnapshot();
+
 	LOG_ALL(backendpainterlog) << "redrawing in " << roi << " with resolution " << resolution << std::endl;
 
+	// get the transformation the user asked for since the last draw()
+	if (takeViewState())
+		processFinishedZoom();
+
+	// while the user is still zooming, start drawing the scale we will 
+	// probably end up with
+	if (_mode == Zooming)
+		prepareScaleLevel();
+
 	// the smallest integer pixel roi fitting the desired roi
 	util::rect<int> pixelRoi;
 	pixelRoi.minX = (int)floor(roi.minX);
@@ -82,10 +142,16 @@ BackendPainter::draw(
 
 		LOG_DEBUG(backendpainterlog) << "rebuild texture or document changed entirely -- initiate full redraw" << std::endl;
 
+		// the caches of the other scale levels show another document
+		if (_documentChanged && !_scaleLevels.empty())
+			_scaleLevels.erase(++_scaleLevels.begin(), _scaleLevels.end());
+
 		initiateFullRedraw(pixelRoi);
 		_documentChanged = false;
 	}
 
+	processPendingChanges(changes);
+
 	if (_mode == IncrementalDrawing) {
 
 		// scale changed while we are in drawing mode -- texture needs to be 
@@ -125,6 +191,15 @@ BackendPainter::draw(
 		}
 	}
 
+	// keep the preview of the surroundings up-to-date for the next zoom
+	if (_mode != Zooming && _previewPyramid->needsUpdate(pixelRoi.center(), _scale))
+		_previewPyramid->update(pixelRoi.center(), _scale);
+
+	// content changes are drawn into the preview only once a zoom starts, not 
+	// continuously while the user is writing
+	if (_mode == Zooming)
+		_previewPyramid->updateDirty();
+
 	// draw the document and its overlay
 	drawTextures(pixelRoi);
 
@@ -147,13 +222,158 @@ BackendPainter::draw(
 void
 BackendPainter::contentAdded(const util::rect<DocumentPrecision>& region) {
 
+	boost::lock_guard<boost::mutex> lock(_pendingChangesMutex);
+	_pendingChanges.push_back(PendingChange(PendingChange::ContentAdded, region));
+}
+
+void
+BackendPainter::strokePointAdded(const StrokePointAdded& signal) {
+
+	OpenStroke stroke;
+	stroke.begin = signal.begin;
+	stroke.end   = signal.end;
+	stroke.style = signal.style;
+	stroke.shift = signal.shift;
+
+	boost::lock_guard<boost::mutex> lock(_pendingChangesMutex);
+	_pendingChanges.push_back(PendingChange(PendingChange::StrokePointAdded, signal.area, stroke));
+}
+
+void
+BackendPainter::strokeFinished(const util::rect<DocumentPrecision>& region) {
+
+	boost::lock_guard<boost::mutex> lock(_pendingChangesMutex);
+	_pendingChanges.push_back(PendingChange(PendingChange::StrokeFinished, region));
+}
+
+void
+BackendPainter::markDirty(const util::rect<DocumentPrecision>& area) {
+
+	boost::lock_guard<boost::mutex> lock(_pendingChangesMutex);
+	_pendingChanges.push_back(PendingChange(PendingChange::Dirty, area));
+}
+
+void
+BackendPainter::markOverlayDirty(const util::rect<DocumentPrecision>& area) {
+
+	boost::lock_guard<boost::mutex> lock(_pendingChangesMutex);
+	_pendingChanges.push_back(PendingChange(PendingChange::OverlayDirty, area));
+}
+
+void
+BackendPainter::takeSnapshot() {
+
+	_snapshot = _document->snapshot();
+
+	_documentPainter.setDocument(_snapshot);
+	_overlayPainter.setDocument(_snapshot);
+	for (scale_levels_type::iterator i = _scaleLevels.begin(); i != _scaleLevels.end(); i++)
+		i->painter->setDocument(_snapshot);
+	_previewPainter->setDocument(_snapshot);
+	_pageRasterCache->setSnapshot(_snapshot);
+}
+
+void
+BackendPainter::processPendingChanges(const std::vector<PendingChange>& changes) {
+
+	for (unsigned int i = 0; i < changes.size(); i++) {
+
+		switch (changes[i].type) {
+
+			case PendingChange::ContentAdded:
+				processContentAdded(changes[i].area);
+				break;
+
+			case PendingChange::StrokePointAdded:
+				_openStroke = changes[i].stroke;
+				processStrokePointAdded(changes[i].area);
+				break;
+
+			case PendingChange::StrokeFinished:
+				_openStroke = OpenStroke();
+				// without wet ink, the tiles show the open stroke from its 
+				// points already, redraw it from its curve
+				if (_wetInk)
+					processContentAdded(changes[i].area);
+				else
+					processDirty(changes[i].area);
+				break;
+
+			case PendingChange::Dirty:
+				processDirty(changes[i].area);
+				break;
+
+			case PendingChange::OverlayDirty:
+				processOverlayDirty(changes[i].area);
+				break;
+
+			case PendingChange::Refresh:
+				initiateFullRedraw(_previousPixelRoi);
+				break;
+		}
+	}
+}
+
+void
+BackendPainter::processContentAdded(const util::rect<DocumentPrecision>& region) {
+
 	// get the pixels that are affected
 	util::rect<int> pixelRegion = documentToTexture(region);
 
+	// add a border of one pixel to compensate for rounding artefacts (the 
+	// update will be clipped to this region)
+	pixelRegion.minX -= 1;
+	pixelRegion.minY -= 1;
+	pixelRegion.maxX += 1;
+	pixelRegion.maxY += 1;
+
 	// mark the corresponding part of the texture as needs-update
 	_documentTexture->markDirty(pixelRegion, TorusTexture::NeedsUpdate);
+	_previewPyramid->markDirty(region);
+
+	// the caches of the other scale levels have to catch up as well
+	if (!_scaleLevels.empty())
+		for (scale_levels_type::iterator i = ++_scaleLevels.begin(); i != _scaleLevels.end(); i++) {
+
+			util::rect<double> levelRegion = region;
+			levelRegion *= i->scale;
+
+			util::rect<int> levelPixelRegion = levelRegion;
+			levelPixelRegion.minX -= 1;
+			levelPixelRegion.minY -= 1;
+			levelPixelRegion.maxX += 1;
+			levelPixelRegion.maxY += 1;
+
+			i->cache->markDirty(levelPixelRegion, TilesCache::NeedsUpdate);
+		}
+
+	stopDragging();
+}
+
+void
+BackendPainter::processStrokePointAdded(const util::rect<DocumentPrecision>& region) {
+
+	if (!_wetInk) {
+
+		processContentAdded(region);
+		return;
+	}
+
+	// nothing to do for the textures, the stroke will be drawn on top of them
+	stopDragging();
+}
+
+void
+BackendPainter::stopDragging() {
+
+	if (_mode != Dragging)
+		return;
 
 	_mode = IncrementalDrawing;
+
+	boost::lock_guard<boost::mutex> lock(_viewStateMutex);
+	if (_viewState.mode == Dragging)
+		_viewState.mode = IncrementalDrawing;
 }
 
 void
@@ -164,9 +384,10 @@ BackendPainter::drag(const util::point<DocumentPrecision>& direction) {
 	d.x = (int)round(direction.x);
 	d.y = (int)round(direction.y);
 
-	_shift += d;
+	boost::lock_guard<boost::mutex> lock(_viewStateMutex);
 
-	_mode = Dragging;
+	_viewState.shift += d;
+	_viewState.mode   = Dragging;
 }
 
 void
@@ -174,40 +395,106 @@ BackendPainter::zoom(double zoomChange, const util::point<DocumentPrecision>& an
 
 	LOG_ALL(backendpainterlog) << "changing zoom by " << zoomChange << " keeping " << anchor << " where it is" << std::endl;
 
+	boost::lock_guard<boost::mutex> lock(_viewStateMutex);
+
+	zoomViewState(_viewState, zoomChange, anchor);
+}
+
+void
+BackendPainter::finishZoom(const util::point<DocumentPrecision>& anchor) {
+
+	boost::lock_guard<boost::mutex> lock(_viewStateMutex);
+
+	if (_snapToScaleGrid) {
+
+		util::point<DocumentPrecision> gridScale = snapScaleToGrid(_viewState.scale);
+
+		// zoom to grid scale while keeping anchor where it is
+		zoomViewState(_viewState, gridScale.x/_viewState.scale.x, anchor);
+
+		// prevent scale shifts due to numerical limits
+		_viewState.scale = gridScale;
+	}
+
+	// the textures follow in the next draw()
+	_viewState.zoomFinished = true;
+	_viewState.mode         = IncrementalDrawing;
+}
+
+void
+BackendPainter::zoomViewState(ViewState& state, double zoomChange, const util::point<DocumentPrecision>& anchor) {
+
 	// convert the anchor from screen coordinates to texture coordinates
-	_zoomAnchor = anchor - _shift;
+	state.zoomAnchor = anchor - state.shift;
 
-	if (_mode != Zooming)
-		_scaleChange = util::point<double>(1.0, 1.0);
+	// if the last zoom was not drawn yet, this one just continues it
+	if (state.mode != Zooming && !state.zoomFinished)
+		state.scaleChange = util::point<double>(1.0, 1.0);
 
-	_scaleChange *= zoomChange;
-	_scale       *= zoomChange;
-	_shift        = _shift + (1 - zoomChange)*_zoomAnchor;
+	state.scaleChange *= zoomChange;
+	state.scale       *= zoomChange;
+	state.shift        = state.shift + (1 - zoomChange)*state.zoomAnchor;
 
 	// don't change the document painter transformations -- we simulate the zoom 
 	// by stretching the texture (and repaint when we leave the zoom mode)
 
-	_mode = Zooming;
+	state.mode = Zooming;
+}
+
+bool
+BackendPainter::takeViewState() {
+
+	boost::lock_guard<boost::mutex> lock(_viewStateMutex);
+
+	// a zoom that was finished and started again before we could draw is 
+	// still going on
+	bool zoomFinished = _viewState.zoomFinished && _viewState.mode != Zooming;
+	_viewState.zoomFinished = false;
+
+	_mode           = _viewState.mode;
+	_shift          = _viewState.shift;
+	_scale          = _viewState.scale;
+	_scaleChange    = _viewState.scaleChange;
+	_zoomAnchor     = _viewState.zoomAnchor;
+	_cursorPosition = _viewState.cursorPosition;
+	_showCursor     = _viewState.showCursor;
+
+	return zoomFinished;
 }
 
 void
-BackendPainter::finishZoom(const util::point<DocumentPrecision>& anchor) {
+BackendPainter::processFinishedZoom() {
 
-	if (_snapToScaleGrid) {
+	if (cacheScaleLevels() && _documentTexture) {
 
-		util::point<DocumentPrecision> gridScale = snapScaleToGrid(_scale);
+		util::point<int> center = _previousPixelRoi.center();
+		util::point<int> centerTile(
+				(int)floor((double)center.x/TilesCache::TileSize),
+				(int)floor((double)center.y/TilesCache::TileSize));
 
-		// zoom to grid scale while keeping anchor where it is
-		zoom(gridScale.x/_scale.x, anchor);
+		// switch to the cache of the new scale, which might contain some (or 
+		// all) of the tiles already
+		ScaleLevel& level = getScaleLevel(getGridLevel(_scale), centerTile, true);
 
-		// prevent scale shifts due to numerical limits
-		_scale = gridScale;
+		setDeviceTransformation();
+
+		_documentTexture->rescale(center, _scaleChange, _previousPixelRoi, level.cache);
+
+	} else {
+
+		setDeviceTransformation();
+
+		// redraw everything, but show the stretched previous content until the 
+		// new tiles are ready
+		if (_documentTexture)
+			_documentTexture->rescale(_previousPixelRoi.center(), _scaleChange, _previousPixelRoi);
 	}
 
-	setDeviceTransformation();
-	initiateFullRedraw(_previousPixelRoi);
+	if (_overlayTexture)
+		_overlayTexture->reset(_previousPixelRoi.center());
 
-	_mode = IncrementalDrawing;
+	// the scale change is handled already
+	_previousScale = _scale;
 }
 
 util::point<DocumentPrecision>
@@ -233,13 +520,118 @@ BackendPainter::snapScaleToGrid(const util::point<DocumentPrecision>& requestedS
 	return scale;
 }
 
+int
+BackendPainter::getGridLevel(const util::point<DocumentPrecision>& scale) {
+
+	return (int)round(log(scale.x/_defaultScale.x)/_logScaleGridSize);
+}
+
+util::point<DocumentPrecision>
+BackendPainter::getGridScale(int level) {
+
+	return util::point<DocumentPrecision>(
+			exp(level*_logScaleGridSize)*_defaultScale.x,
+			exp(level*_logScaleGridSize)*_defaultScale.y);
+}
+
+BackendPainter::ScaleLevel&
+BackendPainter::getScaleLevel(int level, const util::point<int>& centerTile, bool activate) {
+
+	// the position of the level in the LRU list
+	scale_levels_type::iterator position = _scaleLevels.begin();
+	if (!activate && position != _scaleLevels.end())
+		position++;
+
+	scale_levels_type::iterator i = _scaleLevels.begin();
+	for (; i != _scaleLevels.end(); i++)
+		if (i->level == level)
+			break;
+
+	if (i != _scaleLevels.end()) {
+
+		LOG_DEBUG(backendpainterlog) << "found cached scale level " << level << std::endl;
+
+		// the texture will recenter the cache when it gets activated
+		if (!activate)
+			i->cache->recenter(centerTile);
+
+		_scaleLevels.splice(position, _scaleLevels, i);
+
+		return *i;
+	}
+
+	if (_scaleLevels.size() < _maxScaleLevels) {
+
+		LOG_DEBUG(backendpainterlog) << "creating cache for scale level " << level << std::endl;
+
+		ScaleLevel newLevel;
+		newLevel.painter = boost::make_shared<SkiaDocumentPainter>(gui::skia_pixel_t(255, 255, 255));
+		newLevel.painter->setPageRasterCache(_pageRasterCache);
+		newLevel.painter->setOmitOpenStroke(_wetInk);
+		newLevel.cache   = boost::make_shared<TilesCache>();
+		newLevel.cache->setBackgroundRasterizer(newLevel.painter);
+
+		i = _scaleLevels.insert(position, newLevel);
+
+	} else {
+
+		LOG_DEBUG(backendpainterlog) << "reusing cache of scale level " << _scaleLevels.back().level << " for scale level " << level << std::endl;
+
+		i = --_scaleLevels.end();
+		_scaleLevels.splice(position, _scaleLevels, i);
+	}
+
+	i->level = level;
+	i->scale = (activate ? _scale : getGridScale(level));
+
+	{
+		// a reused level's background thread might still be drawing with the 
+		// painter, wait for it before retargeting
+		TilesCache::BackgroundRasterizerLock lock(*i->cache);
+
+		if (_snapshot)
+			i->painter->setDocument(_snapshot);
+		i->painter->setDeviceTransformation(i->scale, util::point<int>(0, 0));
+		i->cache->reset(centerTile);
+	}
+
+	return *i;
+}
+
+void
+BackendPainter::prepareScaleLevel() {
+
+	if (!cacheScaleLevels() || _scaleLevels.empty())
+		return;
+
+	int level = getGridLevel(_scale);
+
+	if (level == _scaleLevels.front().level)
+		return;
+
+	// the center of the current view at the scale of the level
+	util::point<double> center = _previousPixelRoi.center();
+	center /= _scale;
+	center *= getGridScale(level);
+
+	util::point<int> centerTile(
+			(int)floor(center.x/TilesCache::TileSize),
+			(int)floor(center.y/TilesCache::TileSize));
+
+	getScaleLevel(level, centerTile, false);
+}
+
 util::point<DocumentPrecision>
 BackendPainter::screenToDocument(const util::point<double>& point) {
 
 	util::point<DocumentPrecision> inv = point;
 
-	inv -= _shift;
-	inv /= _scale;
+	// input handlers see the view as the user requested it, even if it was 
+	// not drawn yet
+	boost::lock_guard<boost::mutex> lock(_viewStateMutex);
+
+	inv -= _viewState.shift;
+	inv /= _viewState.scale;
 
 	return inv;
 }
@@ -269,11 +661,12 @@ BackendPainter::refresh() {
 
 	LOG_DEBUG(backendpainterlog) << "refresh requested" << std::endl;
 
-	initiateFullRedraw(_previousPixelRoi);
+	boost::lock_guard<boost::mutex> lock(_pendingChangesMutex);
+	_pendingChanges.push_back(PendingChange(PendingChange::Refresh, util::rect<DocumentPrecision>(0, 0, 0, 0)));
 }
 
 void
-BackendPainter::markDirty(const util::rect<DocumentPrecision>& area) {
+BackendPainter::processDirty(const util::rect<DocumentPrecision>& area) {
 
 	// area is in document units -- transform it to pixel units
 	util::point<int> ul = documentToTexture(area.upperLeft());
@@ -283,10 +676,26 @@ BackendPainter::markDirty(const util::rect<DocumentPrecision>& area) {
 	util::rect<int> pixelArea(ul.x - 1, ul.y - 1, lr.x + 1, lr.y +1);
 
 	_documentTexture->markDirty(pixelArea, TorusTexture::NeedsRedraw);
+	_previewPyramid->markDirty(area);
+
+	if (!_scaleLevels.empty())
+		for (scale_levels_type::iterator i = ++_scaleLevels.begin(); i != _scaleLevels.end(); i++) {
+
+			util::rect<double> levelArea = area;
+			levelArea *= i->scale;
+
+			util::rect<int> levelPixelArea = levelArea;
+			levelPixelArea.minX -= 1;
+			levelPixelArea.minY -= 1;
+			levelPixelArea.maxX += 1;
+			levelPixelArea.maxY += 1;
+
+			i->cache->markDirty(levelPixelArea, TilesCache::NeedsRedraw);
+		}
 }
 
 void
-BackendPainter::markOverlayDirty(const util::rect<DocumentPrecision>& area) {
+BackendPainter::processOverlayDirty(const util::rect<DocumentPrecision>& area) {
 
 	// area is in document units -- transform it to pixel units
 	util::point<int> ul = documentToTexture(area.upperLeft());
@@ -302,7 +711,13 @@ void
 BackendPainter::setDeviceTransformation() {
 
 	_documentPainter.setDeviceTransformation(_scale, util::point<int>(0, 0));
-	_documentCleanUpPainter->setDeviceTransformation(_scale, util::point<int>(0, 0));
+	if (!_scaleLevels.empty()) {
+
+		TilesCache::BackgroundRasterizerLock lock(*_scaleLevels.front().cache);
+
+		_scaleLevels.front().scale = _scale;
+		_scaleLevels.front().painter->setDeviceTransformation(_scale, util::point<int>(0, 0));
+	}
 	_overlayPainter.setDeviceTransformation(_scale, util::point<int>(0, 0));
 }
 
@@ -312,8 +727,8 @@ BackendPainter::initiateFullRedraw(const util::rect<int>& roi) {
 	LOG_DEBUG(backendpainterlog) << "initiate full redraw for roi " << roi << std::endl;
 
 	_documentTexture->reset(roi.center());
-	_documentPainter.resetIncrementalMemory();
 	_overlayTexture->reset(roi.center());
+	_previewPyramid->markDirty();
 }
 
 bool
@@ -326,13 +741,19 @@ BackendPainter::prepareTextures(const util::rect<int>& pixelRoi) {
 
 		LOG_DEBUG(backendpainterlog) << "roi changed in size -- recreate textures" << std::endl;
 
-		_documentTexture = boost::make_shared<TorusTexture>(pixelRoi);
-		_documentTexture->setBackgroundRasterizer(_documentCleanUpPainter);
+		// the texture resets the cache around its center
+		if (_scaleLevels.empty())
+			getScaleLevel(getGridLevel(_scale), util::point<int>(0, 0), true);
+
+		_documentTexture = boost::make_shared<TorusTexture>(pixelRoi, _scaleLevels.front().cache);
 		_documentTexture->setContentChangedSlot(_contentChanged);
 
 		_overlayTexture = boost::make_shared<TorusTexture>(pixelRoi);
 		_overlayTexture->setContentChangedSlot(_contentChanged);
 
+		_previewPyramid = boost::make_shared<PreviewPyramid>(util::point<int>(pixelRoi.width(), pixelRoi.height()));
+		_previewPyramid->setRasterizer(_previewPainter);
+
 		LOG_DEBUG(backendpainterlog) << "textures recreated" << std::endl;
 
 		return true;
@@ -351,7 +772,10 @@ BackendPainter::drawTextures(const util::rect<int>& roi) {
 
 		glScaled(_scaleChange.x, _scaleChange.y, 1.0);
 		glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+		// show the previews where the texture has no content
+		_previewPyramid->render(_previousScale);
 		_documentTexture->render(roi/_scaleChange, _documentPainter);
+		drawWetInk(_previousScale);
 		glColor4f(1.0f, 1.0f, 0.5f, _overlayAlpha);
 		_overlayTexture->render(roi/_scaleChange, _overlayPainter);
 
@@ -359,13 +783,123 @@ BackendPainter::drawTextures(const util::rect<int>& roi) {
 
 		glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
 		_documentTexture->render(roi, _documentPainter);
+		drawWetInk(_scale);
 		glColor4f(1.0f, 1.0f, 0.8f, _overlayAlpha);
 		_overlayTexture->render(roi, _overlayPainter);
 	}
 
 	glPopMatrix();
+}
+
+void
+BackendPainter::drawWetInk(const util::point<double>& scale) {
+
+	if (!_wetInk || !_snapshot)
+		return;
+
+	// the snapshot contains the points of all notifications we processed
+	StrokePoints& points = _snapshot->getStrokePoints();
+
+	boost::shared_lock<boost::shared_mutex> lock(points.getMutex());
+
+	// the stroke points of the current stroke don't change anymore
+	const OpenStroke& stroke = _openStroke;
+
+	if (stroke.end <= stroke.begin || stroke.end > points.size())
+		return;
+
+	glPushMatrix();
+	glScaled(scale.x, scale.y, 1.0);
+	// stroke points are in page units
+	glTranslated(stroke.shift.x, stroke.shift.y, 0.0);
+
+	glDisable(GL_TEXTURE_2D);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	// a band along the stroke points, as wide as the balls the stroke painter 
+	// would draw for the pressure of each point
+	glBegin(GL_TRIANGLE_STRIP);
+
+	util::point<PagePrecision> normal(0, 0);
+
+	for (unsigned long i = stroke.begin; i < stroke.end; i++)
+		wetInkVertices(
+				points[std::max(i, stroke.begin + 1) - 1],
+				points[i],
+				points[std::min(i + 1, stroke.end - 1)],
+				stroke.style,
+				1.0,
+				normal);
+
+	glEnd();
+
+	StrokePoint tip = points[stroke.end - 1];
+
+	// continue the band where the pen will probably be by the time this frame 
+	// is shown, more transparent to mark it as provisional
+	std::vector<StrokePoint> predicted;
+	if (_penPrediction > 0 && _penPredictor.predict(points, stroke.begin, stroke.end, _penPrediction, predicted)) {
+
+		predicted.insert(predicted.begin(), tip);
+
+		glBegin(GL_TRIANGLE_STRIP);
+
+		for (unsigned int i = 0; i < predicted.size(); i++)
+			wetInkVertices(
+					predicted[std::max(i, 1u) - 1],
+					predicted[i],
+					predicted[std::min(i + 1, (unsigned int)predicted.size() - 1)],
+					stroke.style,
+					0.5,
+					normal);
+
+		glEnd();
+
+		tip = predicted.back();
+	}
+
+	// a round tip where the pen is
+	double radius = 0.5*stroke.style.width()*SkiaStrokeBallPainter::widthPressureCurve(tip.pressure);
+
+	glBegin(GL_TRIANGLE_FAN);
+	glVertex2d(tip.position.x, tip.position.y);
+	for (int i = 0; i <= 16; i++)
+		glVertex2d(
+				tip.position.x + radius*cos(i*M_PI/8),
+				tip.position.y + radius*sin(i*M_PI/8));
+	glEnd();
+
+	glPopMatrix();
+}
 
-	_documentPainter.rememberDrawnElements();
+void
+BackendPainter::wetInkVertices(
+		const StrokePoint&          previous,
+		const StrokePoint&          point,
+		const StrokePoint&          next,
+		const Style&                style,
+		double                      opacity,
+		util::point<PagePrecision>& normal) {
+
+	util::point<PagePrecision> direction = next.position - previous.position;
+	double length = sqrt(direction.x*direction.x + direction.y*direction.y);
+
+	// keep the previous normal for repeated points
+	if (length > 0)
+		normal = util::point<PagePrecision>(-direction.y, direction.x)/length;
+
+	double radius = 0.5*style.width()*SkiaStrokeBallPainter::widthPressureCurve(point.pressure);
+	double alpha  = SkiaStrokeBallPainter::strokeAlphaPressureCurve(point.pressure);
+
+	glColor4ub(
+			style.getRed(),
+			style.getGreen(),
+			style.getBlue(),
+			(unsigned char)(255*opacity*alpha));
+
+	glVertex2d(point.position.x + radius*normal.x, point.position.y + radius*normal.y);
+	glVertex2d(point.position.x - radius*normal.x, point.position.y - radius*normal.y);
 }
 
 void
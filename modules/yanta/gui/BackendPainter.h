@@ -1,6 +1,11 @@
 #ifndef CANVAS_PAINTER_H__
 #define CANVAS_PAINTER_H__
 
+#include <list>
+#include <vector>
+
+#include <boost/thread.hpp>
+
 #include <signals/Slot.h>
 #include <gui/GuiSignals.h>
 #include <gui/Skia.h>
@@ -11,13 +16,17 @@
 #include <document/DocumentSignals.h>
 #include <tools/Tools.h>
 #include <tools/PenMode.h>
+#include "PageRasterCache.h"
+#include "PenPredictor.h"
 #include "SkiaDocumentPainter.h"
 #include "SkiaOverlayPainter.h"
 
 extern logger::LogChannel backendpainterlog;
 
-// forward declaration
+// forward declarations
 class TorusTexture;
+class TilesCache;
+class PreviewPyramid;
 
 class BackendPainter : public gui::Painter {
 
@@ -25,11 +34,14 @@ public:
 
 	BackendPainter();
 
+	/**
+	 * Set the document to draw. The painters draw from snapshots of it, which 
+	 * are taken in draw() whenever the document changed.
+	 */
 	void setDocument(boost::shared_ptr<Document> document) {
 
-		_documentPainter.setDocument(document);
-		_overlayPainter.setDocument(document);
-		_documentCleanUpPainter->setDocument(document);
+		_document = document;
+		_pageRasterCache->setDocument(document);
 		_documentChanged = true;
 	}
 
@@ -42,12 +54,14 @@ public:
 
 		LOG_ALL(backendpainterlog) << "cursor set to position " << position << std::endl;
 
-		_cursorPosition = position;
+		boost::lock_guard<boost::mutex> lock(_viewStateMutex);
+		_viewState.cursorPosition = position;
 	}
 
 	void showCursor(bool show) {
 
-		_showCursor = show;
+		boost::lock_guard<boost::mutex> lock(_viewStateMutex);
+		_viewState.showCursor = show;
 	}
 
 	void setPenMode(const PenMode& penMode) {
@@ -78,12 +92,28 @@ public:
 			const util::point<double>& resolution);
 
 	/**
-	 * Give the painter a hint about added content.
+	 * Give the painter a hint about added content. This and the other 
+	 * notifications about changes below can be called from any thread, they 
+	 * will be processed in the next call to draw().
 	 */
 	void contentAdded(const util::rect<DocumentPrecision>& region);
 
 	/**
-	 * Request a drag of the painter in pixel units.
+	 * Give the painter a hint about a point added to the current stroke. With 
+	 * wet ink enabled, the current stroke is drawn on top of the textures 
+	 * until strokeFinished() is called for it.
+	 */
+	void strokePointAdded(const StrokePointAdded& signal);
+
+	/**
+	 * Give the painter a hint about the current stroke being finished.
+	 */
+	void strokeFinished(const util::rect<DocumentPrecision>& region);
+
+	/**
+	 * Request a drag of the painter in pixel units. This and the other view 
+	 * changes below only change the view state, which draw() picks up the next 
+	 * time it is called. They never wait for a frame to be drawn.
 	 */
 	void drag(const util::point<DocumentPrecision>& direction);
 
@@ -151,11 +181,175 @@ private:
 		Zooming
 	};
 
+	/**
+	 * The current stroke, as far as the painter was told about it.
+	 */
+	struct OpenStroke {
+
+		OpenStroke() :
+			begin(0),
+			end(0),
+			shift(0, 0) {}
+
+		unsigned long                  begin;
+		unsigned long                  end;
+		Style                          style;
+		util::point<DocumentPrecision> shift;
+	};
+
+	/**
+	 * A change notification that waits for the next draw().
+	 */
+	struct PendingChange {
+
+		enum Type {
+
+			ContentAdded,
+			StrokePointAdded,
+			StrokeFinished,
+			Dirty,
+			OverlayDirty,
+			Refresh
+		};
+
+		PendingChange(
+				Type type_,
+				const util::rect<DocumentPrecision>& area_,
+				const OpenStroke& stroke_ = OpenStroke()) :
+			type(type_),
+			area(area_),
+			stroke(stroke_) {}
+
+		Type                          type;
+		util::rect<DocumentPrecision> area;
+
+		// the current stroke after a StrokePointAdded
+		OpenStroke                    stroke;
+	};
+
+	/**
+	 * The parts of the transformation and the cursor that are changed by user 
+	 * input. The input handlers change _viewState, draw() works on a copy of 
+	 * it that does not change while drawing.
+	 */
+	struct ViewState {
+
+		ViewState(const util::point<double>& scale_) :
+			mode(IncrementalDrawing),
+			shift(0, 0),
+			scale(scale_),
+			scaleChange(1, 1),
+			zoomAnchor(0, 0),
+			cursorPosition(0, 0),
+			showCursor(false),
+			zoomFinished(false) {}
+
+		BackendPainterMode  mode;
+		util::point<double> shift;
+		util::point<double> scale;
+		util::point<double> scaleChange;
+		util::point<double> zoomAnchor;
+		util::point<double> cursorPosition;
+		bool                showCursor;
+
+		// a zoom was finished, but the textures did not follow yet
+		bool zoomFinished;
+	};
+
+	/**
+	 * A tiles cache for one of the grid scales, together with the painter that 
+	 * fills it in the background.
+	 */
+	struct ScaleLevel {
+
+		ScaleLevel() :
+			level(0),
+			scale(0, 0) {}
+
+		// the number of grid steps from the default scale
+		int level;
+
+		// the scale of the content of the cache
+		util::point<DocumentPrecision> scale;
+
+		boost::shared_ptr<TilesCache>          cache;
+		boost::shared_ptr<SkiaDocumentPainter> painter;
+	};
+
+	// scale levels, most recently used first
+	typedef std::list<ScaleLevel> scale_levels_type;
+
+	/**
+	 * Copy the current view state into the members used for drawing. Returns 
+	 * true, if a zoom was finished since the last call.
+	 */
+	bool takeViewState();
+
+	/**
+	 * Change the scale of the given view state, keeping anchor where it is.
+	 */
+	void zoomViewState(ViewState& state, double zoomChange, const util::point<DocumentPrecision>& anchor);
+
+	/**
+	 * Let the textures follow the scale of a finished zoom.
+	 */
+	void processFinishedZoom();
+
+	/**
+	 * Leave the dragging mode after content changed.
+	 */
+	void stopDragging();
+
+	/**
+	 * Take a snapshot of the document and pass it to all painters.
+	 */
+	void takeSnapshot();
+
+	/**
+	 * Process the change notifications that arrived since the last draw().
+	 */
+	void processPendingChanges(const std::vector<PendingChange>& changes);
+
+	void processContentAdded(const util::rect<DocumentPrecision>& region);
+	void processStrokePointAdded(const util::rect<DocumentPrecision>& region);
+	void processDirty(const util::rect<DocumentPrecision>& area);
+	void processOverlayDirty(const util::rect<DocumentPrecision>& area);
+
 	/**
 	 * Get the closest grid scale to the requested scale.
 	 */
 	util::point<DocumentPrecision> snapScaleToGrid(const util::point<DocumentPrecision>& scale);
 
+	/**
+	 * Get the number of grid steps between the default scale and the given 
+	 * scale.
+	 */
+	int getGridLevel(const util::point<DocumentPrecision>& scale);
+
+	/**
+	 * Get the scale of a grid level.
+	 */
+	util::point<DocumentPrecision> getGridScale(int level);
+
+	/**
+	 * Check whether we keep caches for more than one scale.
+	 */
+	bool cacheScaleLevels() { return _snapToScaleGrid && _maxScaleLevels > 1; }
+
+	/**
+	 * Get the scale level for the given grid level, recycling the least 
+	 * recently used one if it is not cached. New levels start filling around 
+	 * centerTile. If activate is set, the level becomes the most recently used 
+	 * one, otherwise the second (to be used next).
+	 */
+	ScaleLevel& getScaleLevel(int level, const util::point<int>& centerTile, bool activate);
+
+	/**
+	 * Let the cache of the grid level closest to the current zoom fill in the 
+	 * background while the user is still zooming.
+	 */
+	void prepareScaleLevel();
+
 	/**
 	 * Set the current device transformation in all painters.
 	 */
@@ -173,6 +367,25 @@ private:
 	 */
 	void drawTextures(const util::rect<int>& roi);
 
+	/**
+	 * Draw the unfinished stroke directly from the stroke points, with the 
+	 * given number of pixels per document unit. Does not look at the 
+	 * document, which can change while we draw, except for the stroke points 
+	 * of the current stroke.
+	 */
+	void drawWetInk(const util::point<double>& scale);
+
+	/**
+	 * Add the two vertices of the wet ink band at point.
+	 */
+	void wetInkVertices(
+			const StrokePoint&          previous,
+			const StrokePoint&          point,
+			const StrokePoint&          next,
+			const Style&                style,
+			double                      opacity,
+			util::point<PagePrecision>& normal);
+
 	/**
 	 * Draw the pen based on the current pen mode.
 	 */
@@ -182,7 +395,7 @@ private:
 	// PAINTER CONFIGURATION //
 	///////////////////////////
 
-	// the current mode of the backend painter
+	// the mode of the backend painter for the current draw()
 	BackendPainterMode _mode;
 
 	// show the current pen position
@@ -194,18 +407,43 @@ private:
 	// the amount of scaling between two scale levels
 	double _logScaleGridSize;
 
+	// draw the current stroke on top of the textures, instead of into them
+	bool _wetInk;
+
+	// the current stroke to draw as wet ink, only accessed by draw()
+	OpenStroke _openStroke;
+
+	// the number of milliseconds to extrapolate the current stroke
+	double _penPrediction;
+
+	PenPredictor _penPredictor;
+
 	//////////////////////
 	// TEXTURE HANDLING //
 	//////////////////////
 
+	// the document to draw
+	boost::shared_ptr<Document> _document;
+
+	// the snapshot of the document the painters draw from
+	boost::shared_ptr<Document> _snapshot;
+
 	// indicates that the document was changed entirely
 	bool _documentChanged;
 
 	// the skia painter for the document
 	SkiaDocumentPainter _documentPainter;
 
-	// a skia painter for the background updates
-	boost::shared_ptr<SkiaDocumentPainter> _documentCleanUpPainter;
+	// images of the pages for far zoomed-out views, shared by all document 
+	// painters
+	boost::shared_ptr<PageRasterCache> _pageRasterCache;
+
+	// the caches for the recently used scales, each with its own skia painter 
+	// for the background updates
+	scale_levels_type _scaleLevels;
+
+	// the maximal number of scale levels to keep
+	unsigned int _maxScaleLevels;
 
 	// a skia painter for the overlay
 	SkiaOverlayPainter _overlayPainter;
@@ -214,12 +452,21 @@ private:
 	boost::shared_ptr<TorusTexture> _documentTexture;
 	boost::shared_ptr<TorusTexture> _overlayTexture;
 
+	// low-resolution images of the surroundings to show while zooming, and 
+	// the painter to draw them
+	boost::shared_ptr<PreviewPyramid>      _previewPyramid;
+	boost::shared_ptr<SkiaDocumentPainter> _previewPainter;
+
 	// the transparency of the overlay texture
 	float _overlayAlpha;
 
 	// slot to send content changed signal to
 	signals::Slot<const gui::ContentChanged>* _contentChanged;
 
+	// change notifications from other threads
+	std::vector<PendingChange> _pendingChanges;
+	boost::mutex               _pendingChangesMutex;
+
 	////////////////////
 	// TRANSFORMATION //
 	////////////////////
@@ -244,6 +491,12 @@ private:
 
 	util::rect<int> _previousPixelRoi;
 
+	// the view state as set by the input handlers, _mode, _shift, _scale, 
+	// _scaleChange, _zoomAnchor, and the cursor are copied from it at the 
+	// beginning of each draw()
+	ViewState    _viewState;
+	boost::mutex _viewStateMutex;
+
 	/////////
 	// PEN //
 	/////////
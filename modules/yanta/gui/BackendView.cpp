@@ -33,6 +33,7 @@ BackendView::BackendView() :
 
 	_document.registerBackwardCallback(&BackendView::onDocumentChangedArea, this);
 	_document.registerBackwardCallback(&BackendView::onStrokePointAdded, this);
+	_document.registerBackwardCallback(&BackendView::onStrokeFinished, this);
 	_tools.registerBackwardCallback(&BackendView::onToolsChangedArea, this);
 	_tools.registerBackwardCallback(&BackendView::onLassoPointAdded, this);
 	_penMode.registerBackwardCallback(&BackendView::onPenModeChanged, this);
@@ -377,7 +378,16 @@ BackendView::onStrokePointAdded(const StrokePointAdded& signal) {
 
 	LOG_ALL(backendviewlog) << "a stroke point was added -- initiate a redraw" << std::endl;
 
-	_painter->contentAdded(signal.area);
+	_painter->strokePointAdded(signal);
+	_contentChanged();
+}
+
+void
+BackendView::onStrokeFinished(const StrokeFinished& signal) {
+
+	LOG_ALL(backendviewlog) << "a stroke was finished -- initiate a redraw" << std::endl;
+
+	_painter->strokeFinished(signal.area);
 	_contentChanged();
 }
 
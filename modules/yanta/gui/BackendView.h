@@ -69,6 +69,8 @@ private:
 
 	void onStrokePointAdded(const StrokePointAdded& signal);
 
+	void onStrokeFinished(const StrokeFinished& signal);
+
 
 	// callbacks from backend for tools
 
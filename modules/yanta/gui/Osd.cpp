@@ -19,6 +19,8 @@ Osd::Osd() :
 
 	_osdRequest.registerForwardSlot(_add);
 	_osdRequest.registerForwardSlot(_remove);
+	_osdRequest.registerForwardSlot(_undo);
+	_osdRequest.registerForwardSlot(_redo);
 
 	_painter.registerForwardCallback(&Osd::onFingerDown, this);
 	_painter.registerForwardCallback(&Osd::onFingerUp, this);
@@ -110,6 +112,14 @@ Osd::onFingerDown(gui::FingerDown& signal) {
 	} else if (signal.position.y < 1100) {
 
 		_remove();
+
+	} else if (signal.position.y < 1200) {
+
+		_undo();
+
+	} else if (signal.position.y < 1300) {
+
+		_redo();
 	}
 
 	signal.processed = true;
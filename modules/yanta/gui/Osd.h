@@ -43,6 +43,8 @@ private:
 
 	signals::Slot<Add>    _add;
 	signals::Slot<Remove> _remove;
+	signals::Slot<Undo>   _undo;
+	signals::Slot<Redo>   _redo;
 
 	unsigned char _previousRed;
 	unsigned long _redTapTime;
@@ -147,6 +147,24 @@ OsdPainter::draw(
 	glVertex2f(x + 10, y - 3);
 	glEnd();
 
+	glColor3f(0.0, 0.0, 0.0);
+	x = 50;
+	y = 1150;
+	glBegin(GL_TRIANGLES);
+	glVertex2f(x - 10, y);
+	glVertex2f(x + 10, y - 10);
+	glVertex2f(x + 10, y + 10);
+	glEnd();
+
+	glColor3f(0.0, 0.0, 0.0);
+	x = 50;
+	y = 1250;
+	glBegin(GL_TRIANGLES);
+	glVertex2f(x + 10, y);
+	glVertex2f(x - 10, y - 10);
+	glVertex2f(x - 10, y + 10);
+	glEnd();
+
 	return false;
 }
 
@@ -18,5 +18,15 @@ class Add : public OsdSignal {};
  */
 class Remove : public OsdSignal {};
 
+/**
+ * Request to revert the last change.
+ */
+class Undo : public OsdSignal {};
+
+/**
+ * Request to repeat the last reverted change.
+ */
+class Redo : public OsdSignal {};
+
 #endif // YANTA_OSD_SIGNALS_H__
 
@@ -0,0 +1,189 @@
+#include <cmath>
+
+#include <boost/make_shared.hpp>
+
+#include <SkCanvas.h>
+#include <SkBitmap.h>
+
+#include <util/Logger.h>
+#include <util/ProgramOptions.h>
+#include "PageRasterCache.h"
+#include "SkiaDocumentPainter.h"
+
+logger::LogChannel pagerastercachelog("pagerastercachelog", "[PageRasterCache] ");
+
+util::ProgramOption optionPageRasterResolution(
+	util::_long_name        = "pageRasterResolution",
+	util::_description_text = "The resolution in pixels per millimeter of the page images used for far zoomed-out views.",
+	util::_default_value    = 0.5);
+
+PageRasterCache::PageRasterCache() :
+	_resolution(optionPageRasterResolution.as<double>()),
+	_painter(boost::make_shared<SkiaDocumentPainter>()),
+	_stopped(false),
+	_backgroundThread(boost::bind(&PageRasterCache::createImages, this)) {}
+
+PageRasterCache::~PageRasterCache() {
+
+	LOG_ALL(pagerastercachelog) << "tearing background thread down..." << std::endl;
+
+	{
+		boost::unique_lock<boost::mutex> lock(_mutex);
+		_stopped = true;
+	}
+
+	_wakeup.notify_one();
+	_backgroundThread.join();
+
+	LOG_ALL(pagerastercachelog) << "background thread stopped" << std::endl;
+}
+
+void
+PageRasterCache::setDocument(boost::shared_ptr<Document> document) {
+
+	boost::unique_lock<boost::mutex> lock(_mutex);
+
+	_document = document;
+	_snapshot.reset();
+	_images.clear();
+	_requests.clear();
+}
+
+void
+PageRasterCache::setSnapshot(boost::shared_ptr<Document> snapshot) {
+
+	boost::unique_lock<boost::mutex> lock(_mutex);
+
+	_snapshot = snapshot;
+}
+
+bool
+PageRasterCache::draw(SkCanvas& canvas, const Page& page) {
+
+	boost::unique_lock<boost::mutex> lock(_mutex);
+
+	Image& image = _images[page.getIndex()];
+
+	if (image.version != page.getContentVersion() || image.pixels.empty()) {
+
+		// the image will show the version at the time it is drawn, so there 
+		// is no need to queue the page again for each change
+		if (!image.requested) {
+
+			LOG_ALL(pagerastercachelog) << "requesting image of page " << page.getIndex() << " in version " << page.getContentVersion() << std::endl;
+
+			image.requested = true;
+			_requests.push_back(page.getIndex());
+			_wakeup.notify_one();
+		}
+
+		return false;
+	}
+
+	SkBitmap bitmap;
+	bitmap.setInfo(SkImageInfo::MakeN32Premul(image.width, image.height));
+	bitmap.setPixels(&image.pixels[0]);
+
+	SkPaint paint;
+	paint.setFilterLevel(SkPaint::kLow_FilterLevel);
+
+	canvas.drawBitmapRect(
+			bitmap,
+			SkRect::MakeLTRB(image.region.minX, image.region.minY, image.region.maxX, image.region.maxY),
+			&paint);
+
+	return true;
+}
+
+void
+PageRasterCache::createImages() {
+
+	LOG_ALL(pagerastercachelog) << "background thread started" << std::endl;
+
+	while (true) {
+
+		unsigned int page;
+		boost::shared_ptr<Document> document;
+		boost::shared_ptr<Document> snapshot;
+
+		{
+			boost::unique_lock<boost::mutex> lock(_mutex);
+
+			while (_requests.empty() && !_stopped)
+				_wakeup.wait(lock);
+
+			if (_stopped)
+				return;
+
+			page     = _requests.front();
+			document = _document;
+			snapshot = _snapshot;
+			_requests.pop_front();
+
+			// changes from now on need another request
+			_images[page].requested = false;
+		}
+
+		if (!snapshot)
+			continue;
+
+		// the snapshot does not change while we draw one of its pages
+		if (page >= snapshot->numPages())
+			continue;
+
+		Image image;
+
+		_painter->setDocument(snapshot);
+		createImage(snapshot->getPage(page), image);
+
+		boost::unique_lock<boost::mutex> lock(_mutex);
+
+		// the document was replaced in the meantime
+		if (document != _document)
+			continue;
+
+		Image& cached = _images[page];
+
+		// keep a request for a newer version
+		image.requested = cached.requested;
+
+		std::swap(cached, image);
+	}
+}
+
+void
+PageRasterCache::createImage(Page& page, Image& image) {
+
+	image.version = page.getContentVersion();
+
+	// the paper and its border
+	image.region = util::rect<PagePrecision>(
+			-page.getBorderSize(),
+			-page.getBorderSize(),
+			page.getSize().x + page.getBorderSize(),
+			page.getSize().y + page.getBorderSize());
+
+	image.width  = (unsigned int)ceil(image.region.width()*_resolution);
+	image.height = (unsigned int)ceil(image.region.height()*_resolution);
+	image.pixels.resize(image.width*image.height);
+
+	LOG_DEBUG(pagerastercachelog)
+			<< "creating image of page " << page.getIndex() << " in version " << image.version
+			<< " with " << image.width << "x" << image.height << " pixels" << std::endl;
+
+	SkBitmap bitmap;
+	bitmap.setInfo(SkImageInfo::MakeN32Premul(image.width, image.height));
+	bitmap.setPixels(&image.pixels[0]);
+
+	SkCanvas canvas(bitmap);
+	canvas.clear(SkColorSetARGB(0, 0, 0, 0));
+
+	// the upper left of the region is the upper left of the image
+	canvas.translate(
+			-image.region.minX*_resolution,
+			-image.region.minY*_resolution);
+
+	_painter->setDeviceTransformation(util::point<double>(_resolution, _resolution), util::point<int>(0, 0));
+	_painter->drawPage(canvas, page);
+}
+
@@ -0,0 +1,121 @@
+#ifndef YANTA_GUI_PAGE_RASTER_CACHE_H__
+#define YANTA_GUI_PAGE_RASTER_CACHE_H__
+
+#include <map>
+#include <deque>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include <gui/Skia.h>
+#include <document/Document.h>
+
+// forward declarations
+class SkCanvas;
+class SkiaDocumentPainter;
+
+/**
+ * Low-resolution images of whole pages, for drawing far zoomed-out views
+ * without visiting every stroke point. Images are created by a background
+ * thread whenever a page's content version does not match the image.
+ */
+class PageRasterCache {
+
+public:
+
+	PageRasterCache();
+
+	~PageRasterCache();
+
+	/**
+	 * Set the document whose pages to cache. Clears the cache.
+	 */
+	void setDocument(boost::shared_ptr<Document> document);
+
+	/**
+	 * Set a snapshot of the document to draw the images from. Keeps the
+	 * cache, the pages of the snapshot have the same content versions as the
+	 * pages of the document.
+	 */
+	void setSnapshot(boost::shared_ptr<Document> snapshot);
+
+	/**
+	 * Get the resolution of the images in pixels per document unit. Pages
+	 * drawn at this or a lower resolution look the same from the cache.
+	 */
+	double getResolution() const { return _resolution; }
+
+	/**
+	 * Draw the image of a page on the given canvas, which has to be in page
+	 * coordinates. Returns false, if there is no up-to-date image of the page
+	 * (one will be created in the background).
+	 */
+	bool draw(SkCanvas& canvas, const Page& page);
+
+private:
+
+	struct Image {
+
+		Image() :
+			version(0),
+			requested(false),
+			width(0),
+			height(0) {}
+
+		// the content version of the page shown in the image
+		unsigned long version;
+
+		// the page is waiting in the requests for a new image
+		bool requested;
+
+		// the image data
+		std::vector<gui::skia_pixel_t> pixels;
+		unsigned int width;
+		unsigned int height;
+
+		// the area in page units covered by the image
+		util::rect<PagePrecision> region;
+	};
+
+	/**
+	 * Entry point of the background thread.
+	 */
+	void createImages();
+
+	/**
+	 * Draw the image of a page.
+	 */
+	void createImage(Page& page, Image& image);
+
+	// images of pages are identified by the number of the page in the
+	// document, the cache is cleared whenever the document is replaced
+	typedef std::map<unsigned int, Image> images_type;
+
+	double _resolution;
+
+	boost::shared_ptr<Document> _document;
+
+	// the most recent snapshot of the document, to draw from
+	boost::shared_ptr<Document> _snapshot;
+
+	// painter for the background thread
+	boost::shared_ptr<SkiaDocumentPainter> _painter;
+
+	images_type _images;
+
+	// the numbers of the pages for which images have been requested, each at
+	// most once
+	std::deque<unsigned int> _requests;
+
+	// protects the images, requests, and the document pointers
+	boost::mutex _mutex;
+
+	boost::condition_variable _wakeup;
+
+	bool _stopped;
+
+	boost::thread _backgroundThread;
+};
+
+#endif // YANTA_GUI_PAGE_RASTER_CACHE_H__
+
@@ -0,0 +1,137 @@
+#include <cmath>
+#include <algorithm>
+
+#include "PenPredictor.h"
+
+bool
+PenPredictor::predict(
+		const StrokePoints&       points,
+		unsigned long             begin,
+		unsigned long             end,
+		double                    ahead,
+		std::vector<StrokePoint>& predicted) {
+
+	predicted.clear();
+
+	if (ahead <= 0 || end <= begin)
+		return false;
+
+	const StrokePoint& last = points[end - 1];
+
+	// collect the recent samples, with times relative to the last one
+	std::vector<double> t, x, y, pressure;
+
+	for (unsigned long i = end; i > begin && t.size() < NumSamples; i--) {
+
+		const StrokePoint& point = points[i - 1];
+
+		if (last.timestamp - point.timestamp > MaxSampleAge)
+			break;
+
+		t.push_back(-(double)(last.timestamp - point.timestamp));
+		x.push_back(point.position.x);
+		y.push_back(point.position.y);
+		pressure.push_back(point.pressure);
+	}
+
+	// we need samples at at least two different times
+	if (t.size() < 2 || t.front() == t.back())
+		return false;
+
+	// fall back to a linear fit for few samples
+	unsigned int degree = (t.size() >= 4 ? 2 : 1);
+
+	double cx[3], cy[3], cp[2];
+
+	if (!fit(t, x, degree, cx) || !fit(t, y, degree, cy) || !fit(t, pressure, 1, cp))
+		return false;
+
+	for (unsigned int i = 1; i <= NumPredicted; i++) {
+
+		double time = ahead*i/NumPredicted;
+
+		util::point<double> position(
+				evaluate(cx, degree, time),
+				evaluate(cy, degree, time));
+
+		predicted.push_back(
+				StrokePoint(
+						position,
+						std::max(0.0, evaluate(cp, 1, time)),
+						last.timestamp + (unsigned long)time));
+	}
+
+	return true;
+}
+
+bool
+PenPredictor::fit(
+		const std::vector<double>& t,
+		const std::vector<double>& values,
+		unsigned int               degree,
+		double*                    coefficients) {
+
+	const unsigned int n = degree + 1;
+
+	// the normal equations, as augmented matrix
+	double a[3][4] = {{0}};
+
+	for (unsigned int k = 0; k < t.size(); k++) {
+
+		double powers[3] = { 1, t[k], t[k]*t[k] };
+
+		for (unsigned int i = 0; i < n; i++) {
+
+			for (unsigned int j = 0; j < n; j++)
+				a[i][j] += powers[i]*powers[j];
+
+			a[i][n] += powers[i]*values[k];
+		}
+	}
+
+	// Gaussian elimination with partial pivoting
+	for (unsigned int col = 0; col < n; col++) {
+
+		unsigned int pivot = col;
+		for (unsigned int row = col + 1; row < n; row++)
+			if (std::abs(a[row][col]) > std::abs(a[pivot][col]))
+				pivot = row;
+
+		if (std::abs(a[pivot][col]) < 1e-12)
+			return false;
+
+		for (unsigned int j = 0; j <= n; j++)
+			std::swap(a[col][j], a[pivot][j]);
+
+		for (unsigned int row = col + 1; row < n; row++) {
+
+			double factor = a[row][col]/a[col][col];
+
+			for (unsigned int j = col; j <= n; j++)
+				a[row][j] -= factor*a[col][j];
+		}
+	}
+
+	for (int i = n - 1; i >= 0; i--) {
+
+		double sum = a[i][n];
+
+		for (unsigned int j = i + 1; j < n; j++)
+			sum -= a[i][j]*coefficients[j];
+
+		coefficients[i] = sum/a[i][i];
+	}
+
+	return true;
+}
+
+double
+PenPredictor::evaluate(const double* coefficients, unsigned int degree, double t) {
+
+	double value = 0;
+
+	for (int i = degree; i >= 0; i--)
+		value = value*t + coefficients[i];
+
+	return value;
+}
@@ -0,0 +1,59 @@
+#ifndef YANTA_GUI_PEN_PREDICTOR_H__
+#define YANTA_GUI_PEN_PREDICTOR_H__
+
+#include <vector>
+
+#include <util/point.hpp>
+#include <document/StrokePoint.h>
+#include <document/StrokePoints.h>
+
+/**
+ * Extrapolates the current stroke a few milliseconds into the future, to
+ * compensate for the time it takes until a stroke point is on the screen. The
+ * positions of the most recent stroke points are fitted with a quadratic
+ * polynomial in time, the pressure with a linear one.
+ */
+class PenPredictor {
+
+public:
+
+	// the maximal number of recent stroke points to fit
+	static const unsigned int NumSamples = 6;
+
+	// stroke points older than that (in milliseconds, relative to the last
+	// one) are not considered
+	static const unsigned long MaxSampleAge = 50;
+
+	// the number of points to predict
+	static const unsigned int NumPredicted = 3;
+
+	/**
+	 * Predict the continuation of the stroke points in [begin, end) for the
+	 * given number of milliseconds after the last of them. Returns false, if
+	 * there is not enough information for a prediction.
+	 */
+	bool predict(
+			const StrokePoints&       points,
+			unsigned long             begin,
+			unsigned long             end,
+			double                    ahead,
+			std::vector<StrokePoint>& predicted);
+
+private:
+
+	/**
+	 * Least-squares fit of a polynomial of the given degree (at most 2) to the
+	 * values at times t. The coefficients are stored with the lowest order
+	 * first.
+	 */
+	bool fit(
+			const std::vector<double>& t,
+			const std::vector<double>& values,
+			unsigned int               degree,
+			double*                    coefficients);
+
+	double evaluate(const double* coefficients, unsigned int degree, double t);
+};
+
+#endif // YANTA_GUI_PEN_PREDICTOR_H__
+
@@ -0,0 +1,337 @@
+#include <cstdlib>
+#include <cmath>
+
+#include <SkCanvas.h>
+#include <SkBitmap.h>
+
+#include <gui/OpenGl.h>
+#include <util/Logger.h>
+#include "PreviewPyramid.h"
+
+logger::LogChannel previewpyramidlog("previewpyramidlog", "[PreviewPyramid] ");
+
+PreviewPyramid::PreviewPyramid(const util::point<int>& size) :
+	_size(size),
+	_requestedCenter(0, 0),
+	_requestedScale(0, 0),
+	_haveRequest(false),
+	_requestedDirtyArea(0, 0, 0, 0),
+	_lastCenter(0, 0),
+	_lastScale(0, 0),
+	_dirty(true),
+	_dirtyArea(0, 0, 0, 0),
+	_stopped(false),
+	_backgroundThread(boost::bind(&PreviewPyramid::drawImages, this)) {
+
+	LOG_DEBUG(previewpyramidlog) << "creating preview pyramid with images of size " << size << std::endl;
+
+	gui::OpenGl::Guard guard;
+
+	for (unsigned int level = 0; level < NumLevels; level++) {
+
+		_imageRegions[level]   = util::rect<int>(0, 0, 0, 0);
+		_imageScales[level]    = util::point<double>(0, 0);
+		_imageChanged[level]   = false;
+		_textures[level]       = new gui::Texture(_size.x, _size.y, GL_RGBA);
+		_textureRegions[level] = util::rect<int>(0, 0, 0, 0);
+		_textureScales[level]  = util::point<double>(0, 0);
+	}
+}
+
+PreviewPyramid::~PreviewPyramid() {
+
+	LOG_ALL(previewpyramidlog) << "tearing background thread down..." << std::endl;
+
+	{
+		boost::unique_lock<boost::mutex> lock(_mutex);
+		_stopped = true;
+	}
+
+	_wakeup.notify_one();
+	_backgroundThread.join();
+
+	LOG_ALL(previewpyramidlog) << "background thread stopped" << std::endl;
+
+	gui::OpenGl::Guard guard;
+
+	for (unsigned int level = 0; level < NumLevels; level++)
+		delete _textures[level];
+}
+
+void
+PreviewPyramid::setRasterizer(boost::shared_ptr<SkiaDocumentPainter> painter) {
+
+	boost::unique_lock<boost::mutex> lock(_mutex);
+
+	_painter = painter;
+}
+
+void
+PreviewPyramid::markDirty(const util::rect<DocumentPrecision>& area) {
+
+	if (_dirtyArea.isZero())
+		_dirtyArea = area;
+	else
+		_dirtyArea.fit(area);
+}
+
+bool
+PreviewPyramid::needsUpdate(const util::point<int>& center, const util::point<double>& scale) {
+
+	if (_dirty || scale != _lastScale)
+		return true;
+
+	// tolerate small shifts, the levels cover much more than the view anyway
+	return
+			std::abs(center.x - _lastCenter.x) > _size.x/4 ||
+			std::abs(center.y - _lastCenter.y) > _size.y/4;
+}
+
+void
+PreviewPyramid::update(const util::point<int>& center, const util::point<double>& scale) {
+
+	LOG_DEBUG(previewpyramidlog) << "requesting update around " << center << " for scale " << scale << std::endl;
+
+	{
+		boost::unique_lock<boost::mutex> lock(_mutex);
+
+		// replaces a pending request, if there is one
+		_requestedCenter    = center;
+		_requestedScale     = scale;
+		_haveRequest        = true;
+		_requestedDirtyArea = util::rect<DocumentPrecision>(0, 0, 0, 0);
+	}
+
+	_lastCenter = center;
+	_lastScale  = scale;
+	_dirty      = false;
+	_dirtyArea  = util::rect<DocumentPrecision>(0, 0, 0, 0);
+
+	_wakeup.notify_one();
+}
+
+void
+PreviewPyramid::updateDirty() {
+
+	if (_dirtyArea.isZero())
+		return;
+
+	LOG_DEBUG(previewpyramidlog) << "requesting update of " << _dirtyArea << std::endl;
+
+	{
+		boost::unique_lock<boost::mutex> lock(_mutex);
+
+		if (_requestedDirtyArea.isZero())
+			_requestedDirtyArea = _dirtyArea;
+		else
+			_requestedDirtyArea.fit(_dirtyArea);
+	}
+
+	_dirtyArea = util::rect<DocumentPrecision>(0, 0, 0, 0);
+
+	_wakeup.notify_one();
+}
+
+void
+PreviewPyramid::render(const util::point<double>& scale) {
+
+	{
+		boost::unique_lock<boost::mutex> lock(_mutex);
+
+		// upload images that changed
+		for (unsigned int level = 0; level < NumLevels; level++) {
+
+			if (!_imageChanged[level])
+				continue;
+
+			LOG_ALL(previewpyramidlog) << "uploading image of level " << level << std::endl;
+
+			_textures[level]->loadData(&_images[level][0]);
+			_textureRegions[level] = _imageRegions[level];
+			_textureScales[level]  = _imageScales[level];
+			_imageChanged[level]   = false;
+		}
+	}
+
+	glEnable(GL_TEXTURE_2D);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	// coarsest first, such that finer levels are drawn on top
+	for (int level = NumLevels - 1; level >= 0; level--) {
+
+		if (_textureRegions[level].area() <= 0)
+			continue;
+
+		// the region of the image in pixels at the requested scale
+		util::rect<double> region = _textureRegions[level];
+		region /= _textureScales[level];
+		region *= scale;
+
+		_textures[level]->bind();
+
+		glBegin(GL_QUADS);
+		glTexCoord2d(0, 0); glVertex2d(region.minX, region.minY);
+		glTexCoord2d(1, 0); glVertex2d(region.maxX, region.minY);
+		glTexCoord2d(1, 1); glVertex2d(region.maxX, region.maxY);
+		glTexCoord2d(0, 1); glVertex2d(region.minX, region.maxY);
+		glEnd();
+
+		_textures[level]->unbind();
+	}
+
+	glDisable(GL_BLEND);
+}
+
+util::rect<int>
+PreviewPyramid::getLevelRegion(unsigned int level, const util::point<int>& center) {
+
+	// level 0 has half the scale of the view
+	double factor = 1.0/(2 << level);
+
+	util::point<int> levelCenter(
+			(int)round(center.x*factor),
+			(int)round(center.y*factor));
+
+	util::point<int> upperLeft = levelCenter - _size/2;
+
+	return util::rect<int>(upperLeft.x, upperLeft.y, upperLeft.x + _size.x, upperLeft.y + _size.y);
+}
+
+void
+PreviewPyramid::drawImages() {
+
+	LOG_ALL(previewpyramidlog) << "background thread started" << std::endl;
+
+	std::vector<gui::skia_pixel_t> buffer(_size.x*_size.y);
+
+	while (true) {
+
+		util::point<int>    center;
+		util::point<double> scale;
+		bool                full;
+		util::rect<DocumentPrecision> dirtyArea;
+		boost::shared_ptr<SkiaDocumentPainter> painter;
+
+		{
+			boost::unique_lock<boost::mutex> lock(_mutex);
+
+			while (!_haveRequest && _requestedDirtyArea.isZero() && !_stopped)
+				_wakeup.wait(lock);
+
+			if (_stopped)
+				return;
+
+			center       = _requestedCenter;
+			scale        = _requestedScale;
+			full         = _haveRequest;
+			dirtyArea    = _requestedDirtyArea;
+			painter      = _painter;
+			_haveRequest = false;
+			_requestedDirtyArea = util::rect<DocumentPrecision>(0, 0, 0, 0);
+		}
+
+		if (!painter || !painter->hasDocument())
+			continue;
+
+		// only changes in the current images
+		if (!full) {
+
+			drawDirty(dirtyArea, *painter, buffer);
+			continue;
+		}
+
+		// coarsest first, it covers the largest area
+		for (int level = NumLevels - 1; level >= 0; level--) {
+
+			util::point<double> levelScale = scale/(double)(2 << level);
+			util::rect<int>     region     = getLevelRegion(level, center);
+
+			LOG_ALL(previewpyramidlog) << "drawing level " << level << " in " << region << std::endl;
+
+			SkBitmap bitmap;
+			bitmap.setInfo(SkImageInfo::MakeN32Premul(_size.x, _size.y));
+			bitmap.setPixels(&buffer[0]);
+
+			SkCanvas canvas(bitmap);
+			canvas.translate(-region.minX, -region.minY);
+
+			painter->setDeviceTransformation(levelScale, util::point<int>(0, 0));
+			painter->draw(canvas, region);
+
+			boost::unique_lock<boost::mutex> lock(_mutex);
+
+			_images[level].swap(buffer);
+			_imageRegions[level] = region;
+			_imageScales[level]  = levelScale;
+			_imageChanged[level] = true;
+
+			if (buffer.size() != _images[level].size())
+				buffer.resize(_images[level].size());
+
+			// don't finish stale images
+			if (_haveRequest || _stopped)
+				break;
+		}
+	}
+}
+
+void
+PreviewPyramid::drawDirty(
+		const util::rect<DocumentPrecision>& area,
+		SkiaDocumentPainter&                 painter,
+		std::vector<gui::skia_pixel_t>&      buffer) {
+
+	for (int level = NumLevels - 1; level >= 0; level--) {
+
+		util::rect<int>     region;
+		util::point<double> levelScale;
+
+		{
+			boost::unique_lock<boost::mutex> lock(_mutex);
+
+			if (_imageRegions[level].area() <= 0)
+				continue;
+
+			region     = _imageRegions[level];
+			levelScale = _imageScales[level];
+
+			// start from the current content of the image
+			buffer = _images[level];
+		}
+
+		// the area in pixels of this level, with a border of one pixel to 
+		// compensate for rounding artefacts
+		util::rect<int> dirty(
+				(int)floor(area.minX*levelScale.x) - 1,
+				(int)floor(area.minY*levelScale.y) - 1,
+				(int)ceil(area.maxX*levelScale.x) + 1,
+				(int)ceil(area.maxY*levelScale.y) + 1);
+		dirty = dirty.intersection(region);
+
+		if (dirty.area() <= 0)
+			continue;
+
+		LOG_ALL(previewpyramidlog) << "redrawing " << dirty << " of level " << level << std::endl;
+
+		SkBitmap bitmap;
+		bitmap.setInfo(SkImageInfo::MakeN32Premul(_size.x, _size.y));
+		bitmap.setPixels(&buffer[0]);
+
+		SkCanvas canvas(bitmap);
+		canvas.translate(-region.minX, -region.minY);
+
+		painter.setDeviceTransformation(levelScale, util::point<int>(0, 0));
+		painter.draw(canvas, dirty);
+
+		boost::unique_lock<boost::mutex> lock(_mutex);
+
+		_images[level].swap(buffer);
+		_imageChanged[level] = true;
+
+		// a new request replaces this one
+		if (_haveRequest || _stopped)
+			return;
+	}
+}
+
@@ -0,0 +1,156 @@
+#ifndef YANTA_GUI_PREVIEW_PYRAMID_H__
+#define YANTA_GUI_PREVIEW_PYRAMID_H__
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include <gui/Skia.h>
+#include <gui/Texture.h>
+#include <util/point.hpp>
+#include <util/rect.hpp>
+
+#include "SkiaDocumentPainter.h"
+
+/**
+ * A set of low-resolution images of the neighbourhood of the current view, at
+ * 1/2, 1/4, and 1/8 of the current scale. Each level has the size of the view
+ * in pixels, i.e., covers twice the area of the previous level. The images are
+ * drawn by a background thread and can be shown during zooming without
+ * rasterizing anything. Content changes are collected and drawn into the
+ * existing images on request, such that writing does not keep the background
+ * thread busy.
+ */
+class PreviewPyramid {
+
+public:
+
+	// the number of levels, each with half the scale of the previous one
+	static const unsigned int NumLevels = 3;
+
+	/**
+	 * Create a pyramid with images of the given size in pixels.
+	 */
+	PreviewPyramid(const util::point<int>& size);
+
+	~PreviewPyramid();
+
+	/**
+	 * Set the painter to draw the images with. Its device transformation will
+	 * be changed by the pyramid.
+	 */
+	void setRasterizer(boost::shared_ptr<SkiaDocumentPainter> painter);
+
+	/**
+	 * Request new images around center (in pixels at the given scale). This
+	 * method does not block, the images will be drawn in the background.
+	 */
+	void update(const util::point<int>& center, const util::point<double>& scale);
+
+	/**
+	 * Indicate that the document changed entirely, such that the next call to
+	 * needsUpdate() is true even if center and scale did not change.
+	 */
+	void markDirty() { _dirty = true; }
+
+	/**
+	 * Indicate that the document changed within the given area (in document
+	 * units). The changes are drawn into the images by the next call to
+	 * updateDirty() or update().
+	 */
+	void markDirty(const util::rect<DocumentPrecision>& area);
+
+	/**
+	 * Check whether update() would redraw the images for the given center and
+	 * scale. Small changes of the center are tolerated.
+	 */
+	bool needsUpdate(const util::point<int>& center, const util::point<double>& scale);
+
+	/**
+	 * Request to redraw only the parts of the images that were marked dirty
+	 * since the last update. Does nothing, if there are none. This method does
+	 * not block.
+	 */
+	void updateDirty();
+
+	/**
+	 * Draw the available images, coarsest first. The images are placed in
+	 * pixel units of the given scale. Has to be called with an active OpenGl
+	 * context.
+	 */
+	void render(const util::point<double>& scale);
+
+private:
+
+	/**
+	 * The region (in pixels at the level's scale) of a level for the given
+	 * center of the view.
+	 */
+	util::rect<int> getLevelRegion(unsigned int level, const util::point<int>& center);
+
+	/**
+	 * Entry point of the background thread.
+	 */
+	void drawImages();
+
+	// the size of each image in pixels
+	util::point<int> _size;
+
+	// the painter for the background thread
+	boost::shared_ptr<SkiaDocumentPainter> _painter;
+
+	/**
+	 * Draw the parts of the current images that intersect the given area in
+	 * document units.
+	 */
+	void drawDirty(
+			const util::rect<DocumentPrecision>&   area,
+			SkiaDocumentPainter&                   painter,
+			std::vector<gui::skia_pixel_t>&        buffer);
+
+	// the requested center and scale
+	util::point<int>    _requestedCenter;
+	util::point<double> _requestedScale;
+	bool                _haveRequest;
+
+	// the requested area to redraw in document units, if not zero
+	util::rect<DocumentPrecision> _requestedDirtyArea;
+
+	// the center and scale of the last request
+	util::point<int>    _lastCenter;
+	util::point<double> _lastScale;
+
+	// the document changed entirely since the last request
+	bool _dirty;
+
+	// the area that changed since the last request in document units
+	util::rect<DocumentPrecision> _dirtyArea;
+
+	// the images of each level, as drawn by the background thread
+	std::vector<gui::skia_pixel_t> _images[NumLevels];
+
+	// the regions in pixels and scales of the drawn images
+	util::rect<int>     _imageRegions[NumLevels];
+	util::point<double> _imageScales[NumLevels];
+
+	// the image of a level was changed and has to be uploaded
+	bool _imageChanged[NumLevels];
+
+	// the textures to show the images, and the region and scale they
+	// currently represent
+	gui::Texture*       _textures[NumLevels];
+	util::rect<int>     _textureRegions[NumLevels];
+	util::point<double> _textureScales[NumLevels];
+
+	// protects the request and the images
+	boost::mutex _mutex;
+
+	boost::condition_variable _wakeup;
+
+	bool _stopped;
+
+	boost::thread _backgroundThread;
+};
+
+#endif // YANTA_GUI_PREVIEW_PYRAMID_H__
+
@@ -1,6 +1,7 @@
 #ifndef YANTA_GUI_RASTERIZER_H__
 #define YANTA_GUI_RASTERIZER_H__
 
+#include <util/point.hpp>
 #include <util/rect.hpp>
 #include <document/Precision.h>
 #include "Quality.h"
@@ -21,12 +22,35 @@ public:
 			SkCanvas& canvas,
 			const util::rect<DocumentPrecision>& roi) = 0;
 
+	/**
+	 * Draw the content of a single tile of a TilesCache within the given roi.  
+	 * Subclasses can use the tile coordinates to quickly find the content of 
+	 * the tile. The default implementation just draws the roi.
+	 */
+	virtual void drawTile(
+			SkCanvas& canvas,
+			const util::rect<DocumentPrecision>& roi,
+			const util::point<int>& /*tile*/) { draw(canvas, roi); }
+
 	/**
 	 * Enable or disable incremental drawing mode. Can be implemented by 
 	 * subclasses for quick incremental updates.
 	 */
 	virtual void setIncremental(bool /*incremental*/) {};
 
+	/**
+	 * For incremental drawing, tell the rasterizer until which stroke point 
+	 * the content of the canvas passed to the next draw call is complete.
+	 */
+	virtual void setDrawnUntil(unsigned long /*strokePoint*/) {};
+
+	/**
+	 * Get the stroke point until which content was drawn in the last draw 
+	 * call. Pass this value to setDrawnUntil() for the next incremental draw 
+	 * on the same canvas.
+	 */
+	virtual unsigned long getDrawnUntil() { return 0; }
+
 	/**
 	 * Set the quality of this rasterizer.
 	 */
@@ -37,6 +61,13 @@ public:
 	 */
 	inline Quality getQuality() { return _quality; }
 
+	/**
+	 * Get the quality the next draw call will actually use, i.e., with Auto 
+	 * resolved. Subclasses that choose the quality depending on the content 
+	 * should override this method.
+	 */
+	virtual Quality getEffectiveQuality() { return (_quality == Auto ? Best : _quality); }
+
 private:
 
 	// the level of quality to rasterize with
@@ -1,7 +1,10 @@
+#include <limits>
+
 #include <SkMaskFilter.h>
 #include <SkBlurMaskFilter.h>
 
 #include <util/Logger.h>
+#include "PageRasterCache.h"
 #include "SkiaDocumentPainter.h"
 
 logger::LogChannel skiadocumentpainterlog("skiadocumentpainterlog", "[SkiaDocumentPainter] ");
@@ -12,18 +15,29 @@ SkiaDocumentPainter::SkiaDocumentPainter(
 	_clearColor(clearColor),
 	_drawPaper(drawPaper),
 	_drawnUntilStrokePoint(0),
-	_drawnUntilStrokePointTmp(0),
-	_canvasCleared(false),
-	_canvasClearedTmp(false),
-	_paperDrawn(false),
-	_paperDrawnTmp(false),
-	_incremental(false) {}
+	_drawUntilStrokePoint(std::numeric_limits<unsigned long>::max()),
+	_incremental(false),
+	_omitOpenStroke(false),
+	_useTileIndex(false),
+	_tileRoi(0, 0, 0, 0),
+	_drawRange(false),
+	_rangeBegin(0),
+	_rangeEnd(0),
+	_pageFromRaster(false) {}
 
 void
 SkiaDocumentPainter::draw(SkCanvas& canvas, const util::rect<DocumentPrecision>& roi) {
 
 	LOG_DEBUG(skiadocumentpainterlog) << "drawing document in " << roi << std::endl;
 
+	updateDocument();
+
+	if (_useTileIndex && getDocument().getTileSize().x <= 0) {
+
+		LOG_ALL(skiadocumentpainterlog) << "document has no tile index, using roi traversal" << std::endl;
+		_useTileIndex = false;
+	}
+
 	setCanvas(canvas);
 
 	// prepare the visitor to draw only within roi
@@ -37,20 +51,20 @@ SkiaDocumentPainter::draw(SkCanvas& canvas, const util::rect<DocumentPrecision>&
 
 	bool qualitWasAuto = (getQuality() == Auto);
 
-	if (qualitWasAuto) {
-
-		if (scale < 1)
-			setQuality(Worst);
-		else if (scale < 5)
-			setQuality(Medium);
-		else
-			setQuality(Best);
-	}
+	if (qualitWasAuto)
+		setQuality(getAutoQuality(scale));
 
 	{
+		// the document is a snapshot that does not change while we draw it, 
+		// the input thread keeps changing the original
+
 		// make sure reading access to the stroke points are safe
 		boost::shared_lock<boost::shared_mutex> lock(getDocument().getStrokePoints().getMutex());
 
+		// points that get added while we are drawing will be drawn in the next 
+		// incremental draw
+		setDrawUntil();
+
 		// go visit the document
 		getDocument().accept(*this);
 	}
@@ -61,20 +75,82 @@ SkiaDocumentPainter::draw(SkCanvas& canvas, const util::rect<DocumentPrecision>&
 	finish();
 }
 
-bool
-SkiaDocumentPainter::needRedraw() {
+void
+SkiaDocumentPainter::setDrawUntil() {
+
+	_drawUntilStrokePoint = getDocument().getStrokePoints().size();
+
+	// the points of the open stroke are the last ones, stop before them
+	if (_omitOpenStroke && getDocument().hasOpenStroke())
+		_drawUntilStrokePoint = std::min(
+				_drawUntilStrokePoint,
+				getDocument().getCurrentPage().currentStroke().begin());
+}
+
+Quality
+SkiaDocumentPainter::getEffectiveQuality() {
+
+	if (getQuality() != Auto)
+		return getQuality();
+
+	return getAutoQuality(getPixelsPerDeviceUnit().x);
+}
+
+Quality
+SkiaDocumentPainter::getAutoQuality(double scale) {
+
+	if (scale < 1)
+		return Worst;
+	else if (scale < 5)
+		return Medium;
+
+	return Best;
+}
+
+void
+SkiaDocumentPainter::drawTile(SkCanvas& canvas, const util::rect<DocumentPrecision>& roi, const util::point<int>& /*tile*/) {
+
+	// the index tiles have a fixed size in document units, look up all of them 
+	// that cover the roi (if the document has an index, see draw())
+	_useTileIndex = true;
+	_tileRoi      = (roi - getPixelOffset())/getPixelsPerDeviceUnit();
+
+	draw(canvas, roi);
+
+	_useTileIndex = false;
+}
+
+void
+SkiaDocumentPainter::drawPage(SkCanvas& canvas, Page& page) {
+
+	LOG_DEBUG(skiadocumentpainterlog) << "drawing a single page" << std::endl;
 
-	if (!_canvasCleared || !_paperDrawn)
-		return true;
+	updateDocument();
 
-	if (getDocument().numStrokes() == 0)
-		return false;
+	setCanvas(canvas);
+
+	prepare(util::rect<DocumentPrecision>(0, 0, 0, 0));
+
+	// undo the page's shift, which will be applied when we enter the page
+	getCanvas().translate(-page.getShift().x, -page.getShift().y);
+
+	bool qualitWasAuto = (getQuality() == Auto);
+
+	if (qualitWasAuto)
+		setQuality(getAutoQuality(getPixelsPerDeviceUnit().x));
+
+	{
+		boost::shared_lock<boost::shared_mutex> lock(getDocument().getStrokePoints().getMutex());
+
+		setDrawUntil();
+
+		page.accept(*this);
+	}
 
-	// did we draw all the stroke points?
-	if (_drawnUntilStrokePoint == getDocument().getStrokePoints().size())
-		return false;
+	if (qualitWasAuto)
+		setQuality(Auto);
 
-	return true;
+	finish();
 }
 
 void
@@ -82,16 +158,9 @@ SkiaDocumentPainter::visit(Document&) {
 
 	LOG_DEBUG(skiadocumentpainterlog) << "visiting document" << std::endl;
 
-	// reset temporal memory about what we drew already
-	_drawnUntilStrokePointTmp = _drawnUntilStrokePoint;
-	_canvasClearedTmp = _canvasCleared;
-	_paperDrawnTmp = _paperDrawn;
-
 	// clear the surface, respecting the clipping
-	if (!_incremental || !_canvasCleared) {
+	if (!_incremental)
 		getCanvas().drawColor(SkColorSetRGB(_clearColor.blue, _clearColor.green, _clearColor.red));
-		_canvasClearedTmp = true;
-	}
 }
 
 void
@@ -99,9 +168,23 @@ SkiaDocumentPainter::visit(Page& page) {
 
 	LOG_ALL(skiadocumentpainterlog) << "visiting page with roi " << getRoi() << std::endl;
 
-	if ((_incremental && _paperDrawn) || !_drawPaper)
+	_pageFromRaster = false;
+
+	if (_incremental || !_drawPaper)
 		return;
 
+	// far away, the image of the page looks the same as the page itself
+	if (_pageRasterCache && getCanvas().getTotalMatrix().getScaleX() <= _pageRasterCache->getResolution()) {
+
+		_pageFromRaster = _pageRasterCache->draw(getCanvas(), page);
+
+		if (_pageFromRaster) {
+
+			LOG_ALL(skiadocumentpainterlog) << "page was drawn from its image" << std::endl;
+			return;
+		}
+	}
+
 	// even though the roi might intersect the page's content, it might not 
 	// intersect the paper -- check that here (in page coordinates)
 	if (!getRoi().isZero() && !getRoi().intersects(
@@ -179,13 +262,17 @@ SkiaDocumentPainter::visit(Page& page) {
 	paint.setStrokeJoin(SkPaint::kRound_Join);
 	getCanvas().drawPath(outline, paint);
 
-	_paperDrawnTmp = true;
 }
 
 void
 SkiaDocumentPainter::visit(Stroke& stroke) {
 
-	unsigned long end = stroke.end();
+	// don't draw lines to points that were added after we started drawing
+	unsigned long end = std::min(stroke.end(), _drawUntilStrokePoint);
+
+	// when drawing a tile, draw only the range listed in the tile index
+	if (_drawRange)
+		end = std::min(end, _rangeEnd);
 
 	// end is one beyond the last point of the stroke. _drawnUntilStrokePoint is 
 	// one beyond the last point until which we drew already.  If end is less or 
@@ -200,6 +287,12 @@ SkiaDocumentPainter::visit(Stroke& stroke) {
 	if (_incremental && _drawnUntilStrokePoint > 0 && _drawnUntilStrokePoint - 1 > stroke.begin())
 		begin = _drawnUntilStrokePoint - 1;
 
+	if (_drawRange)
+		begin = std::max(begin, _rangeBegin);
+
+	if (begin >= end)
+		return;
+
 	LOG_ALL(skiadocumentpainterlog)
 			<< "drawing stroke (" << stroke.begin() << " - " << stroke.end()
 			<< ") , starting from point " << begin << " until " << end << std::endl;
@@ -209,10 +302,11 @@ SkiaDocumentPainter::visit(Stroke& stroke) {
 		_worseStrokePainter.setQuality(getQuality());
 		_worseStrokePainter.draw(getCanvas(), getDocument().getStrokePoints(), stroke, getRoi(), begin, end);
 
-	} else
-		_bestStrokePainter.draw(getCanvas(), getDocument().getStrokePoints(), stroke, getRoi(), begin, end);
+	} else {
 
-	// remember until which point we drew already in our temporary memory
-	_drawnUntilStrokePointTmp = std::max(_drawnUntilStrokePointTmp, end);
+		// finished strokes are drawn from their curve, no matter whether 
+		// incrementally or not, to look the same on all tiles
+		_bestStrokePainter.draw(getCanvas(), getDocument().getStrokePoints(), stroke, getRoi(), begin, end);
+	}
 }
 
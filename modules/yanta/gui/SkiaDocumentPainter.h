@@ -1,6 +1,8 @@
 #ifndef YANTA_SKIA_CANVAS_PAINTER_H__
 #define YANTA_SKIA_CANVAS_PAINTER_H__
 
+#include <algorithm>
+
 #include <gui/Skia.h>
 #include <util/rect.hpp>
 
@@ -10,6 +12,9 @@
 #include "SkiaStrokeBallPainter.h"
 #include "SkiaStrokeLinePainter.h"
 
+// forward declaration
+class PageRasterCache;
+
 class SkiaDocumentPainter : public SkiaDocumentVisitor, public Rasterizer {
 
 public:
@@ -25,50 +30,65 @@ public:
 			bool drawPaper = true);
 
 	/**
-	 * Draw the document in the given ROI on the provided canvas. If 
-	 * drawnUntilStroke is non-zero, only an incremental draw is performed, 
-	 * starting from stroke drawnUntilStroke with point drawnUntilStrokePoint.
+	 * Draw the document in the given ROI on the provided canvas. In 
+	 * incremental mode, only lines after the stroke point given by 
+	 * setDrawnUntil() are drawn.
 	 */
 	virtual void draw(
 			SkCanvas& canvas,
 			const util::rect<DocumentPrecision>& roi = util::rect<DocumentPrecision>(0, 0, 0, 0));
 
 	/**
-	 * Enable or disable incremental drawing. If enabled and 
-	 * rememberDrawnElements() has been called, a subsequent call to draw() will 
-	 * only paint what was not painted, yet. After that, rememberDrawnElements() 
-	 * has to be called again to remember these incremental changes.
+	 * Draw a single tile of a TilesCache. If the document has a tile index, 
+	 * only the strokes listed in the index tiles covering the roi are drawn.
 	 */
-	void setIncremental(bool incremental) { _incremental = incremental; }
+	virtual void drawTile(
+			SkCanvas& canvas,
+			const util::rect<DocumentPrecision>& roi,
+			const util::point<int>& tile);
 
 	/**
-	 * Remember what was drawn already. Call this method prior an incremental 
-	 * draw, to draw only new elements.
+	 * Draw a single page on the provided canvas, with the upper left corner of 
+	 * the page at the origin. The page has to be part of the document of this 
+	 * painter, which should be a snapshot.
 	 */
-	void rememberDrawnElements() {
+	void drawPage(SkCanvas& canvas, Page& page);
 
-		_drawnUntilStrokePoint = _drawnUntilStrokePointTmp;
-		_canvasCleared         = _canvasClearedTmp;
-		_paperDrawn            = _paperDrawnTmp;
-	}
+	/**
+	 * Set a cache of page images to draw pages from, whenever the current 
+	 * scale is below the resolution of the images.
+	 */
+	void setPageRasterCache(boost::shared_ptr<PageRasterCache> cache) { _pageRasterCache = cache; }
 
 	/**
-	 * Returns false if there are no more elements in this document then the 
-	 * ones rememembered to be drawn already with a call to 
-	 * rememberDrawnElements().
+	 * Enable or disable incremental drawing. If enabled, a subsequent call to 
+	 * draw() will only paint what was added after the stroke point set via 
+	 * setDrawnUntil().
 	 */
-	bool needRedraw();
+	void setIncremental(bool incremental) { _incremental = incremental; }
 
 	/**
-	 * Reset the memory about what has been drawn already. Call this method to 
-	 * re-initialize incremental drawing.
+	 * Leave out the stroke that is currently drawn, if it is not finished yet. 
+	 * Incremental draws will add it once it is finished.
 	 */
-	void resetIncrementalMemory() {
+	void setOmitOpenStroke(bool omit) { _omitOpenStroke = omit; }
 
-		_drawnUntilStrokePoint = 0;
-		_canvasCleared =  false;
-		_paperDrawn = false;
-	}
+	/**
+	 * Set the stroke point until which the canvas of the next incremental draw 
+	 * is up-to-date.
+	 */
+	void setDrawnUntil(unsigned long strokePoint) { _drawnUntilStrokePoint = strokePoint; }
+
+	/**
+	 * Get the stroke point until which the last call to draw() painted.
+	 */
+	unsigned long getDrawnUntil() { return _drawUntilStrokePoint; }
+
+	/**
+	 * Get the quality that will be used to draw on a canvas without additional 
+	 * scaling, given the current device transformation.
+	 */
+	Quality getEffectiveQuality();
 
 	/**
 	 * Overload of the traverse method for this document visitor. Does not 
@@ -78,6 +98,53 @@ public:
 	template <typename VisitorType>
 	void traverse(Selection&, VisitorType&) {}
 
+	/**
+	 * Overload of the traverse method for pages. When drawing a tile, visits 
+	 * only the parts of strokes that are listed in the tile index of the page.
+	 */
+	template <typename VisitorType>
+	void traverse(Page& page, VisitorType& visitor) {
+
+		// the page was drawn from its image already
+		if (_pageFromRaster)
+			return;
+
+		if (!_useTileIndex) {
+
+			SkiaDocumentVisitor::traverse(page, visitor);
+			return;
+		}
+
+		// in the order of the strokes on the page
+		TileIndex::entries_type entries;
+		page.getTileIndex().getEntries(_tileRoi, entries);
+
+		for (unsigned int i = 0; i < entries.size(); i++) {
+
+			if (entries[i].stroke >= page.numStrokes())
+				continue;
+
+			Stroke& stroke = page.getStroke(entries[i].stroke);
+
+			_rangeBegin = entries[i].begin;
+			_rangeEnd   = entries[i].end;
+			_drawRange  = true;
+
+			// the outline of a curve is filled at once, draw the entries of 
+			// the same stroke in one go to not overlap them
+			if (stroke.hasCurve())
+				while (i + 1 < entries.size() && entries[i + 1].stroke == entries[i].stroke) {
+
+					i++;
+					_rangeEnd = std::max(_rangeEnd, entries[i].end);
+				}
+
+			stroke.accept(visitor);
+
+			_drawRange = false;
+		}
+	}
+
 	// other business as usual
 	using SkiaDocumentVisitor::traverse;
 
@@ -102,6 +169,17 @@ public:
 
 private:
 
+	/**
+	 * Set the stroke point until which the next draw will paint.
+	 */
+	void setDrawUntil();
+
+	/**
+	 * Get the quality to use when Auto was selected, given the number of pixels 
+	 * per document unit.
+	 */
+	Quality getAutoQuality(double scale);
+
 	// the background color
 	gui::skia_pixel_t _clearColor;
 
@@ -109,18 +187,36 @@ private:
 	bool _drawPaper;
 
 	// the number of the stroke point until which all lines connecting previous 
-	// stroke points have been drawn
-	unsigned long _drawnUntilStrokePoint, _drawnUntilStrokePointTmp;
-
-	// did we clear the canvas in a previous call already?
-	bool _canvasCleared, _canvasClearedTmp;
+	// stroke points have been drawn on the current canvas
+	unsigned long _drawnUntilStrokePoint;
 
-	// did we draw the paper in a previous call already?
-	bool _paperDrawn, _paperDrawnTmp;
+	// the number of stroke points at the beginning of the current draw, lines 
+	// after that will be drawn in the next incremental draw
+	unsigned long _drawUntilStrokePoint;
 
 	// shall we draw incrementally?
 	bool _incremental;
 
+	// leave out the unfinished stroke?
+	bool _omitOpenStroke;
+
+	// are we drawing a tile using the tile index?
+	bool _useTileIndex;
+
+	// the roi of the tile we are currently drawing in document units
+	util::rect<DocumentPrecision> _tileRoi;
+
+	// the range of stroke points listed in the tile index for the stroke that 
+	// is currently visited
+	bool          _drawRange;
+	unsigned long _rangeBegin, _rangeEnd;
+
+	// images of pages for far zoomed-out views
+	boost::shared_ptr<PageRasterCache> _pageRasterCache;
+
+	// the current page was drawn from its image
+	bool _pageFromRaster;
+
 	SkiaStrokeBallPainter _bestStrokePainter;
 	SkiaStrokeLinePainter _worseStrokePainter;
 };
@@ -1,6 +1,8 @@
 #ifndef YANTA_SKIA_DOCUMENT_VISITOR_H__
 #define YANTA_SKIA_DOCUMENT_VISITOR_H__
 
+#include <boost/thread/mutex.hpp>
+
 #include <SkCanvas.h>
 
 #include <document/Document.h>
@@ -18,9 +20,15 @@ public:
 	void setCanvas(SkCanvas& canvas) { _canvas = &canvas; }
 
 	/**
-	 * Set the document that shall be draw by subsequent draw() calls.
+	 * Set the document that shall be draw by subsequent draw() calls. This can 
+	 * be called while another thread is drawing, the document will be used 
+	 * from the next draw() on.
 	 */
-	void setDocument(boost::shared_ptr<Document> document) { _document = document; }
+	void setDocument(boost::shared_ptr<Document> document) {
+
+		boost::lock_guard<boost::mutex> lock(_documentMutex);
+		_nextDocument = document;
+	}
 
 	/**
 	 * Get the document to visit.
@@ -30,7 +38,11 @@ public:
 	/**
 	 * Check whether a document was set for this visitor already.
 	 */
-	bool hasDocument() { return _document; }
+	bool hasDocument() {
+
+		boost::lock_guard<boost::mutex> lock(_documentMutex);
+		return _nextDocument;
+	}
 
 	/**
 	 * Set the transformation to map from document units to pixel units.
@@ -67,11 +79,27 @@ public:
 
 protected:
 
+	/**
+	 * Start using the document that was set last. Call this at the beginning 
+	 * of a draw, the document does not change until the next call.
+	 */
+	void updateDocument() {
+
+		boost::lock_guard<boost::mutex> lock(_documentMutex);
+		_document = _nextDocument;
+	}
+
 	/**
 	 * Get the skia canvas to draw to.
 	 */
 	SkCanvas& getCanvas() { return *_canvas; }
 
+	/**
+	 * Get the current device transformation.
+	 */
+	const util::point<double>& getPixelsPerDeviceUnit() const { return _pixelsPerDeviceUnit; }
+	const util::point<int>&    getPixelOffset() const { return _pixelOffset; }
+
 private:
 
 	// the skia canvas to draw to
@@ -80,6 +108,11 @@ private:
 	// the document to draw
 	boost::shared_ptr<Document> _document;
 
+	// the document to draw from the next draw on, and a mutex to set it from 
+	// other threads
+	boost::shared_ptr<Document> _nextDocument;
+	boost::mutex                _documentMutex;
+
 	// the device transformation (document to skia canvas)
 	util::point<double> _pixelsPerDeviceUnit;
 	util::point<int>    _pixelOffset;
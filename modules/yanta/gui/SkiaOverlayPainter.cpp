@@ -1,3 +1,6 @@
+#include <cmath>
+
+#include <SkBitmap.h>
 #include <SkMaskFilter.h>
 #include <SkBlurMaskFilter.h>
 
@@ -7,7 +10,10 @@
 
 logger::LogChannel skiaoverlaypainterlog("skiaoverlaypainterlog", "[SkiaOverlayPainter] ");
 
-SkiaOverlayPainter::SkiaOverlayPainter() {
+SkiaOverlayPainter::SkiaOverlayPainter() :
+	_layerVersion(0),
+	_layerWidth(0),
+	_layerHeight(0) {
 
 	_selectionPaint.setColor(SkColorSetARGB(25, 0, 0, 0));
 	_selectionPaint.setAntiAlias(true);
@@ -21,6 +27,9 @@ SkiaOverlayPainter::draw(
 		SkCanvas& canvas,
 		const util::rect<DocumentPrecision>& roi) {
 
+	// the selections are drawn from a snapshot of the document
+	updateDocument();
+
 	setCanvas(canvas);
 
 	prepare(roi);
@@ -28,6 +37,13 @@ SkiaOverlayPainter::draw(
 	// clear the surface, respecting the clipping
 	canvas.clear(SkColorSetARGB(0, 255, 255, 255));
 
+	// the selection was anchored or dropped, release the layer
+	if (_layerVersion != 0 && getDocument().size<Selection>() == 0) {
+
+		std::vector<gui::skia_pixel_t>().swap(_layerPixels);
+		_layerVersion = 0;
+	}
+
 	{
 		// make sure reading access to the stroke points are safe
 		boost::shared_lock<boost::shared_mutex> lock(getDocument().getStrokePoints().getMutex());
@@ -40,15 +56,19 @@ SkiaOverlayPainter::draw(
 		LOG_DEBUG(skiaoverlaypainterlog) << "done visiting document" << std::endl;
 	}
 
-	// draw the tools
-	for (Tools::iterator i = _tools->begin(); i != _tools->end(); i++) {
+	{
+		// the input thread must not change the tools while we draw them
+		boost::lock_guard<boost::mutex> lock(_tools->getMutex());
+
+		for (Tools::iterator i = _tools->begin(); i != _tools->end(); i++) {
 
-		LOG_ALL(skiaoverlaypainterlog) << "drawing a tool" << std::endl;
+			LOG_ALL(skiaoverlaypainterlog) << "drawing a tool" << std::endl;
 
-		Tool& tool = *(*i);
+			Tool& tool = *(*i);
 
-		if (tool.getBoundingBox().intersects(getRoi()))
-			tool.draw(canvas);
+			if (tool.getBoundingBox().intersects(getRoi()))
+				tool.draw(canvas);
+		}
 	}
 
 	finish();
@@ -72,3 +92,89 @@ SkiaOverlayPainter::visit(Selection& selection) {
 
 	getCanvas().drawPath(path, _selectionPaint);
 }
+
+bool
+SkiaOverlayPainter::drawSelectionLayer(Selection& selection) {
+
+	if (
+			selection.getContentVersion() != _layerVersion ||
+			getPixelsPerDeviceUnit() != _layerPixelsPerDeviceUnit) {
+
+		// pixels per selection unit at the current scale of the selection
+		util::point<double> resolution = getPixelsPerDeviceUnit()*selection.getScale();
+
+		// the area of the strokes in selection units, with a border of two 
+		// pixels for antialiasing
+		util::rect<DocumentPrecision> region = (selection.getBoundingBox() - selection.getShift())/selection.getScale();
+		region.minX -= 2/resolution.x;
+		region.minY -= 2/resolution.y;
+		region.maxX += 2/resolution.x;
+		region.maxY += 2/resolution.y;
+
+		unsigned int width  = (unsigned int)ceil(region.width()*resolution.x);
+		unsigned int height = (unsigned int)ceil(region.height()*resolution.y);
+
+		if (width > MaxLayerSize || height > MaxLayerSize) {
+
+			LOG_DEBUG(skiaoverlaypainterlog) << "selection is too large for a layer of " << width << "x" << height << " pixels" << std::endl;
+
+			std::vector<gui::skia_pixel_t>().swap(_layerPixels);
+			_layerVersion = 0;
+
+			return false;
+		}
+
+		_layerVersion             = selection.getContentVersion();
+		_layerPixelsPerDeviceUnit = getPixelsPerDeviceUnit();
+		_layerRegion              = region;
+		_layerWidth               = width;
+		_layerHeight              = height;
+
+		rasterizeSelectionLayer(selection);
+	}
+
+	SkBitmap bitmap;
+	bitmap.setInfo(SkImageInfo::MakeN32Premul(_layerWidth, _layerHeight));
+	bitmap.setPixels(&_layerPixels[0]);
+
+	SkPaint paint;
+	paint.setFilterLevel(SkPaint::kLow_FilterLevel);
+
+	// the canvas is in selection units already
+	getCanvas().drawBitmapRect(
+			bitmap,
+			SkRect::MakeLTRB(_layerRegion.minX, _layerRegion.minY, _layerRegion.maxX, _layerRegion.maxY),
+			&paint);
+
+	return true;
+}
+
+void
+SkiaOverlayPainter::rasterizeSelectionLayer(Selection& selection) {
+
+	LOG_DEBUG(skiaoverlaypainterlog)
+			<< "rasterizing selection layer of " << _layerWidth << "x" << _layerHeight
+			<< " pixels for " << _layerRegion << std::endl;
+
+	_layerPixels.resize(_layerWidth*_layerHeight);
+
+	SkBitmap bitmap;
+	bitmap.setInfo(SkImageInfo::MakeN32Premul(_layerWidth, _layerHeight));
+	bitmap.setPixels(&_layerPixels[0]);
+
+	SkCanvas canvas(bitmap);
+	canvas.clear(SkColorSetARGB(0, 0, 0, 0));
+
+	// the upper left of the region is the upper left of the layer
+	canvas.scale(_layerWidth/_layerRegion.width(), _layerHeight/_layerRegion.height());
+	canvas.translate(-_layerRegion.minX, -_layerRegion.minY);
+
+	// draw the strokes on the layer instead of the overlay
+	SkCanvas& overlayCanvas = getCanvas();
+	setCanvas(canvas);
+
+	for (unsigned int i = 0; i < selection.numStrokes(); i++)
+		selection.getStroke(i).accept(*this);
+
+	setCanvas(overlayCanvas);
+}
@@ -1,8 +1,11 @@
 #ifndef YANTA_SKIA_OVERLAY_PAINTER_H__
 #define YANTA_SKIA_OVERLAY_PAINTER_H__
 
+#include <vector>
+
 #include <SkCanvas.h>
 
+#include <gui/Skia.h>
 #include <util/point.hpp>
 #include <util/rect.hpp>
 
@@ -10,10 +13,20 @@
 #include <tools/Tools.h>
 #include "SkiaDocumentPainter.h"
 
+/**
+ * Draws selections and tools. The content of a selection is rasterized once 
+ * into a layer, which is composited at the selection's current shift and 
+ * scale. Dragging or scaling a selection does therefore not require to draw 
+ * its strokes again.
+ */
 class SkiaOverlayPainter : public SkiaDocumentPainter {
 
 public:
 
+	// the maximal width and height of the selection layer in pixels, larger 
+	// selections are drawn stroke by stroke
+	static const unsigned int MaxLayerSize = 4096;
+
 	SkiaOverlayPainter();
 
 	/**
@@ -30,6 +43,11 @@ public:
 			SkCanvas& canvas,
 			const util::rect<DocumentPrecision>& roi = util::rect<DocumentPrecision>(0, 0, 0, 0));
 
+	/**
+	 * The overlay is always drawn from scratch.
+	 */
+	void setIncremental(bool) {}
+
 	/**
 	 * Overload of the traverse method for this document visitor. Calls accept() 
 	 * only on selections in a document.
@@ -41,6 +59,17 @@ public:
 		std::for_each(document.get<Selection>().begin(), document.get<Selection>().end(), traverser);
 	}
 
+	/**
+	 * Overload of the traverse method for Selections. Draws the selection 
+	 * layer instead of the strokes, if possible.
+	 */
+	template <typename VisitorType>
+	void traverse(Selection& selection, VisitorType& visitor) {
+
+		if (!drawSelectionLayer(selection))
+			SkiaDocumentVisitor::traverse(selection, visitor);
+	}
+
 	// proceed with others as defined in SkiaDocumentVisitor (not 
 	// SkiaOverlayPainter, since this one doesn't traverse into Selections)
 	using SkiaDocumentVisitor::traverse;
@@ -60,9 +89,36 @@ public:
 
 private:
 
+	/**
+	 * Draw the content of the given selection from the selection layer. 
+	 * Rasterizes the layer first, if it does not show the selection's content 
+	 * at the current device transformation. Returns false, if the selection is 
+	 * too large to be cached.
+	 */
+	bool drawSelectionLayer(Selection& selection);
+
+	/**
+	 * Draw the strokes of the selection into the selection layer.
+	 */
+	void rasterizeSelectionLayer(Selection& selection);
+
 	boost::shared_ptr<Tools> _tools;
 
 	SkPaint _selectionPaint;
+
+	// the content version of the selection shown in the layer, 0 if none
+	unsigned long _layerVersion;
+
+	// the device transformation at which the layer was rasterized
+	util::point<double> _layerPixelsPerDeviceUnit;
+
+	// the area in selection units covered by the layer
+	util::rect<DocumentPrecision> _layerRegion;
+
+	// the layer image
+	std::vector<gui::skia_pixel_t> _layerPixels;
+	unsigned int _layerWidth;
+	unsigned int _layerHeight;
 };
 
 #endif // YANTA_SKIA_OVERLAY_PAINTER_H__
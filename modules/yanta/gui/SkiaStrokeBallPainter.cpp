@@ -1,4 +1,10 @@
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
 #include <SkCanvas.h>
+#include <SkPath.h>
+#include <SkGradientShader.h>
 #include <SkMaskFilter.h>
 #include <SkBlurMaskFilter.h>
 
@@ -7,7 +13,8 @@
 #include "SkiaStrokeBallPainter.h"
 #include "util/Logger.h"
 
-SkiaStrokeBallPainter::SkiaStrokeBallPainter() {}
+SkiaStrokeBallPainter::SkiaStrokeBallPainter() :
+	_useCurves(true) {}
 
 void
 SkiaStrokeBallPainter::draw(
@@ -40,6 +47,12 @@ SkiaStrokeBallPainter::draw(
 	SkMaskFilter* maskFilter = SkBlurMaskFilter::Create(kNormal_SkBlurStyle, 0.05*penWidth, kNormal_SkBlurStyle);
 	paint.setMaskFilter(maskFilter)->unref();
 
+	if (_useCurves && stroke.hasCurve()) {
+
+		drawCurve(canvas, paint, strokePoints, stroke, beginStroke, endStroke);
+		return;
+	}
+
 	util::point<PagePrecision> previousPosition = strokePoints[beginStroke].position;
 	double pos = 0;
 	double length = 0;
@@ -73,12 +86,7 @@ SkiaStrokeBallPainter::draw(
 			util::point<PagePrecision> p = previousPosition + a*diff;
 			double pressure = (1-a)*strokePoints[i-1].pressure + a*strokePoints[i].pressure;
 
-			double alpha = alphaPressureCurve(pressure);
-			double width = widthPressureCurve(pressure);
-
-			paint.setAlpha(alpha*255.0);
-
-			canvas.drawCircle(p.x, p.y, 0.5*width*penWidth, paint);
+			drawBall(canvas, paint, p, pressure, penWidth);
 		}
 
 		length += lineLength;
@@ -88,6 +96,231 @@ SkiaStrokeBallPainter::draw(
 	return;
 }
 
+void
+SkiaStrokeBallPainter::drawCurve(
+		SkCanvas& canvas,
+		SkPaint& paint,
+		const StrokePoints& strokePoints,
+		const Stroke& stroke,
+		unsigned long beginStroke,
+		unsigned long endStroke) {
+
+	const StrokeCurve::segments_type& segments = stroke.getCurve().getSegments();
+
+	double penWidth = stroke.getStyle().width();
+
+	// the lines to draw
+	unsigned long first = beginStroke;
+	unsigned long last  = endStroke - 1;
+
+	std::vector<StrokeCurve::Segment> pieces;
+
+	for (unsigned int s = 0; s < segments.size(); s++) {
+
+		const StrokeCurve::Segment& segment = segments[s];
+
+		if (segment.begin >= last || segment.end <= first)
+			continue;
+
+		// the curve can be shared with other parts of an erased stroke, draw 
+		// only the part between our lines
+		double t0 = (segment.begin < first ? getParameter(strokePoints, segment, first) : 0.0);
+		double t1 = (segment.end   > last  ? getParameter(strokePoints, segment, last)  : 1.0);
+
+		pieces.push_back(StrokeCurve::cut(segment, t0, t1));
+	}
+
+	if (pieces.empty())
+		return;
+
+	// the opacity is set per piece by a gradient
+	paint.setAlpha(255);
+
+	// how far the pieces reach beyond their center line, including the blur
+	const double reach = penWidth;
+
+	// the direction at the start of the current piece, shared with the end of 
+	// the previous one
+	util::point<PagePrecision> direction0 = getDirection(pieces[0], true);
+
+	for (unsigned int i = 0; i < pieces.size(); i++) {
+
+		const StrokeCurve::Segment& piece = pieces[i];
+
+		// the direction at the joint with the next piece
+		util::point<PagePrecision> direction1 = getDirection(piece, false);
+		if (i + 1 < pieces.size()) {
+
+			direction1 += getDirection(pieces[i+1], true);
+
+			double length = sqrt(direction1.x*direction1.x + direction1.y*direction1.y);
+			if (length > 0)
+				direction1 = util::point<PagePrecision>(direction1.x/length, direction1.y/length);
+			else
+				direction1 = getDirection(piece, false);
+		}
+
+		util::point<PagePrecision> normal0(-direction0.y*reach, direction0.x*reach);
+		util::point<PagePrecision> normal1(-direction1.y*reach, direction1.x*reach);
+
+		// The part of the canvas that belongs to this piece, bounded by the 
+		// normals at the joints. The neighbouring pieces share the normals, 
+		// such that each pixel is drawn by exactly one piece and no seams or 
+		// overlaps appear. The ends of the stroke are extended to include the 
+		// round caps.
+		util::point<PagePrecision> begin = piece.p0;
+		util::point<PagePrecision> end   = piece.p1;
+		if (i == 0)
+			begin -= util::point<PagePrecision>(direction0.x*reach, direction0.y*reach);
+		if (i + 1 == pieces.size())
+			end += util::point<PagePrecision>(direction1.x*reach, direction1.y*reach);
+
+		SkPath area;
+		area.moveTo(begin.x - normal0.x, begin.y - normal0.y);
+		area.lineTo(end.x   - normal1.x, end.y   - normal1.y);
+		area.lineTo(end.x   + normal1.x, end.y   + normal1.y);
+		area.lineTo(begin.x + normal0.x, begin.y + normal0.y);
+		area.close();
+
+		SkPath outline;
+		addOutline(outline, piece, penWidth);
+
+		// fade the opacity of the piece with the pressure along it
+		SkColor colors[2] = {
+			SkColorSetARGB(strokeAlphaPressureCurve(piece.pressure0)*255.0, stroke.getStyle().getRed(), stroke.getStyle().getGreen(), stroke.getStyle().getBlue()),
+			SkColorSetARGB(strokeAlphaPressureCurve(piece.pressure1)*255.0, stroke.getStyle().getRed(), stroke.getStyle().getGreen(), stroke.getStyle().getBlue())
+		};
+		SkPoint points[2] = {
+			SkPoint::Make(piece.p0.x, piece.p0.y),
+			SkPoint::Make(piece.p1.x, piece.p1.y)
+		};
+
+		// a gradient needs two different points
+		if (piece.p0 == piece.p1)
+			points[1] = SkPoint::Make(piece.p0.x + direction0.x, piece.p0.y + direction0.y);
+
+		paint.setShader(SkGradientShader::CreateLinear(points, colors, 0, 2, SkShader::kClamp_TileMode))->unref();
+
+		canvas.save();
+		canvas.clipPath(area);
+		canvas.drawPath(outline, paint);
+		canvas.restore();
+
+		direction0 = direction1;
+	}
+
+	paint.setShader(0);
+}
+
+util::point<PagePrecision>
+SkiaStrokeBallPainter::getDirection(const StrokeCurve::Segment& segment, bool atBegin) {
+
+	// the tangent at the requested end (the control points can coincide with 
+	// the ends)
+	util::point<PagePrecision> tangent = (atBegin ? segment.c0 - segment.p0 : segment.p1 - segment.c1);
+
+	if (tangent.x == 0 && tangent.y == 0)
+		tangent = segment.p1 - segment.p0;
+
+	double length = sqrt(tangent.x*tangent.x + tangent.y*tangent.y);
+
+	if (length == 0)
+		return util::point<PagePrecision>(1, 0);
+
+	return util::point<PagePrecision>(tangent.x/length, tangent.y/length);
+}
+
+void
+SkiaStrokeBallPainter::addOutline(
+		SkPath& path,
+		const StrokeCurve::Segment& segment,
+		double penWidth) {
+
+	double width0 = 0.5*widthPressureCurve(segment.pressure0)*penWidth;
+	double width1 = 0.5*widthPressureCurve(segment.pressure1)*penWidth;
+
+	// the tangents at the ends (the control points can coincide with the 
+	// ends)
+	util::point<PagePrecision> chord    = segment.p1 - segment.p0;
+	util::point<PagePrecision> tangent0 = segment.c0 - segment.p0;
+	util::point<PagePrecision> tangent1 = segment.p1 - segment.c1;
+
+	if (tangent0.x == 0 && tangent0.y == 0)
+		tangent0 = chord;
+	if (tangent1.x == 0 && tangent1.y == 0)
+		tangent1 = chord;
+
+	double length0 = sqrt(tangent0.x*tangent0.x + tangent0.y*tangent0.y);
+	double length1 = sqrt(tangent1.x*tangent1.x + tangent1.y*tangent1.y);
+
+	// offset the control polygon along the normals of the ends, this is close 
+	// enough for the short segments we get from the fitting
+	if (length0 > 0 && length1 > 0) {
+
+		util::point<PagePrecision> normal0(-tangent0.y/length0*width0, tangent0.x/length0*width0);
+		util::point<PagePrecision> normal1(-tangent1.y/length1*width1, tangent1.x/length1*width1);
+
+		path.moveTo(segment.p0.x + normal0.x, segment.p0.y + normal0.y);
+		path.cubicTo(
+				segment.c0.x + normal0.x, segment.c0.y + normal0.y,
+				segment.c1.x + normal1.x, segment.c1.y + normal1.y,
+				segment.p1.x + normal1.x, segment.p1.y + normal1.y);
+		path.lineTo(segment.p1.x - normal1.x, segment.p1.y - normal1.y);
+		path.cubicTo(
+				segment.c1.x - normal1.x, segment.c1.y - normal1.y,
+				segment.c0.x - normal0.x, segment.c0.y - normal0.y,
+				segment.p0.x - normal0.x, segment.p0.y - normal0.y);
+		path.close();
+	}
+
+	// round ends, in the same direction as the outline above, such that the 
+	// overlaps are filled as well
+	path.addCircle(segment.p0.x, segment.p0.y, width0, SkPath::kCCW_Direction);
+	path.addCircle(segment.p1.x, segment.p1.y, width1, SkPath::kCCW_Direction);
+}
+
+double
+SkiaStrokeBallPainter::getParameter(
+		const StrokePoints& strokePoints,
+		const StrokeCurve::Segment& segment,
+		unsigned long index) {
+
+	double before = 0;
+	double total  = 0;
+
+	for (unsigned long i = segment.begin + 1; i <= segment.end; i++) {
+
+		util::point<PagePrecision> diff = strokePoints[i].position - strokePoints[i-1].position;
+
+		double lineLength = sqrt(diff.x*diff.x + diff.y*diff.y);
+
+		total += lineLength;
+		if (i <= index)
+			before += lineLength;
+	}
+
+	if (total == 0)
+		return 0;
+
+	return before/total;
+}
+
+void
+SkiaStrokeBallPainter::drawBall(
+		SkCanvas& canvas,
+		SkPaint& paint,
+		const util::point<PagePrecision>& position,
+		double pressure,
+		double penWidth) {
+
+	double alpha = alphaPressureCurve(pressure);
+	double width = widthPressureCurve(pressure);
+
+	paint.setAlpha(alpha*255.0);
+
+	canvas.drawCircle(position.x, position.y, 0.5*width*penWidth, paint);
+}
+
 double
 SkiaStrokeBallPainter::widthPressureCurve(double pressure) {
 
@@ -113,3 +346,11 @@ SkiaStrokeBallPainter::alphaPressureCurve(double pressure) {
 
 	return minAlpha + pressure*(maxAlpha - minAlpha);
 }
+
+double
+SkiaStrokeBallPainter::strokeAlphaPressureCurve(double pressure) {
+
+	// the balls are placed a tenth of their size apart, about ten of them 
+	// overlap at each point
+	return 1.0 - pow(1.0 - alphaPressureCurve(pressure), 10);
+}
@@ -2,9 +2,13 @@
 #define YANTA_SKIA_STROKE_BALL_PAINTER_H__
 
 #include <util/rect.hpp>
+#include <document/Precision.h>
+#include <document/StrokeCurve.h>
 
 // forward declarations
 class SkCanvas;
+class SkPaint;
+class SkPath;
 class Stroke;
 class StrokePoints;
 
@@ -14,6 +18,14 @@ public:
 
 	SkiaStrokeBallPainter();
 
+	/**
+	 * Draw strokes that have a curve from their curve, instead of their stroke 
+	 * points. Each segment of a curve is filled as an outline, with an opacity 
+	 * that follows the pressure along the segment, instead of placing balls 
+	 * along it.
+	 */
+	void setUseCurves(bool useCurves) { _useCurves = useCurves; }
+
 	void draw(
 		SkCanvas& canvas,
 		const StrokePoints& strokePoints,
@@ -22,10 +34,63 @@ public:
 		unsigned long beginStroke = 0,
 		unsigned long endStroke   = 0);
 
+	/**
+	 * The width of a ball relative to the pen width for the given pressure.
+	 */
+	static double widthPressureCurve(double pressure);
+
+	/**
+	 * The opacity of a ball for the given pressure.
+	 */
+	static double alphaPressureCurve(double pressure);
+
+	/**
+	 * The opacity of a stroke for the given pressure, i.e., of the balls that 
+	 * overlap at a point of the stroke.
+	 */
+	static double strokeAlphaPressureCurve(double pressure);
+
 private:
 
-	double widthPressureCurve(double pressure);
-	double alphaPressureCurve(double pressure);
+	void drawCurve(
+		SkCanvas& canvas,
+		SkPaint& paint,
+		const StrokePoints& strokePoints,
+		const Stroke& stroke,
+		unsigned long beginStroke,
+		unsigned long endStroke);
+
+	/**
+	 * Add the outline of a curve segment, with the width given by the 
+	 * pressure and round ends, to a path.
+	 */
+	void addOutline(
+		SkPath& path,
+		const StrokeCurve::Segment& segment,
+		double penWidth);
+
+	/**
+	 * Get the unit direction of a curve segment at its begin or end.
+	 */
+	util::point<PagePrecision> getDirection(const StrokeCurve::Segment& segment, bool atBegin);
+
+	/**
+	 * Get the parameter of the curve segment at the given stroke point, from 
+	 * the length of the stroke lines approximated by the segment.
+	 */
+	double getParameter(
+		const StrokePoints& strokePoints,
+		const StrokeCurve::Segment& segment,
+		unsigned long index);
+
+	void drawBall(
+		SkCanvas& canvas,
+		SkPaint& paint,
+		const util::point<PagePrecision>& position,
+		double pressure,
+		double penWidth);
+
+	bool _useCurves;
 };
 
 #endif // YANTA_SKIA_STROKE_BALL_PAINTER_H__
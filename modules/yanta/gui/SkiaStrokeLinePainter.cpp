@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <SkCanvas.h>
 
 #include <document/Stroke.h>
@@ -24,7 +26,6 @@ SkiaStrokeLinePainter::draw(
 	if (stroke.end() - stroke.begin() <= 1)
 		return;
 
-	double penWidth = stroke.getStyle().width();
 	unsigned char penColorRed   = stroke.getStyle().getRed();
 	unsigned char penColorGreen = stroke.getStyle().getGreen();
 	unsigned char penColorBlue  = stroke.getStyle().getBlue();
@@ -34,30 +35,96 @@ SkiaStrokeLinePainter::draw(
 	paint.setColor(SkColorSetRGB(penColorRed, penColorGreen, penColorBlue));
 	paint.setAntiAlias(true);
 
+	if (endStroke <= beginStroke + 1)
+		return;
+
 	unsigned int step = 1;
 
-	if (getQuality() <= Worst)
+	if (stroke.hasLod() && getQuality() < Best) {
+
+		// the number of pixels per stroke unit
+		double pixelScale = canvas.getTotalMatrix().getScaleX();
+
+		// the largest deviation from the stroke we accept, in pixels
+		double maxDeviation = (getQuality() <= Worst ? 1.0 : 0.5);
+
+		// find the coarsest simplification that is close enough
+		int level = -1;
+		for (unsigned int l = 0; l < Stroke::NumLodLevels; l++)
+			if (Stroke::getLodTolerance(l)*pixelScale <= maxDeviation)
+				level = l;
+
+		if (level >= 0) {
+
+			drawSimplified(canvas, paint, strokePoints, stroke, stroke.getLod(level), beginStroke, endStroke);
+			return;
+		}
+
+		// no simplification is good enough -- draw all points
+
+	} else if (getQuality() <= Worst) {
+
 		step = 9;
-	else if (getQuality() <= Medium)
+
+	} else if (getQuality() <= Medium) {
+
 		step = 3;
+	}
 
 	// for each line in the stroke
 	for (unsigned long i = beginStroke; i < endStroke - 1; i += step) {
 
-		//double alpha = alphaPressureCurve(stroke[i].pressure);
-		double width = widthPressureCurve(strokePoints[i].pressure);
+		unsigned long next = std::min(i + step, endStroke - 1);
 
-		paint.setStrokeWidth(width*penWidth);
+		drawLine(canvas, paint, strokePoints, stroke, i, next);
+	}
 
-		unsigned int next = std::min(i + step, endStroke - 1);
+	return;
+}
 
-		canvas.drawLine(
-				strokePoints[i   ].position.x, strokePoints[i   ].position.y,
-				strokePoints[next].position.x, strokePoints[next].position.y,
-				paint);
+void
+SkiaStrokeLinePainter::drawSimplified(
+		SkCanvas& canvas,
+		SkPaint& paint,
+		const StrokePoints& strokePoints,
+		const Stroke& stroke,
+		const std::vector<unsigned int>& lod,
+		unsigned long beginStroke,
+		unsigned long endStroke) {
+
+	// connect the first point of the range, the simplified points within the 
+	// range, and the last point of the range
+	unsigned long previous = beginStroke;
+
+	std::vector<unsigned int>::const_iterator i = std::upper_bound(lod.begin(), lod.end(), beginStroke - stroke.begin());
+
+	for (; i != lod.end() && stroke.begin() + *i < endStroke - 1; i++) {
+
+		drawLine(canvas, paint, strokePoints, stroke, previous, stroke.begin() + *i);
+		previous = stroke.begin() + *i;
 	}
 
-	return;
+	drawLine(canvas, paint, strokePoints, stroke, previous, endStroke - 1);
+}
+
+void
+SkiaStrokeLinePainter::drawLine(
+		SkCanvas& canvas,
+		SkPaint& paint,
+		const StrokePoints& strokePoints,
+		const Stroke& stroke,
+		unsigned long i,
+		unsigned long j) {
+
+	//double alpha = alphaPressureCurve(stroke[i].pressure);
+	double width = widthPressureCurve(strokePoints[i].pressure);
+
+	paint.setStrokeWidth(width*stroke.getStyle().width());
+
+	canvas.drawLine(
+			strokePoints[i].position.x, strokePoints[i].position.y,
+			strokePoints[j].position.x, strokePoints[j].position.y,
+			paint);
 }
 
 double
@@ -1,11 +1,14 @@
 #ifndef YANTA_SKIA_STROKE_LINE_PAINTER_H__
 #define YANTA_SKIA_STROKE_LINE_PAINTER_H__
 
+#include <vector>
+
 #include <util/rect.hpp>
 #include "Quality.h"
 
 // forward declarations
 class SkCanvas;
+class SkPaint;
 class Stroke;
 class StrokePoints;
 
@@ -35,6 +38,30 @@ public:
 
 private:
 
+	/**
+	 * Draw the part of a stroke between beginStroke and endStroke using only 
+	 * the points of a simplified version of the stroke.
+	 */
+	void drawSimplified(
+		SkCanvas& canvas,
+		SkPaint& paint,
+		const StrokePoints& strokePoints,
+		const Stroke& stroke,
+		const std::vector<unsigned int>& lod,
+		unsigned long beginStroke,
+		unsigned long endStroke);
+
+	/**
+	 * Draw the line between the stroke points i and j.
+	 */
+	void drawLine(
+		SkCanvas& canvas,
+		SkPaint& paint,
+		const StrokePoints& strokePoints,
+		const Stroke& stroke,
+		unsigned long i,
+		unsigned long j);
+
 	double widthPressureCurve(double pressure);
 
 	double alphaPressureCurve(double pressure);
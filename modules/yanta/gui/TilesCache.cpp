@@ -1,3 +1,5 @@
+#include <cstdlib>
+
 #include <boost/timer/timer.hpp>
 
 #include <SkCanvas.h>
@@ -8,18 +10,28 @@
 
 logger::LogChannel tilescachelog("tilescachelog", "[TilesCache] ");
 
+const util::rect<int> TilesCache::FullTile(0, 0, TilesCache::TileSize, TilesCache::TileSize);
+
 TilesCache::TilesCache(const util::point<int>& center) :
 	_tiles(boost::extents[Width][Height][TileSize*TileSize]),
 	_tileStates(boost::extents[Width][Height]),
 	_tileChanged(boost::extents[Width][Height]),
+	_tileDirtyAreas(boost::extents[Width][Height]),
+	_tilePreview(boost::extents[Width][Height]),
+	_tileDrawnUntil(boost::extents[Width][Height]),
 	_backgroundRasterizerStopped(false),
 	_backgroundThread(boost::bind(&TilesCache::cleanUp, this)) {
 
 	LOG_ALL(tilescachelog) << "creating new tiles cache around tile " << center << std::endl;
 
 	for (unsigned int x = 0; x < Width; x++)
-		for (unsigned int y = 0; y < Height; y++)
-			_tileChanged[x][y] = false;
+		for (unsigned int y = 0; y < Height; y++) {
+
+			_tileChanged[x][y]    = false;
+			_tileDirtyAreas[x][y] = util::rect<int>(0, 0, 0, 0);
+			_tilePreview[x][y]    = false;
+			_tileDrawnUntil[x][y] = 0;
+		}
 
 	reset(center);
 }
@@ -54,6 +66,23 @@ TilesCache::reset(const util::point<int>& center) {
 			markDirtyPhysical(util::point<int>(x, y), Invalid);
 }
 
+void
+TilesCache::recenter(const util::point<int>& center) {
+
+	util::point<int> shift = _mapping.get_region().center() - center;
+
+	LOG_ALL(tilescachelog) << "recentering cache around " << center << std::endl;
+
+	// nothing to keep
+	if (std::abs(shift.x) >= (int)Width || std::abs(shift.y) >= (int)Height) {
+
+		reset(center);
+		return;
+	}
+
+	this->shift(shift);
+}
+
 void
 TilesCache::shift(const util::point<int>& shift) {
 
@@ -148,15 +177,61 @@ TilesCache::markDirty(const util::point<int>& tile, TileState state) {
 }
 
 void
-TilesCache::markDirtyPhysical(const util::point<int>& physicalTile, TileState state) {
+TilesCache::markDirty(const util::rect<int>& area, TileState state) {
+
+	const int tileSize = TileSize;
+
+	// the tiles covering the area (rounding towards negative infinity)
+	util::rect<int> tiles(
+			area.minX >= 0 ? area.minX/tileSize : (area.minX + 1)/tileSize - 1,
+			area.minY >= 0 ? area.minY/tileSize : (area.minY + 1)/tileSize - 1,
+			area.maxX >= 1 ? (area.maxX - 1)/tileSize + 1 : area.maxX/tileSize,
+			area.maxY >= 1 ? (area.maxY - 1)/tileSize + 1 : area.maxY/tileSize);
+
+	for (int x = tiles.minX; x < tiles.maxX; x++)
+		for (int y = tiles.minY; y < tiles.maxY; y++)
+			markDirty(util::point<int>(x, y), state, area);
+}
+
+void
+TilesCache::markDirty(const util::point<int>& tile, TileState state, const util::rect<int>& area) {
+
+	if (!_mapping.get_region().contains(tile))
+		return;
+
+	util::point<int> physicalTile = _mapping.map(tile);
+
+	// the dirty area relative to the tile
+	util::rect<int> localArea = (area - tile*static_cast<int>(TileSize)).intersection(FullTile);
+
+	if (localArea.area() <= 0)
+		return;
+
+	markDirtyPhysical(physicalTile, state, localArea);
+}
+
+void
+TilesCache::markDirtyPhysical(const util::point<int>& physicalTile, TileState state, const util::rect<int>& localArea) {
 
 	// without a background clean-up thread, allow no invalid flags
 	if (!_backgroundRasterizer && state == Invalid)
 		state = NeedsRedraw;
 
-	// set the flag, but make sure we are not overwriting previous dirty flags 
-	// of higher precedence
-	_tileStates[physicalTile.x][physicalTile.y] = std::max(_tileStates[physicalTile.x][physicalTile.y], state);
+	{
+		// the background thread reads and clears the state and dirty area
+		boost::mutex::scoped_lock lock(_tileMutexes[physicalTile.x][physicalTile.y]);
+
+		// set the flag, but make sure we are not overwriting previous dirty 
+		// flags of higher precedence
+		_tileStates[physicalTile.x][physicalTile.y] = std::max(_tileStates[physicalTile.x][physicalTile.y], state);
+
+		// invalid tiles will be drawn completely
+		util::rect<int>& dirtyArea = _tileDirtyAreas[physicalTile.x][physicalTile.y];
+		if (state == Invalid || dirtyArea.isZero())
+			dirtyArea = (state == Invalid ? FullTile : localArea);
+		else
+			dirtyArea.fit(localArea);
+	}
 
 	if (_backgroundRasterizer) {
 
@@ -190,7 +265,7 @@ TilesCache::getTile(const util::point<int>& tile, Rasterizer& rasterizer) {
 		util::rect<int> tileRegion(tile.x, tile.y, tile.x + 1, tile.y + 1);
 		tileRegion *= static_cast<int>(TileSize);
 
-		updateTile(physicalTile, tileRegion, rasterizer);
+		updateTile(tile, physicalTile, tileRegion, rasterizer);
 	}
 
 	if (_tileStates[physicalTile.x][physicalTile.y] == NeedsRedraw) {
@@ -201,14 +276,26 @@ TilesCache::getTile(const util::point<int>& tile, Rasterizer& rasterizer) {
 		util::rect<int> tileRegion(tile.x, tile.y, tile.x + 1, tile.y + 1);
 		tileRegion *= static_cast<int>(TileSize);
 
-		rasterizer.setIncremental(false);
-		updateTile(physicalTile, tileRegion, rasterizer);
-		rasterizer.setIncremental(true);
+		updateTile(tile, physicalTile, tileRegion, rasterizer);
 	}
 
 	return &_tiles[physicalTile.x][physicalTile.y][0];
 }
 
+const gui::skia_pixel_t*
+TilesCache::peekTile(const util::point<int>& tile) {
+
+	if (!_mapping.get_region().contains(tile))
+		return 0;
+
+	util::point<int> physicalTile = _mapping.map(tile);
+
+	if (_tileStates[physicalTile.x][physicalTile.y] == Invalid)
+		return 0;
+
+	return &_tiles[physicalTile.x][physicalTile.y][0];
+}
+
 bool
 TilesCache::wasChanged(const util::point<int>& tile) {
 
@@ -232,24 +319,52 @@ TilesCache::setBackgroundRasterizer(boost::shared_ptr<Rasterizer> rasterizer) {
 }
 
 void
-TilesCache::updateTile(const util::point<int>& physicalTile, const util::rect<int>& tileRegion, Rasterizer& rasterizer) {
+TilesCache::updateTile(const util::point<int>& tile, const util::point<int>& physicalTile, const util::rect<int>& tileRegion, Rasterizer& rasterizer) {
 
 	LOG_ALL(tilescachelog) << "updating physical tile " << physicalTile << " with content of " << tileRegion << std::endl;
 
+	TileState       state;
+	util::rect<int> dirtyArea;
+	unsigned long   drawnUntil;
+	bool            wasPreview;
+
+	{
+		// take the state, dirty area, watermark, and preview flag, changes 
+		// after this will be drawn in the next update
+		boost::mutex::scoped_lock lock(_tileMutexes[physicalTile.x][physicalTile.y]);
+
+		state      = _tileStates[physicalTile.x][physicalTile.y];
+		dirtyArea  = _tileDirtyAreas[physicalTile.x][physicalTile.y];
+		drawnUntil = _tileDrawnUntil[physicalTile.x][physicalTile.y];
+		wasPreview = _tilePreview[physicalTile.x][physicalTile.y];
+
+		// mark it as clean
+		_tileStates[physicalTile.x][physicalTile.y] = Clean;
+		_tileDirtyAreas[physicalTile.x][physicalTile.y] = util::rect<int>(0, 0, 0, 0);
+	}
+
 	// It can happen that a clean-up request became stale because getTile() 
 	// cleaned the tile already. In this case, there is nothing to do here.
-	if (_tileStates[physicalTile.x][physicalTile.y] == Clean) {
+	if (state == Clean) {
 
 		LOG_ALL(tilescachelog) << "this tile is clean already -- skip update" << std::endl;
 		return;
 	}
 
-	// Possible data race:
-	// 
-	// Tile get's cleaned by someone else while we are here.
+	// Only tiles that need an update have content that can be updated 
+	// incrementally. All others are drawn from scratch.
+	bool incremental = (state == NeedsUpdate);
 
-	// mark it as clean
-	_tileStates[physicalTile.x][physicalTile.y] = Clean;
+	// Invalid tiles are drawn quickly in a lower quality first. They will be 
+	// refined once all invalid tiles are drawn.
+	Quality quality        = rasterizer.getQuality();
+	Quality targetQuality  = rasterizer.getEffectiveQuality();
+	Quality previewQuality = getPreviewQuality(targetQuality);
+	bool    preview        = (state == Invalid && previewQuality < targetQuality);
+
+	// the part of the tile that needs to be drawn
+	if (dirtyArea.isZero())
+		dirtyArea = FullTile;
 
 	// get the data of the tile
 	gui::skia_pixel_t* buffer = &_tiles[physicalTile.x][physicalTile.y][0];
@@ -270,7 +385,42 @@ TilesCache::updateTile(const util::point<int>& physicalTile, const util::rect<in
 	util::point<int> translate = -tileRegion.upperLeft();
 	canvas.translate(translate.x, translate.y);
 
-	rasterizer.draw(canvas, tileRegion);
+	rasterizer.setIncremental(incremental);
+	rasterizer.setDrawnUntil(incremental ? drawnUntil : 0);
+	if (preview) {
+
+		LOG_ALL(tilescachelog) << "drawing a preview of this tile" << std::endl;
+		rasterizer.setQuality(previewQuality);
+	}
+
+	// draw only within the dirty area (this clips the canvas)
+	rasterizer.drawTile(canvas, dirtyArea + tileRegion.upperLeft(), tile);
+
+	if (preview)
+		rasterizer.setQuality(quality);
+
+	// a tile stays a preview, unless it was completely redrawn
+	bool isPreview = preview || (wasPreview && (incremental || !(dirtyArea == FullTile)));
+
+	{
+		// publish what is on the tile now
+		boost::mutex::scoped_lock lock(_tileMutexes[physicalTile.x][physicalTile.y]);
+
+		_tileDrawnUntil[physicalTile.x][physicalTile.y] = rasterizer.getDrawnUntil();
+		_tilePreview[physicalTile.x][physicalTile.y]    = isPreview;
+	}
+
+	if (isPreview && _backgroundRasterizer)
+		markDirtyPhysical(physicalTile, NeedsRefinement);
+}
+
+Quality
+TilesCache::getPreviewQuality(Quality quality) {
+
+	if (quality > Medium)
+		return Medium;
+
+	return Worst;
 }
 
 void
@@ -322,7 +472,7 @@ TilesCache::cleanUp() {
 }
 
 bool
-TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::point<int>& tile, util::point<int>& physicalTile, util::rect<int>& tileRegion) {
+TilesCache::findTile(TileState state, version_tag::version_type& mappingVersion, util::point<int>& tile, util::point<int>& physicalTile, util::rect<int>& tileRegion) {
 
 	// for every radius around center
 	for (int radius = 0; radius < std::max((int)Width, (int)Height)/2; radius++) {
@@ -345,7 +495,7 @@ TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::poi
 			tile.x = center.x - x;
 			tile.y = center.y - radius;
 
-			if (isInvalid(tile, physicalTile, tileRegion))
+			if (hasState(tile, state, physicalTile, tileRegion))
 				return true;
 		}
 
@@ -355,7 +505,7 @@ TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::poi
 			tile.x = center.x - radius;
 			tile.y = center.y + y;
 
-			if (isInvalid(tile, physicalTile, tileRegion))
+			if (hasState(tile, state, physicalTile, tileRegion))
 				return true;
 		}
 
@@ -365,7 +515,7 @@ TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::poi
 			tile.x = center.x + x;
 			tile.y = center.y + radius;
 
-			if (isInvalid(tile, physicalTile, tileRegion))
+			if (hasState(tile, state, physicalTile, tileRegion))
 				return true;
 		}
 
@@ -375,7 +525,7 @@ TilesCache::findInvalidTile(version_tag::version_type& mappingVersion, util::poi
 			tile.x = center.x + radius;
 			tile.y = center.y - y;
 
-			if (isInvalid(tile, physicalTile, tileRegion))
+			if (hasState(tile, state, physicalTile, tileRegion))
 				return true;
 		}
 	}
@@ -396,8 +546,13 @@ TilesCache::cleanDirtyTiles(unsigned int  maxNumRequests) {
 		util::point<int> physicalTile;
 		util::rect<int>  tileRegion(0, 0, 0, 0);
 
-		if (!findInvalidTile(mappingVersion, tile, physicalTile, tileRegion))
-			return cleaned;
+		// keep the rasterizer's settings while we draw
+		boost::mutex::scoped_lock lock(_backgroundRasterizerMutex);
+
+		// invalid tiles first, then the ones that need refinement
+		if (!findTile(Invalid, mappingVersion, tile, physicalTile, tileRegion))
+			if (!findTile(NeedsRefinement, mappingVersion, tile, physicalTile, tileRegion))
+				return cleaned;
 
 		// the mapping changed while we were computing the physical tile and 
 		// region
@@ -407,7 +562,9 @@ TilesCache::cleanDirtyTiles(unsigned int  maxNumRequests) {
 		LOG_DEBUG(tilescachelog) << "cleaning physical tile " << physicalTile << std::endl;
 
 		// update it
-		updateTile(physicalTile, tileRegion, *_backgroundRasterizer);
+		updateTile(tile, physicalTile, tileRegion, *_backgroundRasterizer);
+
+		lock.unlock();
 
 		_tileChanged[physicalTile.x][physicalTile.y] = true;
 
@@ -423,16 +580,16 @@ TilesCache::cleanDirtyTiles(unsigned int  maxNumRequests) {
 }
 
 bool
-TilesCache::isInvalid(const util::point<int>& tile, util::point<int>& physicalTile, util::rect<int>& tileRegion) {
+TilesCache::hasState(const util::point<int>& tile, TileState state, util::point<int>& physicalTile, util::rect<int>& tileRegion) {
 
 	// get physical tile
 	physicalTile = _mapping.map(tile);
 
 	LOG_ALL(tilescachelog) << "probing tile " << tile << std::endl;
 
-	if (_tileStates[physicalTile.x][physicalTile.y] == Invalid) {
+	if (_tileStates[physicalTile.x][physicalTile.y] == state) {
 
-		LOG_ALL(tilescachelog) << "tile " << tile << " is invalid" << std::endl;
+		LOG_ALL(tilescachelog) << "tile " << tile << " has state " << state << std::endl;
 
 		// get the region covered by the tile in pixels
 		tileRegion = util::rect<int>(tile.x, tile.y, tile.x + 1, tile.y + 1);
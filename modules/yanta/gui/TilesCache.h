@@ -21,6 +21,9 @@ public:
 	// the size of a tile
 	static const unsigned int TileSize = 128;
 
+	// the area of a whole tile in tile-local pixels
+	static const util::rect<int> FullTile;
+
 	// the number of tiles in the x and y direction
 	static const unsigned int Width  = 64;
 	static const unsigned int Height = 64;
@@ -33,6 +36,10 @@ public:
 		// the tile is clean and ready for use
 		Clean,
 
+		// the tile is ready for use, but was drawn in a lower quality and 
+		// should be redrawn by the background thread
+		NeedsRefinement,
+
 		// the tile needs a possibly incremental update
 		NeedsUpdate,
 
@@ -43,6 +50,23 @@ public:
 		Invalid
 	};
 
+	/**
+	 * Keeps the background thread from drawing while in scope. Use it to 
+	 * change the background rasterizer's settings. The thread finishes the 
+	 * tile it is currently drawing first.
+	 */
+	class BackgroundRasterizerLock {
+
+	public:
+
+		BackgroundRasterizerLock(TilesCache& cache) :
+			_lock(cache._backgroundRasterizerMutex) {}
+
+	private:
+
+		boost::mutex::scoped_lock _lock;
+	};
+
 	/**
 	 * Create a new cache with tile 'center' being in the middle.
 	 *
@@ -62,6 +86,15 @@ public:
 	 */
 	void reset(const util::point<int>& center);
 
+	/**
+	 * Move the cache such that tile 'center' is in the middle, keeping the 
+	 * tiles that are still covered.
+	 *
+	 * @param center
+	 *              The logical coordinates of the center tile.
+	 */
+	void recenter(const util::point<int>& center);
+
 	/**
 	 * Shift the content of the cache. This method is lightweight,
 	 * it only remembers the new position and marks some tiles as dirty.
@@ -76,6 +109,24 @@ public:
 	 */
 	void markDirty(const util::point<int>& tile, TileState state);
 
+	/**
+	 * Mark all tiles intersecting the given area (in pixels) as dirty.
+	 */
+	void markDirty(const util::rect<int>& area, TileState state);
+
+	/**
+	 * Mark a part of a tile as dirty. Subsequent updates of the tile will be 
+	 * restricted to the accumulated dirty area.
+	 *
+	 * @param tile
+	 *              The logical coordinates of the tile.
+	 * @param state
+	 *              The new state of the tile.
+	 * @param area
+	 *              The dirty area in pixels.
+	 */
+	void markDirty(const util::point<int>& tile, TileState state, const util::rect<int>& area);
+
 	/**
 	 * Get the data of a tile in the cache. If the tile was marked dirty, it 
 	 * will be updated using the provided rasterizer. The caller has to ensure 
@@ -83,6 +134,12 @@ public:
 	 */
 	gui::skia_pixel_t* getTile(const util::point<int>& tile, Rasterizer& rasterizer);
 
+	/**
+	 * Get the current data of a tile without updating it. Returns 0 if the tile 
+	 * is not part of the cache or has not been drawn, yet.
+	 */
+	const gui::skia_pixel_t* peekTile(const util::point<int>& tile);
+
 	/**
 	 * Ask whether a tile was changed by the cache. If it was changed, the 
 	 * caller has to indicate that the change was observed by calling 
@@ -115,13 +172,16 @@ public:
 private:
 
 	/**
-	 * Set the dirty flag of a physical tile.
+	 * Set the dirty flag of a physical tile and add an area (in pixels relative 
+	 * to the tile's upper left corner) to its dirty area.
 	 */
-	inline void markDirtyPhysical(const util::point<int>& physicalTile, TileState state);
+	inline void markDirtyPhysical(const util::point<int>& physicalTile, TileState state, const util::rect<int>& localArea = FullTile);
 
 	/**
 	 * Update a tile.
 	 *
+	 * @param tile
+	 *              The logical coordinates of the tile.
 	 * @param physicalTile
 	 *              The physical coordinates of the tile.
 	 * @param tileRegion
@@ -129,7 +189,7 @@ private:
 	 * @param rasterizer
 	 *              The rasterizer to use.
 	 */
-	void updateTile(const util::point<int>& physicalTile, const util::rect<int>& tileRegion, Rasterizer& rasterizer);
+	void updateTile(const util::point<int>& tile, const util::point<int>& physicalTile, const util::rect<int>& tileRegion, Rasterizer& rasterizer);
 
 	/**
 	 * Entry point of the background thread.
@@ -137,9 +197,10 @@ private:
 	void cleanUp();
 
 	/**
-	 * Find the next dirty tile to clean up.
+	 * Find the next tile with the given state (Invalid or NeedsRefinement) to 
+	 * clean up.
 	 */
-	bool findInvalidTile(version_tag::version_type& mappingVersion, util::point<int>& tile, util::point<int>& physicalTile, util::rect<int>& tileRegion);
+	bool findTile(TileState state, version_tag::version_type& mappingVersion, util::point<int>& tile, util::point<int>& physicalTile, util::rect<int>& tileRegion);
 
 	/**
 	 * Clean at most maxNumRequests dirty tiles.
@@ -147,10 +208,16 @@ private:
 	unsigned int cleanDirtyTiles(unsigned int maxNumRequests);
 
 	/**
-	 * Check whether a logical tile is marked as invalid, get the physical tile 
+	 * Check whether a logical tile has the given state, get the physical tile 
 	 * and the region covered by it on-the-fly.
 	 */
-	bool isInvalid(const util::point<int>& tile, util::point<int>& physicalTile, util::rect<int>& tileRegion);
+	bool hasState(const util::point<int>& tile, TileState state, util::point<int>& physicalTile, util::rect<int>& tileRegion);
+
+	/**
+	 * Get the quality to use for a quick first draw of a tile, if the final 
+	 * quality will be the given one.
+	 */
+	Quality getPreviewQuality(Quality quality);
 
 	// 2D array of tiles
 	typedef boost::multi_array<gui::skia_pixel_t, 3> tiles_type;
@@ -164,7 +231,21 @@ private:
 	typedef boost::multi_array<bool, 2> tile_changed_type;
 	tile_changed_type _tileChanged;
 
-	// 2D array of mutexes for the tiles
+	// 2D array of the accumulated dirty areas of the tiles in tile-local pixels
+	typedef boost::multi_array<util::rect<int>, 2> tile_dirty_areas_type;
+	tile_dirty_areas_type _tileDirtyAreas;
+
+	// 2D array of flags indicating that a tile was drawn with a preview quality
+	typedef boost::multi_array<bool, 2> tile_preview_type;
+	tile_preview_type _tilePreview;
+
+	// 2D array of the stroke points until which the tiles have been drawn, used 
+	// for incremental updates
+	typedef boost::multi_array<unsigned long, 2> tile_drawn_until_type;
+	tile_drawn_until_type _tileDrawnUntil;
+
+	// 2D array of mutexes for the tiles, protecting their states, dirty 
+	// areas, preview flags, and watermarks
 	boost::mutex _tileMutexes[Width][Height];
 
 	// mapping from logical tile coordinates to physical coordinates in 2D array
@@ -188,6 +269,9 @@ private:
 	// used to stop the background rendering thread
 	bool _backgroundRasterizerStopped;
 
+	// held by the background thread while it draws a tile
+	boost::mutex _backgroundRasterizerMutex;
+
 	// the background rendering thread keeping dirty tiles clean
 	boost::thread _backgroundThread;
 
@@ -1,12 +1,22 @@
+#include <cmath>
+
+#include <boost/make_shared.hpp>
+
 #include "TorusTexture.h"
 
 logger::LogChannel torustexturelog("torustexturelog", "[TorusTexture] ");
 
-TorusTexture::TorusTexture(const util::rect<int>& region) :
+TorusTexture::TorusTexture(const util::rect<int>& region, boost::shared_ptr<TilesCache> cache) :
 	_width (region.width() /TileSize + 10),
 	_height(region.height()/TileSize + 10),
 	_outOfDates(boost::extents[_width][_height]),
+	_outOfDateAreas(boost::extents[_width][_height]),
+	_uploadBuffer(TileSize*TileSize),
+	_placeholderRegion(0, 0, 0, 0),
+	_placeholderScale(1, 1),
+	_placeholderShown(boost::extents[_width][_height]),
 	_mapping(_width, _height),
+	_cache(cache ? cache : boost::make_shared<TilesCache>()),
 	_texture(0),
 	_contentChanged(0) {
 
@@ -25,11 +35,14 @@ TorusTexture::TorusTexture(const util::rect<int>& region) :
 	for (unsigned int i = 0; i < TileSize*TileSize; i++)
 		_notDoneImage[i] = gui::skia_pixel_t(255, 0, 0, 255);
 
-	_cache.setTileChangedCallback(boost::bind(&TorusTexture::onTileChacheChanged, this, _1));
+	_cache->setTileChangedCallback(boost::bind(&TorusTexture::onTileChacheChanged, this, _1));
 }
 
 TorusTexture::~TorusTexture() {
 
+	// the cache might outlive us
+	_cache->setTileChangedCallback(boost::function<void(const util::point<int>&)>());
+
 	gui::OpenGl::Guard guard;
 
 	if (_texture)
@@ -44,6 +57,19 @@ TorusTexture::reset(const util::point<int>& center) {
 	// get the tile containing the center
 	util::point<int> centerTile(getTileCoordinate(center.x), getTileCoordinate(center.y));
 
+	resetMapping(centerTile);
+
+	// center the cache around our center tile as well
+	_cache->reset(util::point<int>(centerTile.x, centerTile.y));
+
+	// the old content is not valid anymore
+	_placeholder.clear();
+	_placeholderRegion = util::rect<int>(0, 0, 0, 0);
+}
+
+void
+TorusTexture::resetMapping(const util::point<int>& centerTile) {
+
 	// reset the tile mapping, such that all tiles around center map to 
 	// [0,w)x[0,h)
 	_mapping.reset(centerTile - util::point<int>(_width/2, _height/2));
@@ -55,13 +81,127 @@ TorusTexture::reset(const util::point<int>& center) {
 
 	LOG_DEBUG(torustexturelog) << "current shift is " << _shift << std::endl;
 
-	// center the cache around our center tile as well
-	_cache.reset(util::point<int>(centerTile.x, centerTile.y));
-
 	// mark all tiles as need-update
 	for (unsigned int x = 0; x < _width; x++)
-		for (unsigned int y = 0; y < _height; y++)
-			_outOfDates[x][y] = true;
+		for (unsigned int y = 0; y < _height; y++) {
+
+			_outOfDates[x][y]       = true;
+			_outOfDateAreas[x][y]   = TilesCache::FullTile;
+			_placeholderShown[x][y] = false;
+		}
+}
+
+void
+TorusTexture::rescale(
+		const util::point<int>&    center,
+		const util::point<double>& scaleChange,
+		const util::rect<int>&     region) {
+
+	LOG_DEBUG(torustexturelog) << "rescaling torus texture by " << scaleChange << std::endl;
+
+	keepPlaceholder(scaleChange, region);
+
+	util::point<int> centerTile(getTileCoordinate(center.x), getTileCoordinate(center.y));
+
+	resetMapping(centerTile);
+	_cache->reset(centerTile);
+}
+
+void
+TorusTexture::rescale(
+		const util::point<int>&       center,
+		const util::point<double>&    scaleChange,
+		const util::rect<int>&        region,
+		boost::shared_ptr<TilesCache> cache) {
+
+	LOG_DEBUG(torustexturelog) << "rescaling torus texture by " << scaleChange << " using another cache" << std::endl;
+
+	keepPlaceholder(scaleChange, region);
+
+	// switch to the new cache
+	if (cache != _cache) {
+
+		_cache->setTileChangedCallback(boost::function<void(const util::point<int>&)>());
+		_cache = cache;
+		_cache->setTileChangedCallback(boost::bind(&TorusTexture::onTileChacheChanged, this, _1));
+	}
+
+	util::point<int> centerTile(getTileCoordinate(center.x), getTileCoordinate(center.y));
+
+	// keep whatever the cache has for this scale already
+	resetMapping(centerTile);
+	_cache->recenter(centerTile);
+}
+
+void
+TorusTexture::keepPlaceholder(const util::point<double>& scaleChange, const util::rect<int>& region) {
+
+	// the region in pixels at the previous scale
+	util::rect<int> previousRegion(
+			(int)floor(region.minX/scaleChange.x),
+			(int)floor(region.minY/scaleChange.y),
+			(int)ceil(region.maxX/scaleChange.x),
+			(int)ceil(region.maxY/scaleChange.y));
+
+	// we can only keep what this texture covered so far
+	util::rect<int> textureRegion = _mapping.get_region();
+	textureRegion *= static_cast<int>(TileSize);
+	previousRegion = previousRegion.intersection(textureRegion);
+
+	_placeholder.clear();
+	_placeholderRegion = util::rect<int>(0, 0, 0, 0);
+
+	if (previousRegion.area() <= 0)
+		return;
+
+	// When zooming out, the previous region is larger than the region we 
+	// show. Keep only every step-th pixel of it, such that the placeholder is 
+	// not larger than the shown region.
+	int maxPixels = std::max(region.area(), static_cast<int>(TileSize*TileSize));
+	int step      = 1;
+	while (previousRegion.area()/(step*step) > maxPixels)
+		step++;
+
+	// the placeholder pixel (x, y) is the pixel (x*step, y*step) at the 
+	// previous scale
+	util::rect<int> placeholderRegion(
+			ceilDiv(previousRegion.minX, step),
+			ceilDiv(previousRegion.minY, step),
+			ceilDiv(previousRegion.maxX, step),
+			ceilDiv(previousRegion.maxY, step));
+
+	std::vector<gui::skia_pixel_t> placeholder(placeholderRegion.area(), gui::skia_pixel_t(255, 0, 0, 255));
+
+	// copy the content of the tiles we have from the cache
+	util::rect<int> tiles = getTiles(previousRegion);
+	for (int x = tiles.minX; x < tiles.maxX; x++)
+		for (int y = tiles.minY; y < tiles.maxY; y++) {
+
+			const gui::skia_pixel_t* data = _cache->peekTile(util::point<int>(x, y));
+
+			if (data == 0)
+				continue;
+
+			util::rect<int> tileRegion(x, y, x + 1, y + 1);
+			tileRegion *= static_cast<int>(TileSize);
+
+			util::rect<int> part = tileRegion.intersection(previousRegion);
+
+			for (int py = ceilDiv(part.minY, step); py*step < part.maxY; py++)
+				for (int px = ceilDiv(part.minX, step); px*step < part.maxX; px++)
+					placeholder[(py - placeholderRegion.minY)*placeholderRegion.width() + (px - placeholderRegion.minX)] =
+							data[(py*step - tileRegion.minY)*TileSize + (px*step - tileRegion.minX)];
+		}
+
+	_placeholder.swap(placeholder);
+	_placeholderRegion = placeholderRegion;
+	_placeholderScale  = util::point<double>(scaleChange.x*step, scaleChange.y*step);
+}
+
+int
+TorusTexture::ceilDiv(int a, int b) {
+
+	return (a >= 0 ? (a + b - 1)/b : -((-a)/b));
 }
 
 void
@@ -81,50 +221,50 @@ TorusTexture::shift(const util::point<int>& shift) {
 	while (_shift.x >= (int)TileSize) {
 
 		_mapping.shift(util::point<int>(-1, 0));
-		_cache.shift(util::point<int>(1, 0));
+		_cache->shift(util::point<int>(1, 0));
 		_shift.x -= TileSize;
 
 		// the new tiles are in the left column
 		util::rect<int> tilesRegion = _mapping.get_region();
 		int x = tilesRegion.minX;
 		for (int y = tilesRegion.minY; y < tilesRegion.maxY; y++)
-			markDirty(util::point<int>(x, y), OutOfDate);
+			markOutOfDate(util::point<int>(x, y));
 	}
 	while (_shift.x <= -(int)TileSize) {
 
 		_mapping.shift(util::point<int>(1, 0));
-		_cache.shift(util::point<int>(-1, 0));
+		_cache->shift(util::point<int>(-1, 0));
 		_shift.x += TileSize;
 
 		// the new tiles are in the right column
 		util::rect<int> tilesRegion = _mapping.get_region();
 		int x = tilesRegion.maxX - 1;
 		for (int y = tilesRegion.minY; y < tilesRegion.maxY; y++)
-			markDirty(util::point<int>(x, y), OutOfDate);
+			markOutOfDate(util::point<int>(x, y));
 	}
 	while (_shift.y >= (int)TileSize) {
 
 		_mapping.shift(util::point<int>(0, -1));
-		_cache.shift(util::point<int>(0, 1));
+		_cache->shift(util::point<int>(0, 1));
 		_shift.y -= TileSize;
 
 		// the new tiles are in the top column
 		util::rect<int> tilesRegion = _mapping.get_region();
 		int y = tilesRegion.minY;
 		for (int x = tilesRegion.minX; x < tilesRegion.maxX; x++)
-			markDirty(util::point<int>(x, y), OutOfDate);
+			markOutOfDate(util::point<int>(x, y));
 	}
 	while (_shift.y <= -(int)TileSize) {
 
 		_mapping.shift(util::point<int>(0, 1));
-		_cache.shift(util::point<int>(0, -1));
+		_cache->shift(util::point<int>(0, -1));
 		_shift.y += TileSize;
 
 		// the new tiles are in the bottom column
 		util::rect<int> tilesRegion = _mapping.get_region();
 		int y = tilesRegion.maxY - 1;
 		for (int x = tilesRegion.minX; x < tilesRegion.maxX; x++)
-			markDirty(util::point<int>(x, y), OutOfDate);
+			markOutOfDate(util::point<int>(x, y));
 	}
 
 	LOG_ALL(torustexturelog) << "  cache region is now " << _mapping.get_region() << std::endl;
@@ -139,7 +279,7 @@ TorusTexture::markDirty(const util::rect<int>& region, DirtyFlag dirtyFlag) {
 	// mark them dirty
 	for (int x = tiles.minX; x < tiles.maxX; x++)
 		for (int y = tiles.minY; y < tiles.maxY; y++)
-			markDirty(util::point<int>(x, y), dirtyFlag);
+			markDirty(util::point<int>(x, y), dirtyFlag, region);
 }
 
 void
@@ -182,12 +322,14 @@ TorusTexture::render(const util::rect<int>& region, Rasterizer& rasterizer) {
 
 				bool needUpdate = false;
 
-				if (_cache.wasChanged(tile)) {
+				if (_cache->wasChanged(tile)) {
 
 					LOG_ALL(torustexturelog) << "tile " << tile << " was changed in the cache" << std::endl;
 
+					// the cache redraws changed tiles completely
 					needUpdate = true;
-					_cache.seenChange(tile);
+					_outOfDateAreas[physicalTile.x][physicalTile.y] = TilesCache::FullTile;
+					_cache->seenChange(tile);
 				}
 
 				if (_outOfDates[physicalTile.x][physicalTile.y]) {
@@ -257,7 +399,7 @@ TorusTexture::render(const util::rect<int>& region, Rasterizer& rasterizer) {
 void
 TorusTexture::setBackgroundRasterizer(boost::shared_ptr<Rasterizer> rasterizer) {
 
-	_cache.setBackgroundRasterizer(rasterizer);
+	_cache->setBackgroundRasterizer(rasterizer);
 }
 
 util::rect<int>
@@ -280,7 +422,7 @@ TorusTexture::getTileCoordinate(int pixel) {
 }
 
 void
-TorusTexture::markDirty(const util::point<int>& tile, DirtyFlag dirtyFlag) {
+TorusTexture::markDirty(const util::point<int>& tile, DirtyFlag dirtyFlag, const util::rect<int>& region) {
 
 	LOG_ALL(torustexturelog) << "marking dirty tile " << tile << std::endl;
 
@@ -292,14 +434,36 @@ TorusTexture::markDirty(const util::point<int>& tile, DirtyFlag dirtyFlag) {
 		util::point<int> physicalTile = _mapping.map(tile);
 		_outOfDates[physicalTile.x][physicalTile.y] = true;
 
+		// remember which part of the tile needs to be reloaded
+		util::rect<int> localRegion = (region - tile*static_cast<int>(TileSize)).intersection(TilesCache::FullTile);
+		util::rect<int>& outOfDateArea = _outOfDateAreas[physicalTile.x][physicalTile.y];
+
+		if (outOfDateArea.isZero())
+			outOfDateArea = localRegion;
+		else
+			outOfDateArea.fit(localRegion);
+
 		LOG_ALL(torustexturelog) << "    physical tile is " << physicalTile << std::endl;
 	}
 
 	// NeedsRedraw and NeedsUpdate have to be propagated to the cache
 	if (dirtyFlag == NeedsRedraw)
-		_cache.markDirty(tile, TilesCache::NeedsRedraw);
+		_cache->markDirty(tile, TilesCache::NeedsRedraw, region);
 	else if (dirtyFlag == NeedsUpdate)
-		_cache.markDirty(tile, TilesCache::NeedsUpdate);
+		_cache->markDirty(tile, TilesCache::NeedsUpdate, region);
+}
+
+void
+TorusTexture::markOutOfDate(const util::point<int>& tile) {
+
+	if (!_mapping.get_region().contains(tile))
+		return;
+
+	util::point<int> physicalTile = _mapping.map(tile);
+
+	_outOfDates[physicalTile.x][physicalTile.y]       = true;
+	_outOfDateAreas[physicalTile.x][physicalTile.y]   = TilesCache::FullTile;
+	_placeholderShown[physicalTile.x][physicalTile.y] = false;
 }
 
 bool
@@ -309,7 +473,7 @@ TorusTexture::reloadTile(const util::point<int>& tile, const util::point<int>& p
 	LOG_ALL(torustexturelog) << "    physical tile is " << physicalTile << std::endl;
 
 	// get the tile's data (and update it on-the-fly, if needed)
-	gui::skia_pixel_t* data = _cache.getTile(tile, rasterizer);
+	gui::skia_pixel_t* data = _cache->getTile(tile, rasterizer);
 
 	// get the target area within the texture
 	util::rect<int> textureRegion(physicalTile.x, physicalTile.y, physicalTile.x + 1, physicalTile.y + 1);
@@ -318,21 +482,118 @@ TorusTexture::reloadTile(const util::point<int>& tile, const util::point<int>& p
 	// partially reload the texture
 	if (data == 0) {
 
-		LOG_ALL(torustexturelog) << "    tile is not ready, yet -- showing not-done image" << std::endl;
+		if (_placeholderShown[physicalTile.x][physicalTile.y])
+			return false;
+
+		if (getPlaceholder(tile, &_uploadBuffer[0])) {
 
-		_texture->loadData(_notDoneImage, textureRegion);
+			LOG_ALL(torustexturelog) << "    tile is not ready, yet -- showing resampled previous content" << std::endl;
+
+			_texture->loadData(&_uploadBuffer[0], textureRegion);
+			_placeholderShown[physicalTile.x][physicalTile.y] = true;
+
+		} else {
+
+			LOG_ALL(torustexturelog) << "    tile is not ready, yet -- showing not-done image" << std::endl;
+
+			_texture->loadData(_notDoneImage, textureRegion);
+		}
+
+		// the whole tile will have to be reloaded
+		_outOfDateAreas[physicalTile.x][physicalTile.y] = TilesCache::FullTile;
 
 		return false;
 
-	} else {
+	}
+
+	util::rect<int>& outOfDateArea = _outOfDateAreas[physicalTile.x][physicalTile.y];
+
+	if (outOfDateArea.isZero() || outOfDateArea == TilesCache::FullTile) {
 
 		_texture->loadData(data, textureRegion);
 
-		// mark tile as up-to-date
-		_outOfDates[physicalTile.x][physicalTile.y] = false;
+	} else {
+
+		LOG_ALL(torustexturelog) << "    reloading only " << outOfDateArea << std::endl;
+
+		// copy the out-of-date part into a continuous buffer
+		unsigned int width = outOfDateArea.width();
+		for (int y = outOfDateArea.minY; y < outOfDateArea.maxY; y++)
+			std::copy(
+					data + y*TileSize + outOfDateArea.minX,
+					data + y*TileSize + outOfDateArea.maxX,
+					_uploadBuffer.begin() + (y - outOfDateArea.minY)*width);
 
-		return true;
+		_texture->loadData(&_uploadBuffer[0], outOfDateArea + textureRegion.upperLeft());
 	}
+
+	// mark tile as up-to-date
+	_outOfDates[physicalTile.x][physicalTile.y]       = false;
+	_placeholderShown[physicalTile.x][physicalTile.y] = false;
+	outOfDateArea = util::rect<int>(0, 0, 0, 0);
+
+	return true;
+}
+
+bool
+TorusTexture::getPlaceholder(const util::point<int>& tile, gui::skia_pixel_t* buffer) {
+
+	if (_placeholder.empty())
+		return false;
+
+	// the region of the tile in pixels at the current scale
+	util::rect<int> tileRegion(tile.x, tile.y, tile.x + 1, tile.y + 1);
+	tileRegion *= static_cast<int>(TileSize);
+
+	// the same region at the previous scale
+	util::rect<double> previousTileRegion = tileRegion;
+	previousTileRegion /= _placeholderScale;
+
+	if (!previousTileRegion.intersects(util::rect<double>(_placeholderRegion)))
+		return false;
+
+	const int w = _placeholderRegion.width();
+	const int h = _placeholderRegion.height();
+
+	for (unsigned int y = 0; y < TileSize; y++)
+		for (unsigned int x = 0; x < TileSize; x++) {
+
+			// the position of the pixel center in the placeholder
+			double px = (tileRegion.minX + x + 0.5)/_placeholderScale.x - 0.5 - _placeholderRegion.minX;
+			double py = (tileRegion.minY + y + 0.5)/_placeholderScale.y - 0.5 - _placeholderRegion.minY;
+
+			// not covered by the placeholder
+			if (px < -0.5 || py < -0.5 || px > w - 0.5 || py > h - 0.5) {
+
+				buffer[y*TileSize + x] = _notDoneImage[y*TileSize + x];
+				continue;
+			}
+
+			px = std::min(std::max(px, 0.0), (double)(w - 1));
+			py = std::min(std::max(py, 0.0), (double)(h - 1));
+
+			int x0 = (int)px;
+			int y0 = (int)py;
+			int x1 = std::min(x0 + 1, w - 1);
+			int y1 = std::min(y0 + 1, h - 1);
+
+			double ax = px - x0;
+			double ay = py - y0;
+
+			const gui::skia_pixel_t& p00 = _placeholder[y0*w + x0];
+			const gui::skia_pixel_t& p10 = _placeholder[y0*w + x1];
+			const gui::skia_pixel_t& p01 = _placeholder[y1*w + x0];
+			const gui::skia_pixel_t& p11 = _placeholder[y1*w + x1];
+
+			gui::skia_pixel_t& p = buffer[y*TileSize + x];
+
+			p.red   = (unsigned char)((1-ay)*((1-ax)*p00.red   + ax*p10.red)   + ay*((1-ax)*p01.red   + ax*p11.red)   + 0.5);
+			p.green = (unsigned char)((1-ay)*((1-ax)*p00.green + ax*p10.green) + ay*((1-ax)*p01.green + ax*p11.green) + 0.5);
+			p.blue  = (unsigned char)((1-ay)*((1-ax)*p00.blue  + ax*p10.blue)  + ay*((1-ax)*p01.blue  + ax*p11.blue)  + 0.5);
+			p.alpha = (unsigned char)((1-ay)*((1-ax)*p00.alpha + ax*p10.alpha) + ay*((1-ax)*p01.alpha + ax*p11.alpha) + 0.5);
+		}
+
+	return true;
 }
 
 void
@@ -35,9 +35,11 @@ public:
 
 	/**
 	 * Create a torus texture covering and representing at least the given 
-	 * region.
+	 * region. If no cache is given, the texture creates its own.
 	 */
-	TorusTexture(const util::rect<int>& region);
+	TorusTexture(
+			const util::rect<int>& region,
+			boost::shared_ptr<TilesCache> cache = boost::shared_ptr<TilesCache>());
 
 	~TorusTexture();
 
@@ -46,6 +48,33 @@ public:
 	 */
 	void reset(const util::point<int>& center);
 
+	/**
+	 * Reset the texture to represent the area around pixel 'center' after the 
+	 * scale of the content changed by scaleChange. Until they are redrawn, 
+	 * tiles will show the previous content of region (given in the new pixel 
+	 * coordinates), resampled to the new scale.
+	 */
+	void rescale(
+			const util::point<int>&    center,
+			const util::point<double>& scaleChange,
+			const util::rect<int>&     region);
+
+	/**
+	 * Same as rescale() above, but switch to another cache that holds content 
+	 * for the new scale already. The cache will be recentered instead of being 
+	 * reset.
+	 */
+	void rescale(
+			const util::point<int>&       center,
+			const util::point<double>&    scaleChange,
+			const util::rect<int>&        region,
+			boost::shared_ptr<TilesCache> cache);
+
+	/**
+	 * Get the cache this texture gets its tiles from.
+	 */
+	boost::shared_ptr<TilesCache> getCache() { return _cache; }
+
 	/**
 	 * Shift the content of the texture by the given amount.
 	 */
@@ -75,6 +104,24 @@ public:
 
 private:
 
+	/**
+	 * Reset the mapping of the texture to represent the area around tile 
+	 * 'centerTile', without changing the cache.
+	 */
+	void resetMapping(const util::point<int>& centerTile);
+
+	/**
+	 * Copy the content of the given region from the cache and keep it as a 
+	 * placeholder for tiles that are not ready, yet. Only the part covered by 
+	 * this texture is kept, subsampled to at most the size of the region.
+	 */
+	void keepPlaceholder(const util::point<double>& scaleChange, const util::rect<int>& region);
+
+	/**
+	 * Integer division rounding towards positive infinity, for positive b.
+	 */
+	static int ceilDiv(int a, int b);
+
 	/**
 	 * Get all tiles intersecting the given region.
 	 */
@@ -86,9 +133,14 @@ private:
 	int getTileCoordinate(int pixel);
 
 	/**
-	 * Mark a tile in logical coordinates as dirty.
+	 * Mark a region of a tile in logical coordinates as dirty.
+	 */
+	void markDirty(const util::point<int>& tile, DirtyFlag dirtyFlag, const util::rect<int>& region);
+
+	/**
+	 * Mark a whole tile in logical coordinates as out-of-date.
 	 */
-	void markDirty(const util::point<int>& tile, DirtyFlag dirtyFlag);
+	void markOutOfDate(const util::point<int>& tile);
 
 	/**
 	 * Try to reload a tile. Returns false, if the tile is not present in the 
@@ -96,6 +148,12 @@ private:
 	 */
 	bool reloadTile(const util::point<int>& tile, const util::point<int>& physicalTile, Rasterizer& rasterizer);
 
+	/**
+	 * Fill a tile-sized buffer with the placeholder content for the given 
+	 * tile. Returns false, if there is no placeholder for this tile.
+	 */
+	bool getPlaceholder(const util::point<int>& tile, gui::skia_pixel_t* buffer);
+
 	/**
 	 * Callback for the tiles cache.
 	 */
@@ -119,11 +177,18 @@ private:
 	typedef boost::multi_array<bool, 2> out_of_dates_type;
 	out_of_dates_type _outOfDates;
 
+	// 2D array of the out-of-date areas of the tiles in tile-local pixels
+	typedef boost::multi_array<util::rect<int>, 2> out_of_date_areas_type;
+	out_of_date_areas_type _outOfDateAreas;
+
+	// buffer to copy out-of-date parts of tiles to before uploading them
+	std::vector<gui::skia_pixel_t> _uploadBuffer;
+
 	// mapping from logical tile coordinats to phsical tile coordinates
 	torus_mapping<int> _mapping;
 
 	// the cache to get tiles from
-	TilesCache _cache;
+	boost::shared_ptr<TilesCache> _cache;
 
 	// the actual OpenGl texture
 	gui::Texture* _texture;
@@ -131,6 +196,20 @@ private:
 	// the image to show for tiles that haven't been rendered, yet
 	gui::skia_pixel_t _notDoneImage[TileSize*TileSize];
 
+	// content of the texture before the last rescale, used to fill tiles that 
+	// haven't been rendered, yet
+	std::vector<gui::skia_pixel_t> _placeholder;
+
+	// the region covered by the placeholder in pixels at the previous scale
+	util::rect<int> _placeholderRegion;
+
+	// the scale change from the placeholder to the current content
+	util::point<double> _placeholderScale;
+
+	// 2D array of flags for tiles that show their placeholder already
+	typedef boost::multi_array<bool, 2> placeholder_shown_type;
+	placeholder_shown_type _placeholderShown;
+
 	// slot to send content changed signal to
 	signals::Slot<const gui::ContentChanged>* _contentChanged;
 };
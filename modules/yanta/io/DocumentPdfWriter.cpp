@@ -24,15 +24,18 @@ DocumentPdfWriter::write() {
 
 	SkPDFDocument document;
 
+	// render a version of the document that does not change while we draw
+	boost::shared_ptr<Document> snapshot = _document->snapshot();
+
 	SkiaDocumentPainter painter;
-	painter.setDocument(_document);
+	painter.setDocument(snapshot);
 	painter.setQuality(Better);
 
-	LOG_DEBUG(documentpdfwriterlog) << "rendering document with " << _document->numPages() << " pages" << std::endl;
+	LOG_DEBUG(documentpdfwriterlog) << "rendering document with " << snapshot->numPages() << " pages" << std::endl;
 
-	for (unsigned int i = 0; i < _document->numPages(); i++) {
+	for (unsigned int i = 0; i < snapshot->numPages(); i++) {
 
-		Page& page = _document->getPage(i);
+		Page& page = snapshot->getPage(i);
 
 		LOG_DEBUG(documentpdfwriterlog) << "rendering pdf page " << i << std::endl;
 
@@ -1,5 +1,7 @@
 #include <fstream>
 
+#include <boost/make_shared.hpp>
+
 #include <util/Logger.h>
 #include "DocumentReader.h"
 
@@ -100,6 +102,11 @@ DocumentReader::readStroke(std::ifstream& in, unsigned int page, unsigned int fi
 	if (fileVersion >= 3)
 		in >> scale.x >> scale.y >> shift.x >> shift.y;
 
+	StrokeCurve::segments_type segments;
+
+	if (fileVersion >= 4)
+		readCurve(in, segments);
+
 	if (end > _document->getStrokePoints().size()) {
 
 		LOG_ERROR(documentreaderlog) << "found a stroke with invalid end point -- will ignore it" << std::endl;
@@ -117,5 +124,40 @@ DocumentReader::readStroke(std::ifstream& in, unsigned int page, unsigned int fi
 		_document->getPage(page).currentStroke().setScale(scale);
 		_document->getPage(page).currentStroke().setShift(shift);
 	}
-	_document->getPage(page).currentStroke().finish();
+	if (!segments.empty())
+		_document->getPage(page).currentStroke().setCurve(boost::make_shared<StrokeCurve>(segments));
+	_document->getPage(page).currentStroke().finish(_document->getStrokePoints());
+}
+
+void
+DocumentReader::readCurve(std::ifstream& in, StrokeCurve::segments_type& segments) {
+
+	unsigned int numSegments = 0;
+	in >> numSegments;
+
+	if (numSegments == 0)
+		return;
+
+	segments.resize(numSegments);
+
+	in
+		>> segments[0].p0.x >> segments[0].p0.y
+		>> segments[0].pressure0 >> segments[0].begin;
+
+	for (unsigned int i = 0; i < numSegments; i++) {
+
+		// continue the previous segment
+		if (i > 0) {
+
+			segments[i].p0        = segments[i-1].p1;
+			segments[i].pressure0 = segments[i-1].pressure1;
+			segments[i].begin     = segments[i-1].end;
+		}
+
+		in
+			>> segments[i].c0.x >> segments[i].c0.y
+			>> segments[i].c1.x >> segments[i].c1.y
+			>> segments[i].p1.x >> segments[i].p1.y
+			>> segments[i].pressure1 >> segments[i].end;
+	}
 }
@@ -23,6 +23,8 @@ private:
 
 	void readStroke(std::ifstream& in, unsigned int page, unsigned int fileVersion);
 
+	void readCurve(std::ifstream& in, StrokeCurve::segments_type& segments);
+
 	pipeline::Output<Document> _document;
 
 	std::string _filename;
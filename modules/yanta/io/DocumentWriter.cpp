@@ -32,18 +32,21 @@ DocumentWriter::write(const std::string& filename) {
 
 	LOG_DEBUG(documentwriterlog) << "saving to " << (filename == "" ? _filename : filename) << std::endl;
 
+	// the document might be changed while we are writing
+	boost::shared_ptr<Document> document = _document->snapshot();
+
 	std::ofstream out(filename == "" ? _filename.c_str() : filename.c_str());
 
 	// write the file version
-	out << 3 << std::endl;
+	out << 4 << std::endl;
 
-	writeStrokePoints(out, _document->getStrokePoints());
+	writeStrokePoints(out, document->getStrokePoints());
 
-	unsigned int numPages = _document->numPages();
+	unsigned int numPages = document->numPages();
 	out << numPages << std::endl;
 
 	for (unsigned int i = 0; i < numPages; i++)
-		writePage(out, _document->getPage(i));
+		writePage(out, document->getPage(i));
 }
 
 void
@@ -91,6 +94,48 @@ DocumentWriter::writeStroke(std::ofstream& out, const Stroke& stroke) {
 		<< stroke.getScale().y << " "
 		<< stroke.getShift().x << " "
 		<< stroke.getShift().y << " ";
+
+	// the segments of the curve fitted to the stroke points that approximate 
+	// this stroke (the curve can be shared with other parts of an erased 
+	// stroke)
+	unsigned int first = 0;
+	unsigned int last  = 0;
+
+	if (stroke.hasCurve() && stroke.size() >= 2) {
+
+		const StrokeCurve::segments_type& segments = stroke.getCurve().getSegments();
+
+		while (first < segments.size() && segments[first].end <= stroke.begin())
+			first++;
+
+		last = first;
+		while (last < segments.size() && segments[last].begin < stroke.end() - 1)
+			last++;
+	}
+
+	out << (last - first);
+
+	if (last == first) {
+
+		out << " ";
+		return;
+	}
+
+	// consecutive segments share their ends, store them only once
+	const StrokeCurve::segments_type& segments = stroke.getCurve().getSegments();
+
+	out << " "
+		<< segments[first].p0.x << " " << segments[first].p0.y << " "
+		<< segments[first].pressure0 << " " << segments[first].begin;
+
+	for (unsigned int i = first; i < last; i++)
+		out << " "
+			<< segments[i].c0.x << " " << segments[i].c0.y << " "
+			<< segments[i].c1.x << " " << segments[i].c1.y << " "
+			<< segments[i].p1.x << " " << segments[i].p1.y << " "
+			<< segments[i].pressure1 << " " << segments[i].end;
+
+	out << " ";
 }
 
 void
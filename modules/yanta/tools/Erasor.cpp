@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <util/Logger.h>
 #include "Erasor.h"
 
@@ -6,6 +8,8 @@ logger::LogChannel erasorlog("erasorlog", "[Erasor] ");
 Erasor::Erasor(Document& document, Mode mode) :
 	_document(document),
 	_currentPage(0),
+	_currentPageIndex(0),
+	_history(0),
 	_strokePoints(document.getStrokePoints()),
 	_mode(mode),
 	_radius(1.0) {}
@@ -25,6 +29,7 @@ Erasor::erase(
 	roi.maxX += _radius;
 	roi.maxY += _radius;
 	setRoi(roi);
+	_area = roi;
 
 	// initialize erasor line in document units
 	_start = start;
@@ -39,6 +44,16 @@ Erasor::erase(
 	return _changed;
 }
 
+void
+Erasor::visit(Page& page) {
+
+	_currentPage = &page;
+
+	for (unsigned int i = 0; i < _document.numPages(); i++)
+		if (&_document.getPage(i) == &page)
+			_currentPageIndex = i;
+}
+
 void
 Erasor::visit(Stroke& stroke) {
 
@@ -49,16 +64,45 @@ Erasor::visit(Stroke& stroke) {
 
 	LOG_ALL(erasorlog) << "in stroke stroke coordinates this is " << start << " - " << end << std::endl;
 
+	// remember which stroke of the current page this is, to keep the page's 
+	// tile index up-to-date
+	bool onCurrentPage =
+			_currentPage != 0 &&
+			_currentPage->numStrokes() > 0 &&
+			&stroke >= &_currentPage->getStroke(0) &&
+			&stroke <= &_currentPage->currentStroke();
+	unsigned int strokeIndex = (onCurrentPage ? &stroke - &_currentPage->getStroke(0) : 0);
+	unsigned int numStrokes  = (onCurrentPage ? _currentPage->numStrokes() : 0);
+	util::rect<PagePrecision> previousBoundingBox = stroke.getBoundingBox();
+
+	Stroke previous;
+	if (_history && onCurrentPage)
+		previous = stroke;
+
 	util::rect<PagePrecision> changed;
 	
 	if (_mode == ElementErasor)
 		changed = erase(stroke, start, end);
 	else
-		changed = erase(&stroke, end, _radius*_radius);
+		changed = erase(&stroke, start, end, _radius);
 
 	if (changed.isZero())
 		return;
 
+	if (onCurrentPage) {
+
+		_currentPage->strokeChanged(strokeIndex, previousBoundingBox);
+		for (unsigned int i = numStrokes; i < _currentPage->numStrokes(); i++)
+			_currentPage->strokeAdded(i);
+
+		if (_history) {
+
+			_history->strokeChanged(_currentPageIndex, strokeIndex, previous, _currentPage->getStroke(strokeIndex));
+			for (unsigned int i = numStrokes; i < _currentPage->numStrokes(); i++)
+				_history->strokeAdded(_currentPageIndex, i, _currentPage->getStroke(i));
+		}
+	}
+
 	if (_changed.isZero())
 		_changed = getTransformation().applyTo(changed);
 	else
@@ -66,7 +110,11 @@ Erasor::visit(Stroke& stroke) {
 }
 
 util::rect<PagePrecision>
-Erasor::erase(Stroke* stroke, const util::point<PagePrecision>& center, PagePrecision radius2) {
+Erasor::erase(
+		Stroke* stroke,
+		const util::point<PagePrecision>& start,
+		const util::point<PagePrecision>& end,
+		PagePrecision radius) {
 
 	util::rect<PagePrecision> changedArea(0, 0, 0, 0);
 
@@ -74,18 +122,24 @@ Erasor::erase(Stroke* stroke, const util::point<PagePrecision>& center, PagePrec
 		return changedArea;
 
 	unsigned long begin = stroke->begin();
-	unsigned long end   = stroke->end() - 1;
+	unsigned long last  = stroke->end() - 1;
 
-	LOG_ALL(erasorlog) << "testing stroke lines " << begin << " until " << (end - 1) << std::endl;
+	LOG_ALL(erasorlog) << "testing stroke lines " << begin << " until " << (last - 1) << std::endl;
+
+	// find all lines to erase at once
+	std::vector<unsigned int> hits;
+	ErasorKernel kernel(start, end, radius);
+	if (kernel.findHits(_strokePoints, begin, stroke->end(), hits) == 0)
+		return changedArea;
 
 	Style style = stroke->getStyle();
 	bool wasErasing = false;
 
 	// for each line in the stroke
-	for (unsigned long i = begin; i < end; i++) {
+	for (unsigned long i = begin; i < last; i++) {
 
 		// this line should be erased
-		if (intersectsErasorCircle(_strokePoints[i].position, _strokePoints[i+1].position, center, radius2)) {
+		if (ErasorKernel::isHit(hits, i - begin)) {
 
 			LOG_ALL(erasorlog) << "line " << i << " needs to be erased" << std::endl;
 
@@ -110,7 +164,7 @@ Erasor::erase(Stroke* stroke, const util::point<PagePrecision>& center, PagePrec
 				LOG_ALL(erasorlog) << "this is the first line to erase on this stroke" << std::endl;
 
 				stroke->setEnd(i+1, _strokePoints);
-				stroke->finish();
+				stroke->finish(_strokePoints);
 				stroke->updateBoundingBox(_strokePoints);
 				wasErasing = true;
 			}
@@ -120,21 +174,25 @@ Erasor::erase(Stroke* stroke, const util::point<PagePrecision>& center, PagePrec
 
 			LOG_ALL(erasorlog) << "line " << i << " is the next line not to erase on this stroke" << std::endl;
 
+			// the new stroke can move the previous ones
+			boost::shared_ptr<const StrokeCurve> curve = stroke->shareCurve();
+			Transformation<DocumentPrecision> transformation = stroke->getTransformation();
+
 			_currentPage->createNewStroke(i);
 			Stroke* newStroke = &(_currentPage->currentStroke());
 			newStroke->setStyle(style);
-			newStroke->setTransformation(stroke->getTransformation());
+			newStroke->setTransformation(transformation);
+			newStroke->setCurve(curve);
 			stroke = newStroke;
 			wasErasing = false;
 		}
 	}
 
-	// if we didn't split at all, this is a no-op, otherwise we finish the last 
-	// stroke
+	// finish the last stroke, unless it ends with an erased line
 	if (!wasErasing) {
 
-		stroke->setEnd(end+1, _strokePoints);
-		stroke->finish();
+		stroke->setEnd(last+1, _strokePoints);
+		stroke->finish(_strokePoints);
 		stroke->updateBoundingBox(_strokePoints);
 	}
 
@@ -185,7 +243,7 @@ Erasor::erase(Stroke& stroke, const util::point<PagePrecision>& lineBegin, const
 
 			// make this an empty stroke
 			stroke.setEnd(begin, _strokePoints);
-			stroke.finish();
+			stroke.finish(_strokePoints);
 			stroke.updateBoundingBox(_strokePoints);
 
 			break;
@@ -197,52 +255,6 @@ Erasor::erase(Stroke& stroke, const util::point<PagePrecision>& lineBegin, const
 	return changedArea;
 }
 
-bool
-Erasor::intersectsErasorCircle(
-		const util::point<PagePrecision> lineStart,
-		const util::point<PagePrecision> lineEnd,
-		const util::point<PagePrecision> center,
-		PagePrecision radius2) {
-
-	// if either of the points are in the circle, the line intersects
-	util::point<PagePrecision> diff = center - lineStart;
-	if (diff.x*diff.x + diff.y*diff.y < radius2)
-		return true;
-	diff = center - lineEnd;
-	if (diff.x*diff.x + diff.y*diff.y < radius2)
-		return true;
-
-	// see if the closest point on the line is in the circle
-
-	// the line
-	util::point<PagePrecision> lineVector = lineEnd - lineStart;
-	PagePrecision lenLineVector = sqrt(lineVector.x*lineVector.x + lineVector.y*lineVector.y);
-
-	// unit vector in the line's direction
-	util::point<PagePrecision> lineDirection = lineVector/lenLineVector;
-
-	// the direction to the erasor
-	util::point<PagePrecision> erasorVector = center - lineStart;
-	PagePrecision lenErasorVector2 = erasorVector.x*erasorVector.x + erasorVector.y*erasorVector.y;
-
-	// the dotproduct gives the distance from _strokePoints[i] to the closest 
-	// point on the line to the erasor
-	PagePrecision a = lineDirection.x*erasorVector.x + lineDirection.y*erasorVector.y;
-
-	// if a is beyond the beginning of end of the line, the line does not 
-	// intersect the circle (since the beginning and end are not in the circle)
-	if (a <= 0 || a >= lenLineVector)
-		return false;
-
-	// get the distance of the closest point to the center
-	PagePrecision erasorDistance2 = lenErasorVector2 - a*a;
-
-	if (erasorDistance2 < radius2)
-		return true;
-
-	return false;
-}
-
 bool
 Erasor::intersectLines(
 		const util::point<PagePrecision>& p,
@@ -1,8 +1,12 @@
 #ifndef YANTA_TOOLS_ERASOR_H__
 #define YANTA_TOOLS_ERASOR_H__
 
+#include <vector>
+
 #include <document/Document.h>
 #include <document/DocumentTreeRoiVisitor.h>
+#include <document/History.h>
+#include "ErasorKernel.h"
 
 class Erasor : public DocumentTreeRoiVisitor {
 
@@ -16,7 +20,8 @@ public:
 		ElementErasor,
 
 		/**
-		 * Erases everything within a certain distance to the erasor.
+		 * Erases everything within a certain distance to the erasor line, 
+		 * i.e., within the capsule swept by the erasor between two positions.
 		 */
 		SphereErasor
 	};
@@ -52,9 +57,40 @@ public:
 	void setRadius(DocumentPrecision radius) { _radius = radius; }
 
 	/**
-	 * Visitor callback for stokes.
+	 * Record the changes to the strokes in the given history.
 	 */
-	void visit(Page& page) { _currentPage = &page; }
+	void setHistory(History* history) { _history = history; }
+
+	/**
+	 * Overload of the traverse method for pages. If the page has a tile index, 
+	 * only the strokes listed in the tiles around the erasor line are visited.
+	 */
+	template <typename VisitorType>
+	void traverse(Page& page, VisitorType& visitor) {
+
+		if (!page.getTileIndex().enabled()) {
+
+			DocumentTreeRoiVisitor::traverse(page, visitor);
+			return;
+		}
+
+		std::vector<unsigned int> strokes;
+		page.getTileIndex().getStrokes(_area, strokes);
+
+		// strokes are accessed by their index, since erasing can add strokes 
+		// to the page
+		for (unsigned int i = 0; i < strokes.size(); i++)
+			if (strokes[i] < page.numStrokes() && page.getStrokeBoundingBoxes()[strokes[i]].intersects(getRoi()))
+				page.getStroke(strokes[i]).accept(visitor);
+	}
+
+	// default for other elements
+	using DocumentTreeRoiVisitor::traverse;
+
+	/**
+	 * Visitor callback for pages.
+	 */
+	void visit(Page& page);
 
 	/**
 	 * Visitor callback for stokes.
@@ -68,11 +104,13 @@ public:
 private:
 
 	/**
-	 * Erase points from a stroke by splitting. Reports the changed area.
+	 * Erase points within the capsule around the line from start to end from a 
+	 * stroke by splitting. Reports the changed area.
 	 */
 	util::rect<PagePrecision> erase(
 			Stroke* stroke,
-			const util::point<PagePrecision>& position,
+			const util::point<PagePrecision>& start,
+			const util::point<PagePrecision>& end,
 			PagePrecision radius);
 
 	/**
@@ -83,15 +121,6 @@ private:
 			const util::point<PagePrecision>& lineBegin,
 			const util::point<PagePrecision>& lineEnd);
 
-	/**
-	 * Test, whether a line intersects a circle. Radius is given squared.
-	 */
-	bool intersectsErasorCircle(
-			const util::point<PagePrecision> lineStart,
-			const util::point<PagePrecision> lineEnd,
-			const util::point<PagePrecision> center,
-			PagePrecision                    radius2);
-
 	/**
 	 * Test, whether the lines p + t*r and q + u*s, with t and u in [0,1], 
 	 * intersect.
@@ -104,7 +133,10 @@ private:
 
 	Document& _document;
 
-	Page* _currentPage;
+	Page*        _currentPage;
+	unsigned int _currentPageIndex;
+
+	History* _history;
 
 	StrokePoints& _strokePoints;
 
@@ -116,6 +148,9 @@ private:
 	util::point<DocumentPrecision> _start;
 	util::point<DocumentPrecision> _end;
 
+	// the area around the erasor line, in document units
+	util::rect<DocumentPrecision> _area;
+
 	util::rect<DocumentPrecision> _changed;
 };
 
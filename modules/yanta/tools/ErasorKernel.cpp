@@ -0,0 +1,226 @@
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ErasorKernel.h"
+
+ErasorKernel::ErasorKernel(
+		const util::point<PagePrecision>& start,
+		const util::point<PagePrecision>& end,
+		PagePrecision                     radius) :
+	_bx0(start.x),
+	_by0(start.y),
+	_bx1(end.x),
+	_by1(end.y),
+	_bdx(end.x - start.x),
+	_bdy(end.y - start.y),
+	_radius2(radius*radius) {
+
+	double length2 = _bdx*_bdx + _bdy*_bdy;
+
+	_bInvLength2 = (length2 > 0 ? 1.0/length2 : 0.0);
+}
+
+unsigned long
+ErasorKernel::findHits(
+		const StrokePoints&        points,
+		unsigned long              begin,
+		unsigned long              end,
+		std::vector<unsigned int>& hits) const {
+
+	unsigned long numLines = (end > begin + 1 ? end - begin - 1 : 0);
+
+	hits.assign((numLines + 31)/32, 0);
+
+	if (numLines == 0)
+		return 0;
+
+	// the points are copied into contiguous arrays of coordinates, batches
+	// overlap by one point to get the line between them
+	double x[BatchSize];
+	double y[BatchSize];
+
+	unsigned long numHits = 0;
+
+	for (unsigned long first = begin; first + 1 < end; first += BatchSize - 1) {
+
+		unsigned int n = std::min((unsigned long)BatchSize, end - first);
+
+		for (unsigned int i = 0; i < n; i++) {
+
+			x[i] = points[first + i].position.x;
+			y[i] = points[first + i].position.y;
+		}
+
+		numHits += findHits(x, y, n - 1, first - begin, &hits[0]);
+	}
+
+	return numHits;
+}
+
+unsigned long
+ErasorKernel::findHits(
+		const double* x,
+		const double* y,
+		unsigned int  n,
+		unsigned long offset,
+		unsigned int* hits) const {
+
+	unsigned long numHits = 0;
+	unsigned int  i       = 0;
+
+#ifdef __SSE2__
+
+	const __m128d zero    = _mm_setzero_pd();
+	const __m128d one     = _mm_set1_pd(1.0);
+	const __m128d bx0     = _mm_set1_pd(_bx0);
+	const __m128d by0     = _mm_set1_pd(_by0);
+	const __m128d bx1     = _mm_set1_pd(_bx1);
+	const __m128d by1     = _mm_set1_pd(_by1);
+	const __m128d bdx     = _mm_set1_pd(_bdx);
+	const __m128d bdy     = _mm_set1_pd(_bdy);
+	const __m128d bInvL2  = _mm_set1_pd(_bInvLength2);
+	const __m128d radius2 = _mm_set1_pd(_radius2);
+
+	// two lines at a time, from points i and i+1 to i+1 and i+2
+	for (; i + 1 < n; i += 2) {
+
+		__m128d ax0 = _mm_loadu_pd(x + i);
+		__m128d ay0 = _mm_loadu_pd(y + i);
+		__m128d ax1 = _mm_loadu_pd(x + i + 1);
+		__m128d ay1 = _mm_loadu_pd(y + i + 1);
+
+		__m128d adx = _mm_sub_pd(ax1, ax0);
+		__m128d ady = _mm_sub_pd(ay1, ay0);
+
+		// the start point of the line to the erasor line
+		__m128d px = _mm_sub_pd(ax0, bx0);
+		__m128d py = _mm_sub_pd(ay0, by0);
+		__m128d t  = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(px, bdx), _mm_mul_pd(py, bdy)), bInvL2);
+		t          = _mm_min_pd(_mm_max_pd(t, zero), one);
+		__m128d ex = _mm_sub_pd(px, _mm_mul_pd(t, bdx));
+		__m128d ey = _mm_sub_pd(py, _mm_mul_pd(t, bdy));
+		__m128d d2 = _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey));
+
+		// the end point of the line to the erasor line
+		px = _mm_sub_pd(ax1, bx0);
+		py = _mm_sub_pd(ay1, by0);
+		t  = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(px, bdx), _mm_mul_pd(py, bdy)), bInvL2);
+		t  = _mm_min_pd(_mm_max_pd(t, zero), one);
+		ex = _mm_sub_pd(px, _mm_mul_pd(t, bdx));
+		ey = _mm_sub_pd(py, _mm_mul_pd(t, bdy));
+		d2 = _mm_min_pd(d2, _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey)));
+
+		// 1/|a|², or zero for lines of length zero
+		__m128d aL2    = _mm_add_pd(_mm_mul_pd(adx, adx), _mm_mul_pd(ady, ady));
+		__m128d aInvL2 = _mm_and_pd(_mm_div_pd(one, aL2), _mm_cmpgt_pd(aL2, zero));
+
+		// the start point of the erasor line to the line
+		px = _mm_sub_pd(bx0, ax0);
+		py = _mm_sub_pd(by0, ay0);
+		t  = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(px, adx), _mm_mul_pd(py, ady)), aInvL2);
+		t  = _mm_min_pd(_mm_max_pd(t, zero), one);
+		ex = _mm_sub_pd(px, _mm_mul_pd(t, adx));
+		ey = _mm_sub_pd(py, _mm_mul_pd(t, ady));
+		d2 = _mm_min_pd(d2, _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey)));
+
+		// the end point of the erasor line to the line
+		__m128d qx = _mm_sub_pd(bx1, ax0);
+		__m128d qy = _mm_sub_pd(by1, ay0);
+		t  = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(qx, adx), _mm_mul_pd(qy, ady)), aInvL2);
+		t  = _mm_min_pd(_mm_max_pd(t, zero), one);
+		ex = _mm_sub_pd(qx, _mm_mul_pd(t, adx));
+		ey = _mm_sub_pd(qy, _mm_mul_pd(t, ady));
+		d2 = _mm_min_pd(d2, _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey)));
+
+		// the lines cross, if the end points of each are on different sides
+		// of the other
+		__m128d c0 = _mm_sub_pd(_mm_mul_pd(adx, py), _mm_mul_pd(ady, px));
+		__m128d c1 = _mm_sub_pd(_mm_mul_pd(adx, qy), _mm_mul_pd(ady, qx));
+		__m128d c2 = _mm_sub_pd(_mm_mul_pd(bdx, _mm_sub_pd(ay0, by0)), _mm_mul_pd(bdy, _mm_sub_pd(ax0, bx0)));
+		__m128d c3 = _mm_sub_pd(_mm_mul_pd(bdx, _mm_sub_pd(ay1, by0)), _mm_mul_pd(bdy, _mm_sub_pd(ax1, bx0)));
+
+		__m128d cross = _mm_and_pd(
+				_mm_cmplt_pd(_mm_mul_pd(c0, c1), zero),
+				_mm_cmplt_pd(_mm_mul_pd(c2, c3), zero));
+
+		int bits = _mm_movemask_pd(_mm_or_pd(_mm_cmplt_pd(d2, radius2), cross));
+
+		unsigned long j = offset + i;
+		hits[j >> 5]       |= (unsigned int)(bits & 1) << (j & 31);
+		hits[(j + 1) >> 5] |= (unsigned int)((bits >> 1) & 1) << ((j + 1) & 31);
+
+		numHits += (bits & 1) + ((bits >> 1) & 1);
+	}
+
+#endif // __SSE2__
+
+	// the remaining lines one by one
+	for (; i < n; i++) {
+
+		if (!isHit(x[i], y[i], x[i + 1], y[i + 1]))
+			continue;
+
+		unsigned long j = offset + i;
+		hits[j >> 5] |= 1u << (j & 31);
+		numHits++;
+	}
+
+	return numHits;
+}
+
+bool
+ErasorKernel::isHit(double ax0, double ay0, double ax1, double ay1) const {
+
+	double adx = ax1 - ax0;
+	double ady = ay1 - ay0;
+
+	// the start point of the line to the erasor line
+	double px = ax0 - _bx0;
+	double py = ay0 - _by0;
+	double t  = std::min(std::max((px*_bdx + py*_bdy)*_bInvLength2, 0.0), 1.0);
+	double ex = px - t*_bdx;
+	double ey = py - t*_bdy;
+	double d2 = ex*ex + ey*ey;
+
+	// the end point of the line to the erasor line
+	px = ax1 - _bx0;
+	py = ay1 - _by0;
+	t  = std::min(std::max((px*_bdx + py*_bdy)*_bInvLength2, 0.0), 1.0);
+	ex = px - t*_bdx;
+	ey = py - t*_bdy;
+	d2 = std::min(d2, ex*ex + ey*ey);
+
+	double aLength2    = adx*adx + ady*ady;
+	double aInvLength2 = (aLength2 > 0 ? 1.0/aLength2 : 0.0);
+
+	// the start point of the erasor line to the line
+	px = _bx0 - ax0;
+	py = _by0 - ay0;
+	t  = std::min(std::max((px*adx + py*ady)*aInvLength2, 0.0), 1.0);
+	ex = px - t*adx;
+	ey = py - t*ady;
+	d2 = std::min(d2, ex*ex + ey*ey);
+
+	// the end point of the erasor line to the line
+	double qx = _bx1 - ax0;
+	double qy = _by1 - ay0;
+	t  = std::min(std::max((qx*adx + qy*ady)*aInvLength2, 0.0), 1.0);
+	ex = qx - t*adx;
+	ey = qy - t*ady;
+	d2 = std::min(d2, ex*ex + ey*ey);
+
+	if (d2 < _radius2)
+		return true;
+
+	// the lines cross, if the end points of each are on different sides of
+	// the other
+	double c0 = adx*py - ady*px;
+	double c1 = adx*qy - ady*qx;
+	double c2 = _bdx*(ay0 - _by0) - _bdy*(ax0 - _bx0);
+	double c3 = _bdx*(ay1 - _by0) - _bdy*(ax1 - _bx0);
+
+	return c0*c1 < 0 && c2*c3 < 0;
+}
@@ -0,0 +1,81 @@
+#ifndef YANTA_TOOLS_ERASOR_KERNEL_H__
+#define YANTA_TOOLS_ERASOR_KERNEL_H__
+
+#include <vector>
+
+#include <util/point.hpp>
+#include <document/Precision.h>
+#include <document/StrokePoints.h>
+
+/**
+ * Finds the lines of a stroke that are hit by the erasor, i.e., that are
+ * closer than the erasor radius to the line the erasor moved along. The lines
+ * are tested in batches, two at a time with SSE2 where available. The result
+ * is a bitmask over the lines.
+ */
+class ErasorKernel {
+
+public:
+
+	// the number of stroke points copied into one batch
+	static const unsigned int BatchSize = 256;
+
+	/**
+	 * Create a kernel for the capsule of the given radius around the line from
+	 * start to end.
+	 */
+	ErasorKernel(
+			const util::point<PagePrecision>& start,
+			const util::point<PagePrecision>& end,
+			PagePrecision                     radius);
+
+	/**
+	 * Test the lines between consecutive stroke points in [begin, end). Sets
+	 * bit j of hits, if the line from point begin + j to begin + j + 1 is hit.
+	 * Returns the number of lines hit.
+	 */
+	unsigned long findHits(
+			const StrokePoints&         points,
+			unsigned long               begin,
+			unsigned long               end,
+			std::vector<unsigned int>&  hits) const;
+
+	/**
+	 * Test whether bit j is set in the given hits.
+	 */
+	static inline bool isHit(const std::vector<unsigned int>& hits, unsigned long j) {
+
+		return hits[j >> 5] & (1u << (j & 31));
+	}
+
+private:
+
+	/**
+	 * Test the n lines between the n + 1 points given by x and y, and set the
+	 * bits for the lines hit in hits, starting with bit offset.
+	 */
+	unsigned long findHits(
+			const double* x,
+			const double* y,
+			unsigned int  n,
+			unsigned long offset,
+			unsigned int* hits) const;
+
+	/**
+	 * Test a single line.
+	 */
+	bool isHit(double ax0, double ay0, double ax1, double ay1) const;
+
+	// the erasor line
+	double _bx0, _by0;
+	double _bx1, _by1;
+	double _bdx, _bdy;
+
+	// 1/|b|², or zero if the erasor did not move
+	double _bInvLength2;
+
+	double _radius2;
+};
+
+#endif // YANTA_TOOLS_ERASOR_KERNEL_H__
+
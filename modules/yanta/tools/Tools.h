@@ -3,6 +3,8 @@
 
 #include <list>
 
+#include <boost/thread/mutex.hpp>
+
 #include <pipeline/Data.h>
 
 #include "Tool.h"
@@ -44,10 +46,17 @@ public:
 	 */
 	unsigned int size() const { return _tools.size(); }
 
+	/**
+	 * Get the mutex that serializes changes to the tools with drawing them.
+	 */
+	boost::mutex& getMutex() { return _mutex; }
+
 private:
 
 	// the current tools
 	container _tools;
+
+	boost::mutex _mutex;
 };
 
 #endif // YANTA_TOOLS_H__
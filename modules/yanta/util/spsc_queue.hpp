@@ -0,0 +1,76 @@
+#ifndef YANTA_UTIL_SPSC_QUEUE_H__
+#define YANTA_UTIL_SPSC_QUEUE_H__
+
+#include <boost/atomic.hpp>
+
+/**
+ * A lock-free ring buffer for exactly one producer thread and one consumer
+ * thread. The producer calls push(), the consumer pop(). One slot is kept
+ * free to tell a full queue from an empty one, i.e., the queue holds at most
+ * Size - 1 elements.
+ */
+template <typename T, unsigned int Size>
+class spsc_queue {
+
+public:
+
+	spsc_queue() :
+		_head(0),
+		_tail(0) {}
+
+	/**
+	 * Append an element. Returns false if the queue is full.
+	 */
+	bool push(const T& element) {
+
+		unsigned int tail = _tail.load(boost::memory_order_relaxed);
+		unsigned int next = increment(tail);
+
+		if (next == _head.load(boost::memory_order_acquire))
+			return false;
+
+		_elements[tail] = element;
+		_tail.store(next, boost::memory_order_release);
+
+		return true;
+	}
+
+	/**
+	 * Remove the oldest element. Returns false if the queue is empty.
+	 */
+	bool pop(T& element) {
+
+		unsigned int head = _head.load(boost::memory_order_relaxed);
+
+		if (head == _tail.load(boost::memory_order_acquire))
+			return false;
+
+		element = _elements[head];
+		_head.store(increment(head), boost::memory_order_release);
+
+		return true;
+	}
+
+	/**
+	 * Check whether the queue is empty. Only reliable in the consumer thread.
+	 */
+	bool empty() const {
+
+		return _head.load(boost::memory_order_acquire) == _tail.load(boost::memory_order_acquire);
+	}
+
+private:
+
+	static unsigned int increment(unsigned int i) { return (i + 1 == Size ? 0 : i + 1); }
+
+	T _elements[Size];
+
+	// the next element to pop, written by the consumer
+	boost::atomic<unsigned int> _head;
+
+	// the next free slot, written by the producer
+	boost::atomic<unsigned int> _tail;
+};
+
+#endif // YANTA_UTIL_SPSC_QUEUE_H__
+